@@ -0,0 +1,194 @@
+/// Compile time and memory of synthetic programs as each of the generator's
+/// parameters grows while the others stay at their defaults. Run with
+/// `cargo bench --bench scaling`; pass parameter names after `--` to only
+/// scale some of them.
+///
+/// For every parameter this prints a table with the time each stage took and
+/// the peak memory live during the compile, followed by how fast each one
+/// grew at the largest values: an exponent of 1 is linear, 2 quadratic. The
+/// raw numbers are also written to `target/scaling.csv` for plotting.
+///
+/// To just write out a program use `cargo bench --bench scaling -- emit DIR
+/// [PARAMETER=VALUE]...`.
+use std::fmt::Write as FmtWrite;
+use std::path::{Path, PathBuf};
+use std::time::Instant;
+
+use inkwell::context::Context;
+
+use hummingbird::allocations::{self, peak_live_bytes, reset_peak_live_bytes, CountingAllocator};
+use hummingbird::compiler::target::build_llvm_module;
+use hummingbird::frontend::Manager;
+
+#[allow(dead_code)]
+mod support;
+
+use support::black_box;
+use support::generator::{self, Parameters, PARAMETER_NAMES};
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+const VALUES: [usize; 7] = [1, 2, 4, 8, 16, 32, 64];
+/// Growth is measured over only the largest values since fixed costs
+/// dominate the smallest ones.
+const GROWTH_POINTS: usize = 3;
+/// Each program is compiled this many times and the median time is used.
+const RUNS: usize = 3;
+/// Stages whose growth exponent is above this get flagged.
+const SUPERLINEAR: f64 = 1.3;
+
+const STAGES: [&str; 3] = ["load", "ir", "llvm"];
+
+struct Measurement {
+    /// Seconds taken by each of the `STAGES`.
+    seconds: [f64; 3],
+    peak_bytes: usize,
+}
+
+/// Compile the program, returning how long each stage took and the peak
+/// number of bytes the compile had live (on top of whatever was already).
+fn measure(paths: &Vec<PathBuf>) -> Measurement {
+    let live_before = reset_peak_live_bytes();
+    let start = Instant::now();
+    let manager = Manager::new();
+    // Only the first module is the entry; the rest are loaded beside it.
+    let entry = manager.load(paths[0].clone()).unwrap();
+    for path in paths.iter().skip(1) {
+        manager.load(path.clone()).unwrap();
+    }
+    let loaded = Instant::now();
+    let ir_modules = manager.compile_ir(&entry);
+    let compiled = Instant::now();
+    let ctx = Context::create();
+    black_box(build_llvm_module(&ctx, &ir_modules));
+    let emitted = Instant::now();
+    Measurement {
+        seconds: [
+            (loaded - start).as_secs_f64(),
+            (compiled - loaded).as_secs_f64(),
+            (emitted - compiled).as_secs_f64(),
+        ],
+        peak_bytes: peak_live_bytes() - live_before,
+    }
+}
+
+fn median(mut values: Vec<f64>) -> f64 {
+    values.sort_by(|a, b| a.partial_cmp(b).unwrap());
+    values[values.len() / 2]
+}
+
+/// Fit `y = c * x^k` to the last `GROWTH_POINTS` points and return `k`.
+fn growth_exponent(points: &[(f64, f64)]) -> f64 {
+    let logs = points[points.len().saturating_sub(GROWTH_POINTS)..]
+        .iter()
+        .filter(|(_, y)| *y > 0.0)
+        .map(|(x, y)| (x.ln(), y.ln()))
+        .collect::<Vec<_>>();
+    if logs.len() < 2 {
+        return 0.0;
+    }
+    let count = logs.len() as f64;
+    let mean_x = logs.iter().map(|(x, _)| x).sum::<f64>() / count;
+    let mean_y = logs.iter().map(|(_, y)| y).sum::<f64>() / count;
+    let covariance = logs
+        .iter()
+        .map(|(x, y)| (x - mean_x) * (y - mean_y))
+        .sum::<f64>();
+    let variance = logs.iter().map(|(x, _)| (x - mean_x).powi(2)).sum::<f64>();
+    covariance / variance
+}
+
+fn emit(args: &[String]) {
+    let directory = Path::new(args.get(0).expect("Missing directory to emit into"));
+    let mut parameters = Parameters::default();
+    for arg in args.iter().skip(1) {
+        let mut parts = arg.splitn(2, '=');
+        let name = parts.next().unwrap();
+        let value = parts.next().and_then(|value| value.parse().ok());
+        match value {
+            Some(value) if parameters.set(name, value) => (),
+            _ => panic!("Invalid parameter (expected NAME=VALUE): {}", arg),
+        }
+    }
+    for path in generator::generate(&parameters, directory).unwrap() {
+        println!("{}", path.display());
+    }
+}
+
+fn main() {
+    // Cargo passes `--bench` to benchmarks without the standard harness.
+    let args = std::env::args()
+        .skip(1)
+        .filter(|arg| !arg.starts_with("--"))
+        .collect::<Vec<_>>();
+    if args.first().map(String::as_str) == Some("emit") {
+        return emit(&args[1..]);
+    }
+    allocations::enable();
+
+    let root = Path::new(env!("CARGO_MANIFEST_DIR")).join("target");
+    let directory = root.join("scaling");
+    let mut csv = String::from("parameter,value,stage,seconds,peak_bytes\n");
+
+    for name in PARAMETER_NAMES.iter() {
+        if !args.is_empty() && !args.iter().any(|arg| arg == name) {
+            continue;
+        }
+        println!("{}:", name);
+        print!("{:>10}", "value");
+        for stage in STAGES.iter() {
+            print!(" {:>12}", format!("{} (ms)", stage));
+        }
+        println!(" {:>12}", "peak (KB)");
+
+        let mut points = vec![vec![]; STAGES.len() + 1];
+        for value in VALUES.iter() {
+            let mut parameters = Parameters::default();
+            parameters.set(name, *value);
+            let program_directory = directory.join(format!("{}-{}", name, value));
+            let paths = generator::generate(&parameters, &program_directory).unwrap();
+
+            let measurements = (0..RUNS).map(|_| measure(&paths)).collect::<Vec<_>>();
+            print!("{:>10}", value);
+            for (index, stage) in STAGES.iter().enumerate() {
+                let seconds = median(
+                    measurements
+                        .iter()
+                        .map(|measurement| measurement.seconds[index])
+                        .collect(),
+                );
+                print!(" {:>12.3}", seconds * 1000.0);
+                points[index].push((*value as f64, seconds));
+                writeln!(csv, "{},{},{},{},", name, value, stage, seconds).unwrap();
+            }
+            let peak_bytes = measurements
+                .iter()
+                .map(|measurement| measurement.peak_bytes)
+                .max()
+                .unwrap();
+            println!(" {:>12.1}", peak_bytes as f64 / 1024.0);
+            points[STAGES.len()].push((*value as f64, peak_bytes as f64));
+            writeln!(csv, "{},{},peak,,{}", name, value, peak_bytes).unwrap();
+        }
+
+        print!("{:>10}", "exponent");
+        let mut superlinear = vec![];
+        for (index, label) in STAGES.iter().chain(["peak"].iter()).enumerate() {
+            let exponent = growth_exponent(&points[index]);
+            print!(" {:>12.2}", exponent);
+            if exponent > SUPERLINEAR {
+                superlinear.push(*label);
+            }
+        }
+        println!();
+        if !superlinear.is_empty() {
+            println!("  Superlinear in {}: {}", name, superlinear.join(", "));
+        }
+        println!();
+    }
+
+    let csv_path = root.join("scaling.csv");
+    std::fs::write(&csv_path, csv).unwrap();
+    println!("Wrote {}", csv_path.display());
+}
@@ -0,0 +1,151 @@
+/// Micro-benchmarks for each stage of the compiler over the fixed corpus in
+/// `corpus.hb`. Run with `cargo bench`; pass stage names after `--` to only
+/// run some of them (eg. `cargo bench --bench stages -- lexer parser`).
+///
+/// Every stage reports its time per iteration, throughput in bytes and funcs
+/// of source per second, and how many allocations it made per iteration.
+use std::path::Path;
+use std::time::{Duration, Instant};
+
+use inkwell::context::Context;
+
+use hummingbird::allocations::{self, CountingAllocator};
+use hummingbird::compiler::ir::collect_all_func_values;
+use hummingbird::compiler::target::build_llvm_module;
+use hummingbird::frontend::Manager;
+use hummingbird::parser::{parse_module, TokenStream};
+use hummingbird::type_ast::translate_module;
+
+#[allow(dead_code)]
+mod support;
+
+use support::black_box;
+
+/// Run each stage for at least this long before measuring it.
+const WARM_UP: Duration = Duration::from_millis(200);
+/// How long each sample should take; small stages are repeated to fill it.
+const SAMPLE: Duration = Duration::from_millis(20);
+const SAMPLES: usize = 25;
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+/// How much source each iteration of a stage processes.
+#[derive(Clone, Copy)]
+struct Throughput {
+    bytes: usize,
+    funcs: usize,
+}
+
+struct Bencher {
+    filters: Vec<String>,
+}
+
+impl Bencher {
+    fn bench<T, F: FnMut() -> T>(&self, stage: &str, throughput: Throughput, mut stage_fn: F) {
+        if !self.filters.is_empty() && !self.filters.iter().any(|filter| stage.contains(filter)) {
+            return;
+        }
+
+        // Warm up and figure out how many iterations fill a sample.
+        let start = Instant::now();
+        let mut warm_up_iterations = 0u32;
+        while warm_up_iterations == 0 || start.elapsed() < WARM_UP {
+            black_box(stage_fn());
+            warm_up_iterations += 1;
+        }
+        let per_iteration = start.elapsed() / warm_up_iterations;
+        let iterations = (SAMPLE.as_nanos() / per_iteration.as_nanos().max(1)).max(1) as u32;
+
+        let (allocations_before, bytes_before) = allocations::totals();
+        black_box(stage_fn());
+        let (allocations_after, bytes_after) = allocations::totals();
+        let (allocations, allocated_bytes) = (
+            allocations_after - allocations_before,
+            bytes_after - bytes_before,
+        );
+
+        let mut samples = (0..SAMPLES)
+            .map(|_| {
+                let start = Instant::now();
+                for _ in 0..iterations {
+                    black_box(stage_fn());
+                }
+                start.elapsed().as_secs_f64() / iterations as f64
+            })
+            .collect::<Vec<_>>();
+        samples.sort_by(|a, b| a.partial_cmp(b).unwrap());
+        let median = samples[SAMPLES / 2];
+        // Median absolute deviation as a percentage, which (unlike the
+        // standard deviation) isn't thrown off by the odd slow sample.
+        let mut deviations = samples
+            .iter()
+            .map(|sample| (sample - median).abs())
+            .collect::<Vec<_>>();
+        deviations.sort_by(|a, b| a.partial_cmp(b).unwrap());
+        let deviation = deviations[SAMPLES / 2] / median * 100.0;
+
+        println!(
+            "{:<12} {:>10.3} µs/iter (±{:>4.1}%) {:>9.2} MB/s {:>11.0} funcs/s {:>8} allocs {:>10} bytes",
+            stage,
+            median * 1e6,
+            deviation,
+            throughput.bytes as f64 / median / (1024.0 * 1024.0),
+            throughput.funcs as f64 / median,
+            allocations,
+            allocated_bytes,
+        );
+    }
+}
+
+fn main() {
+    // Cargo passes `--bench` to benchmarks without the standard harness.
+    let filters = std::env::args()
+        .skip(1)
+        .filter(|arg| !arg.starts_with("--"))
+        .collect::<Vec<_>>();
+    let bencher = Bencher { filters };
+    allocations::enable();
+
+    let path = Path::new(env!("CARGO_MANIFEST_DIR")).join("benches/corpus.hb");
+    let source = std::fs::read_to_string(&path).unwrap();
+    let source_throughput = Throughput {
+        bytes: source.len(),
+        funcs: source.matches("func ").count(),
+    };
+
+    bencher.bench("lexer", source_throughput, || {
+        let mut token_stream = TokenStream::from_string(source.clone());
+        let mut tokens = 0;
+        while !token_stream.read().is_eof() {
+            tokens += 1;
+        }
+        tokens
+    });
+
+    bencher.bench("parser", source_throughput, || {
+        let mut token_stream = TokenStream::from_string(source.clone());
+        parse_module(&mut token_stream).unwrap()
+    });
+
+    let parsed = parse_module(&mut TokenStream::from_string(source.clone())).unwrap();
+    bencher.bench("type", source_throughput, || {
+        translate_module(parsed.clone()).unwrap()
+    });
+
+    // The later stages start from an already loaded program.
+    let manager = Manager::new();
+    let entry = manager.load(path.clone()).unwrap();
+    let ir_modules = manager.compile_ir(&entry);
+    let specialized_throughput = Throughput {
+        bytes: source.len(),
+        funcs: collect_all_func_values(&ir_modules).len(),
+    };
+
+    bencher.bench("ir", specialized_throughput, || manager.compile_ir(&entry));
+
+    let ctx = Context::create();
+    bencher.bench("llvm-emit", specialized_throughput, || {
+        build_llvm_module(&ctx, &ir_modules)
+    });
+}
@@ -0,0 +1,134 @@
+/// Generates synthetic programs whose size along each axis can be scaled
+/// independently, so that a stage which grows superlinearly in one of them
+/// stands out.
+///
+/// Only the first module has a main func; the others are loaded alongside it
+/// (imports aren't implemented yet) so they're only parsed and type-checked.
+use std::fmt::Write;
+use std::fs;
+use std::io;
+use std::path::{Path, PathBuf};
+
+#[derive(Clone, Debug)]
+pub struct Parameters {
+    pub modules: usize,
+    /// Funcs per module; each one calls the one defined before it.
+    pub funcs: usize,
+    /// How deeply funcs are nested within each of those funcs. This stands in
+    /// for closure nesting depth: closures are type-checked but aren't
+    /// lowered to IR yet, so a program nesting them couldn't be compiled
+    /// past the typed AST. Nested named funcs exercise the same nested
+    /// scopes in every stage.
+    pub nesting: usize,
+    /// Length of a chain of generic funcs each calling the next one.
+    pub generic_chain: usize,
+    /// How deeply calls are nested within a single expression in main.
+    pub expression_chain: usize,
+}
+
+impl Default for Parameters {
+    fn default() -> Self {
+        Self {
+            modules: 1,
+            funcs: 8,
+            nesting: 2,
+            generic_chain: 4,
+            expression_chain: 8,
+        }
+    }
+}
+
+impl Parameters {
+    /// Set a parameter by name. Returns false if there's no such parameter.
+    pub fn set(&mut self, name: &str, value: usize) -> bool {
+        let parameter = match name {
+            "modules" => &mut self.modules,
+            "funcs" => &mut self.funcs,
+            "nesting" => &mut self.nesting,
+            "generic-chain" => &mut self.generic_chain,
+            "expression-chain" => &mut self.expression_chain,
+            _ => return false,
+        };
+        *parameter = value.max(1);
+        true
+    }
+}
+
+pub const PARAMETER_NAMES: [&str; 5] = [
+    "modules",
+    "funcs",
+    "nesting",
+    "generic-chain",
+    "expression-chain",
+];
+
+/// Write every module into the directory. Returns the paths of the modules;
+/// the first one is the entry module.
+pub fn generate(parameters: &Parameters, directory: &Path) -> io::Result<Vec<PathBuf>> {
+    fs::create_dir_all(directory)?;
+    let mut paths = vec![];
+    for index in 0..parameters.modules {
+        let path = directory.join(format!("module{}.hb", index));
+        fs::write(&path, generate_module(parameters, index))?;
+        paths.push(path);
+    }
+    Ok(paths)
+}
+
+pub fn generate_module(parameters: &Parameters, index: usize) -> String {
+    let prefix = format!("m{}", index);
+    let mut source = String::new();
+    writeln!(source, "// Generated with {:?}", parameters).unwrap();
+
+    writeln!(source, "func {}_identity(a) {{\n  a\n}}", prefix).unwrap();
+
+    // Defined backwards so that each func can call the next one in the
+    // chain, since funcs can only refer to funcs defined before them.
+    for link in (0..parameters.generic_chain).rev() {
+        writeln!(source, "func {}_generic{}(a) {{", prefix, link).unwrap();
+        if link == parameters.generic_chain - 1 {
+            writeln!(source, "  a").unwrap();
+        } else {
+            writeln!(source, "  {}_generic{}(a)", prefix, link + 1).unwrap();
+        }
+        writeln!(source, "}}").unwrap();
+    }
+
+    for func in 0..parameters.funcs {
+        writeln!(source, "func {}_func{}(a, b) {{", prefix, func).unwrap();
+        write_nested(&mut source, 1, parameters.nesting);
+        writeln!(source, "  nested1(b)").unwrap();
+        if func > 0 {
+            writeln!(source, "  {}_func{}(b, a)", prefix, func - 1).unwrap();
+        }
+        writeln!(source, "}}").unwrap();
+    }
+
+    if index == 0 {
+        writeln!(source, "func main() {{").unwrap();
+        writeln!(source, "  {}_func{}(1, 2)", prefix, parameters.funcs - 1).unwrap();
+        writeln!(source, "  {}_generic0(3)", prefix).unwrap();
+        let mut expression = "4".to_string();
+        for _ in 0..parameters.expression_chain {
+            expression = format!("{}_identity({})", prefix, expression);
+        }
+        writeln!(source, "  {}", expression).unwrap();
+        writeln!(source, "}}").unwrap();
+    }
+    source
+}
+
+/// Write funcs `nested{depth}` through `nested{max_depth}`, each defined
+/// within and called by the one before it (see `Parameters::nesting` for why
+/// these aren't closures).
+fn write_nested(source: &mut String, depth: usize, max_depth: usize) {
+    let indent = "  ".repeat(depth);
+    writeln!(source, "{}func nested{}(a{}) {{", indent, depth, depth).unwrap();
+    if depth < max_depth {
+        write_nested(source, depth + 1, max_depth);
+        writeln!(source, "{}  nested{}(a{})", indent, depth + 1, depth).unwrap();
+    } else {
+        writeln!(source, "{}  a{}", indent, depth).unwrap();
+    }
+    writeln!(source, "{}}}", indent).unwrap();
+}
@@ -0,0 +1,12 @@
+/// Shared by the benchmarks: a generator for synthetic programs and
+/// `black_box`. Allocations are counted with `hummingbird::allocations`.
+pub mod generator;
+
+/// Keep the optimizer from discarding a value that's never used.
+pub fn black_box<T>(value: T) -> T {
+    unsafe {
+        let copy = std::ptr::read_volatile(&value);
+        std::mem::forget(value);
+        copy
+    }
+}
@@ -0,0 +1,134 @@
+require 'json'
+require 'open3'
+require 'tmpdir'
+
+# Differential testing: every program is run through every engine and
+# backend at every optimization level, and all of them have to print what's
+# in the program's `out` file and exit with the status in its `status` file
+# (0 if there isn't one). Programs with a `pending` file are skipped with its
+# contents as the reason.
+#
+# Compile and run times are written to `target/e2e-timings.json`.
+RSpec.describe 'End-to-end' do
+  executable = File.expand_path('../../../target/debug/hummingbird', __FILE__)
+  timings_path = File.expand_path('../../../target/e2e-timings.json', __FILE__)
+
+  directories = Dir[File.join(File.dirname(__FILE__), '*')]
+    .select { |entry| File.directory?(entry) }
+    .sort
+
+  has_clang = system('which clang > /dev/null 2>&1')
+  is_x86_64 = RbConfig::CONFIG['host_cpu'] =~ /x86_64/
+
+  # Each backend has an optional compile step (run in the build directory)
+  # and then a run step. Flags are added to every step that invokes the
+  # compiler.
+  backends = {
+    'jit' => { run: ['run'] },
+    'interp' => { run: ['run', '--interp'] },
+    'vm' => { run: ['run', '--vm'] },
+    'tiered' => { run: ['run', '--tiered'] },
+    'hot-reload' => { run: ['run', '--hot-reload'] },
+    'bytecode' => { compile: ['compile', '--bytecode'], run: ['run', 'build/out.hbc'] },
+  }
+  if has_clang
+    backends['aot'] = { compile: ['compile'], executable: 'build/out' }
+    if is_x86_64
+      backends['baseline'] = {
+        compile: ['compile', '--backend=baseline'],
+        executable: 'build/out',
+      }
+    end
+  end
+  opt_levels = (0..3).to_a
+
+  timings = {}
+
+  after(:all) do
+    next if timings.empty?
+    File.write(timings_path, JSON.pretty_generate(timings))
+
+    # Total compile and run time of each backend across all programs.
+    totals = Hash.new { |hash, key| hash[key] = { 'compile' => 0.0, 'run' => 0.0 } }
+    timings.each_value do |by_backend|
+      by_backend.each do |backend, by_opt_level|
+        by_opt_level.each_value do |timing|
+          totals[backend]['compile'] += timing['compile']
+          totals[backend]['run'] += timing['run']
+        end
+      end
+    end
+    $stderr.puts
+    $stderr.puts format('%-12s %12s %12s', 'backend', 'compile (s)', 'run (s)')
+    totals.sort.each do |backend, total|
+      $stderr.puts format('%-12s %12.3f %12.3f', backend, total['compile'], total['run'])
+    end
+    $stderr.puts "Timings written to #{timings_path}"
+  end
+
+  # Returns the output and status of the command along with how long it
+  # took in seconds.
+  def timed(command, directory)
+    start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    stdout, stderr, status = Open3.capture3(*command, chdir: directory)
+    elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+    [stdout, stderr, status, elapsed]
+  end
+
+  directories.each do |directory|
+    name = File.basename(directory)
+    source_file = File.join(directory, 'test.hb')
+    next unless File.exist?(source_file)
+
+    describe name do
+      pending_path = File.join(directory, 'pending')
+      status_path = File.join(directory, 'status')
+      expected_output = File.read(File.join(directory, 'out'))
+      expected_status = File.exist?(status_path) ? File.read(status_path).to_i : 0
+
+      backends.each do |backend, steps|
+        opt_levels.each do |opt_level|
+          it "passes with #{backend} at -O#{opt_level}" do
+            skip(File.read(pending_path).strip) if File.exist?(pending_path)
+
+            flags = ["--opt-level=#{opt_level}", '--no-cache']
+            Dir.mktmpdir('hummingbird-e2e') do |build_directory|
+              compile_time = 0.0
+              if steps[:compile]
+                command = [executable, *steps[:compile], source_file, *flags]
+                _, stderr, status, compile_time = timed(command, build_directory)
+                if status.exitstatus != 0
+                  $stderr.puts "Command failed: #{command.join(' ')}"
+                  $stderr.puts stderr
+                  expect(status.exitstatus).to eq(0)
+                end
+              end
+
+              command = if steps[:executable]
+                [File.join(build_directory, steps[:executable])]
+              elsif steps[:compile]
+                [executable, *steps[:run], *flags]
+              else
+                [executable, *steps[:run], source_file, *flags]
+              end
+              stdout, stderr, status, run_time = timed(command, build_directory)
+
+              by_backend = (timings[name] ||= {})
+              (by_backend[backend] ||= {})["O#{opt_level}"] = {
+                'compile' => compile_time,
+                'run' => run_time,
+              }
+
+              if status.exitstatus != expected_status
+                $stderr.puts "Command failed: #{command.join(' ')}"
+                $stderr.puts stderr
+              end
+              expect(stdout).to eq(expected_output)
+              expect(status.exitstatus).to eq(expected_status)
+            end
+          end
+        end
+      end
+    end
+  end
+end
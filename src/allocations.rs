@@ -0,0 +1,248 @@
+/// Allocations, bytes allocated and peak live bytes for each stage of
+/// compilation, reported by `--allocations`. Counting needs the
+/// `CountingAllocator`, which is only installed when built with the
+/// `count-allocations` feature (the benchmarks install it themselves).
+///
+/// Allocations are attributed to the innermost stage being timed (see
+/// `timings::time`); anything outside of a stage goes to "other". Memory can
+/// be freed by a different stage than the one that allocated it, so live
+/// bytes are only tracked for the whole process.
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::sync::atomic::{AtomicBool, AtomicIsize, AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+/// Stages past this many all get lumped together with the last one.
+const MAX_STAGES: usize = 32;
+
+#[derive(Default)]
+struct Counters {
+    allocations: AtomicUsize,
+    bytes: AtomicUsize,
+    /// The most bytes that were live at once in the whole process (not just
+    /// those allocated by the stage) while in the stage.
+    process_peak_live_bytes: AtomicIsize,
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+/// Signed since memory allocated before counting was enabled can be freed
+/// after it.
+static LIVE_BYTES: AtomicIsize = AtomicIsize::new(0);
+/// The most bytes live at once since `reset_peak_live_bytes`.
+static PEAK_LIVE_BYTES: AtomicIsize = AtomicIsize::new(0);
+
+lazy_static! {
+    static ref COUNTERS: Vec<Counters> = (0..MAX_STAGES).map(|_| Counters::default()).collect();
+    static ref STAGES: Mutex<Vec<&'static str>> = Mutex::new(vec!["other"]);
+}
+
+thread_local! {
+    /// Index into `STAGES` of the stage currently running on this thread.
+    static CURRENT: Cell<usize> = Cell::new(0);
+}
+
+pub fn enable() {
+    // Initialize before counting starts so that the allocator never has to.
+    lazy_static::initialize(&COUNTERS);
+    lazy_static::initialize(&STAGES);
+    ENABLED.store(true, Ordering::SeqCst);
+}
+
+pub fn is_enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+/// Attributes allocations to a stage until it's dropped.
+pub struct StageGuard(Option<usize>);
+
+pub fn enter(stage: &'static str) -> StageGuard {
+    if !is_enabled() {
+        return StageGuard(None);
+    }
+    let index = {
+        let mut stages = STAGES.lock().unwrap();
+        match stages.iter().position(|existing| *existing == stage) {
+            Some(index) => index,
+            None if stages.len() < MAX_STAGES => {
+                stages.push(stage);
+                stages.len() - 1
+            }
+            None => MAX_STAGES - 1,
+        }
+    };
+    StageGuard(Some(CURRENT.with(|current| current.replace(index))))
+}
+
+impl Drop for StageGuard {
+    fn drop(&mut self) {
+        if let Some(previous) = self.0 {
+            CURRENT.with(|current| current.set(previous));
+        }
+    }
+}
+
+pub struct CountingAllocator;
+
+impl CountingAllocator {
+    fn count(&self, size: usize) {
+        if !is_enabled() {
+            return;
+        }
+        // The thread-local can be gone while a thread is shutting down.
+        let stage = CURRENT.try_with(|current| current.get()).unwrap_or(0);
+        let counters = &COUNTERS[stage];
+        counters.allocations.fetch_add(1, Ordering::Relaxed);
+        counters.bytes.fetch_add(size, Ordering::Relaxed);
+        let live = LIVE_BYTES.fetch_add(size as isize, Ordering::Relaxed) + size as isize;
+        raise_to(&counters.process_peak_live_bytes, live);
+        raise_to(&PEAK_LIVE_BYTES, live);
+    }
+
+    fn uncount(&self, size: usize) {
+        if is_enabled() {
+            LIVE_BYTES.fetch_sub(size as isize, Ordering::Relaxed);
+        }
+    }
+}
+
+fn raise_to(peak: &AtomicIsize, live: isize) {
+    let mut current = peak.load(Ordering::Relaxed);
+    while live > current {
+        match peak.compare_exchange_weak(current, live, Ordering::Relaxed, Ordering::Relaxed) {
+            Ok(_) => break,
+            Err(actual) => current = actual,
+        }
+    }
+}
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        self.count(layout.size());
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        self.count(layout.size());
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        self.uncount(layout.size());
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        self.uncount(layout.size());
+        self.count(new_size);
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+/// The number of allocations and bytes allocated since counting was
+/// enabled, across every stage.
+pub fn totals() -> (usize, usize) {
+    COUNTERS
+        .iter()
+        .fold((0, 0), |(allocations, bytes), counters| {
+            (
+                allocations + counters.allocations.load(Ordering::Relaxed),
+                bytes + counters.bytes.load(Ordering::Relaxed),
+            )
+        })
+}
+
+/// Start tracking the peak from however many bytes are live right now.
+/// Returns that amount.
+pub fn reset_peak_live_bytes() -> usize {
+    let live = LIVE_BYTES.load(Ordering::Relaxed);
+    PEAK_LIVE_BYTES.store(live, Ordering::Relaxed);
+    live.max(0) as usize
+}
+
+pub fn peak_live_bytes() -> usize {
+    PEAK_LIVE_BYTES.load(Ordering::Relaxed).max(0) as usize
+}
+
+/// Print the counts for each stage that allocated anything, most bytes
+/// first.
+pub fn print_report() {
+    if !is_enabled() {
+        return;
+    }
+    let stages = STAGES.lock().unwrap().clone();
+    let mut rows = stages
+        .iter()
+        .enumerate()
+        .map(|(index, stage)| {
+            let counters = &COUNTERS[index];
+            (
+                *stage,
+                counters.allocations.load(Ordering::Relaxed),
+                counters.bytes.load(Ordering::Relaxed),
+                counters
+                    .process_peak_live_bytes
+                    .load(Ordering::Relaxed)
+                    .max(0) as usize,
+            )
+        })
+        .filter(|(_, allocations, _, _)| *allocations > 0)
+        .collect::<Vec<_>>();
+    rows.sort_by(|a, b| b.2.cmp(&a.2));
+
+    let megabytes = |bytes: usize| bytes as f64 / (1024.0 * 1024.0);
+    eprintln!("===-- Allocations --===");
+    eprintln!(
+        "{:>12} {:>12} {:>14}  Stage",
+        "Allocations", "Allocated", "Process peak"
+    );
+    for (stage, allocations, bytes, process_peak_live_bytes) in rows.iter() {
+        eprintln!(
+            "{:>12} {:>9.2} MB {:>11.2} MB  {}",
+            allocations,
+            megabytes(*bytes),
+            megabytes(*process_peak_live_bytes),
+            stage
+        );
+    }
+    eprintln!(
+        "{:>12} {:>9.2} MB {:>11.2} MB  Total",
+        rows.iter().map(|row| row.1).sum::<usize>(),
+        megabytes(rows.iter().map(|row| row.2).sum::<usize>()),
+        megabytes(rows.iter().map(|row| row.3).max().unwrap_or(0)),
+    );
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::atomic::Ordering;
+
+    use super::{enable, enter, CountingAllocator, COUNTERS, CURRENT, STAGES};
+
+    #[test]
+    fn test_attributes_to_innermost_stage() {
+        enable();
+        let allocator = CountingAllocator;
+        let index = |name| {
+            let stages = STAGES.lock().unwrap();
+            stages.iter().position(|stage| *stage == name).unwrap()
+        };
+        {
+            let _outer = enter("test-outer");
+            {
+                let _inner = enter("test-inner");
+                allocator.count(100);
+                allocator.uncount(100);
+            }
+            allocator.count(10);
+            allocator.uncount(10);
+        }
+        assert_eq!(CURRENT.with(|current| current.get()), 0);
+        // The test isn't using the allocator globally, so only the calls
+        // above are counted.
+        let inner = &COUNTERS[index("test-inner")];
+        let outer = &COUNTERS[index("test-outer")];
+        assert_eq!(inner.bytes.load(Ordering::Relaxed), 100);
+        assert_eq!(outer.bytes.load(Ordering::Relaxed), 10);
+        assert_eq!(outer.allocations.load(Ordering::Relaxed), 1);
+    }
+}
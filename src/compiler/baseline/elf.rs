@@ -0,0 +1,284 @@
+/// Writes the baseline backend's code as an ELF64 relocatable object. Calls
+/// between funcs are resolved before the object is written, so the only
+/// things the linker needs from it are the `.text` section and the symbols.
+///
+/// Also writes the symbol-only objects which the JIT registers with GDB (see
+/// `target::jit_symbols`).
+
+pub struct Symbol {
+    pub name: String,
+    /// Offset of the symbol in `.text`.
+    pub offset: usize,
+    pub size: usize,
+    /// Only global symbols are visible to the linker (ie. `main`).
+    pub global: bool,
+}
+
+const HEADER_SIZE: usize = 64;
+const SECTION_HEADER_SIZE: usize = 64;
+const SYMBOL_SIZE: usize = 24;
+
+const SHT_PROGBITS: u32 = 1;
+const SHT_SYMTAB: u32 = 2;
+const SHT_STRTAB: u32 = 3;
+const SHT_NOBITS: u32 = 8;
+
+const SHF_ALLOC: u64 = 0x2;
+const SHF_EXECINSTR: u64 = 0x4;
+
+const STB_LOCAL: u8 = 0;
+const STB_GLOBAL: u8 = 1;
+const STT_FUNC: u8 = 2;
+
+/// Index of `.text` in the section headers.
+const TEXT_INDEX: u16 = 1;
+
+struct Section {
+    name: u32,
+    typ: u32,
+    flags: u64,
+    address: u64,
+    offset: usize,
+    size: usize,
+    link: u32,
+    info: u32,
+    align: u64,
+    entsize: u64,
+}
+
+/// Null-terminated strings for `.strtab` and `.shstrtab`.
+struct StringTable(Vec<u8>);
+
+impl StringTable {
+    fn new() -> Self {
+        // Index 0 is always the empty string.
+        Self(vec![0])
+    }
+
+    fn add(&mut self, string: &str) -> u32 {
+        let index = self.0.len() as u32;
+        self.0.extend_from_slice(string.as_bytes());
+        self.0.push(0);
+        index
+    }
+}
+
+pub fn write_object(code: &[u8], symbols: &Vec<Symbol>) -> Vec<u8> {
+    write(SHT_PROGBITS, 0, code.len(), code, symbols)
+}
+
+/// Write an object with just the symbols for code which is already loaded
+/// at the address. Its `.text` takes up no space in the object.
+pub fn write_symbol_file(address: u64, size: usize, symbols: &Vec<Symbol>) -> Vec<u8> {
+    write(SHT_NOBITS, address, size, &[], symbols)
+}
+
+fn write(
+    text_typ: u32,
+    text_address: u64,
+    text_size: usize,
+    code: &[u8],
+    symbols: &Vec<Symbol>,
+) -> Vec<u8> {
+    // Local symbols have to come before global ones.
+    let mut sorted = symbols.iter().collect::<Vec<_>>();
+    sorted.sort_by_key(|symbol| symbol.global);
+    let locals = 1 + sorted.iter().filter(|symbol| !symbol.global).count();
+
+    let mut strtab = StringTable::new();
+    let mut symtab = vec![0; SYMBOL_SIZE]; // Null symbol
+    for symbol in sorted {
+        let binding = if symbol.global { STB_GLOBAL } else { STB_LOCAL };
+        symtab.extend_from_slice(&strtab.add(&symbol.name).to_le_bytes());
+        symtab.push((binding << 4) | STT_FUNC);
+        symtab.push(0); // Default visibility
+        symtab.extend_from_slice(&TEXT_INDEX.to_le_bytes());
+        symtab.extend_from_slice(&(symbol.offset as u64).to_le_bytes());
+        symtab.extend_from_slice(&(symbol.size as u64).to_le_bytes());
+    }
+
+    let mut shstrtab = StringTable::new();
+    let mut sections = vec![];
+    let mut body = vec![];
+    let mut add_section = |body: &mut Vec<u8>, section: Section, data: &[u8]| {
+        align(body, HEADER_SIZE, section.align as usize);
+        let offset = HEADER_SIZE + body.len();
+        body.extend_from_slice(data);
+        sections.push(Section { offset, ..section });
+    };
+    let text = Section {
+        name: shstrtab.add(".text"),
+        typ: text_typ,
+        flags: SHF_ALLOC | SHF_EXECINSTR,
+        address: text_address,
+        offset: 0,
+        size: text_size,
+        link: 0,
+        info: 0,
+        align: 16,
+        entsize: 0,
+    };
+    add_section(&mut body, text, code);
+    let symtab_section = Section {
+        name: shstrtab.add(".symtab"),
+        typ: SHT_SYMTAB,
+        flags: 0,
+        address: 0,
+        offset: 0,
+        size: symtab.len(),
+        // Index of `.strtab`.
+        link: 3,
+        info: locals as u32,
+        align: 8,
+        entsize: SYMBOL_SIZE as u64,
+    };
+    add_section(&mut body, symtab_section, &symtab);
+    let strtab_section = Section {
+        name: shstrtab.add(".strtab"),
+        typ: SHT_STRTAB,
+        flags: 0,
+        address: 0,
+        offset: 0,
+        size: strtab.0.len(),
+        link: 0,
+        info: 0,
+        align: 1,
+        entsize: 0,
+    };
+    add_section(&mut body, strtab_section, &strtab.0);
+    // Marks the stack as non-executable.
+    let note_section = Section {
+        name: shstrtab.add(".note.GNU-stack"),
+        typ: SHT_PROGBITS,
+        flags: 0,
+        address: 0,
+        offset: 0,
+        size: 0,
+        link: 0,
+        info: 0,
+        align: 1,
+        entsize: 0,
+    };
+    add_section(&mut body, note_section, &[]);
+    let shstrtab_name = shstrtab.add(".shstrtab");
+    let shstrtab_section = Section {
+        name: shstrtab_name,
+        typ: SHT_STRTAB,
+        flags: 0,
+        address: 0,
+        offset: 0,
+        size: shstrtab.0.len(),
+        link: 0,
+        info: 0,
+        align: 1,
+        entsize: 0,
+    };
+    add_section(&mut body, shstrtab_section, &shstrtab.0);
+
+    align(&mut body, HEADER_SIZE, 8);
+    let section_headers_offset = HEADER_SIZE + body.len();
+    // Includes the null section.
+    let section_count = 1 + sections.len();
+
+    let mut object =
+        Vec::with_capacity(section_headers_offset + section_count * SECTION_HEADER_SIZE);
+    object.extend_from_slice(&[0x7f, b'E', b'L', b'F']);
+    object.push(2); // ELFCLASS64
+    object.push(1); // ELFDATA2LSB
+    object.push(1); // EV_CURRENT
+    object.push(0); // ELFOSABI_NONE
+    object.extend_from_slice(&[0; 8]); // ABI version and padding
+    object.extend_from_slice(&1u16.to_le_bytes()); // ET_REL
+    object.extend_from_slice(&62u16.to_le_bytes()); // EM_X86_64
+    object.extend_from_slice(&1u32.to_le_bytes()); // EV_CURRENT
+    object.extend_from_slice(&0u64.to_le_bytes()); // Entry
+    object.extend_from_slice(&0u64.to_le_bytes()); // Program headers
+    object.extend_from_slice(&(section_headers_offset as u64).to_le_bytes());
+    object.extend_from_slice(&0u32.to_le_bytes()); // Flags
+    object.extend_from_slice(&(HEADER_SIZE as u16).to_le_bytes());
+    object.extend_from_slice(&0u16.to_le_bytes()); // Program header size
+    object.extend_from_slice(&0u16.to_le_bytes()); // Program header count
+    object.extend_from_slice(&(SECTION_HEADER_SIZE as u16).to_le_bytes());
+    object.extend_from_slice(&(section_count as u16).to_le_bytes());
+    object.extend_from_slice(&((section_count - 1) as u16).to_le_bytes()); // .shstrtab
+    object.extend_from_slice(&body);
+
+    object.extend_from_slice(&[0; SECTION_HEADER_SIZE]);
+    for section in sections.iter() {
+        object.extend_from_slice(&section.name.to_le_bytes());
+        object.extend_from_slice(&section.typ.to_le_bytes());
+        object.extend_from_slice(&section.flags.to_le_bytes());
+        object.extend_from_slice(&section.address.to_le_bytes());
+        object.extend_from_slice(&(section.offset as u64).to_le_bytes());
+        object.extend_from_slice(&(section.size as u64).to_le_bytes());
+        object.extend_from_slice(&section.link.to_le_bytes());
+        object.extend_from_slice(&section.info.to_le_bytes());
+        object.extend_from_slice(&section.align.to_le_bytes());
+        object.extend_from_slice(&section.entsize.to_le_bytes());
+    }
+    object
+}
+
+/// Pad the body so that its offset in the object (after the header) is
+/// aligned.
+fn align(body: &mut Vec<u8>, base: usize, alignment: usize) {
+    while (base + body.len()) % alignment != 0 {
+        body.push(0);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{write_object, Symbol};
+
+    fn read_u16(bytes: &[u8], offset: usize) -> u16 {
+        u16::from_le_bytes([bytes[offset], bytes[offset + 1]])
+    }
+
+    fn read_u64(bytes: &[u8], offset: usize) -> u64 {
+        let mut buffer = [0; 8];
+        buffer.copy_from_slice(&bytes[offset..offset + 8]);
+        u64::from_le_bytes(buffer)
+    }
+
+    #[test]
+    fn test_write_object() {
+        let code = vec![0xc3];
+        let symbols = vec![
+            Symbol {
+                name: "main".to_string(),
+                offset: 0,
+                size: 1,
+                global: true,
+            },
+            Symbol {
+                name: "helper".to_string(),
+                offset: 0,
+                size: 1,
+                global: false,
+            },
+        ];
+        let object = write_object(&code, &symbols);
+        assert_eq!(&object[0..4], b"\x7fELF");
+        assert_eq!(read_u16(&object, 16), 1); // ET_REL
+        assert_eq!(read_u16(&object, 18), 62); // EM_X86_64
+        let section_count = read_u16(&object, 60) as usize;
+        assert_eq!(section_count, 6);
+        let section_headers = read_u64(&object, 40) as usize;
+        assert_eq!(object.len(), section_headers + section_count * 64);
+
+        // `.text` is the first section after the null one.
+        let text = section_headers + 64;
+        let text_offset = read_u64(&object, text + 24) as usize;
+        assert_eq!(text_offset % 16, 0);
+        assert_eq!(object[text_offset], 0xc3);
+
+        // The local symbol is sorted before the global one.
+        let symtab = section_headers + 2 * 64;
+        let symtab_offset = read_u64(&object, symtab + 24) as usize;
+        assert_eq!(object[symtab_offset + 24 + 4], 0x02);
+        assert_eq!(object[symtab_offset + 48 + 4], 0x12);
+        // First non-local symbol.
+        assert_eq!(u32::from(object[symtab + 44]), 2);
+    }
+}
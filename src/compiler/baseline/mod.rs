@@ -0,0 +1,567 @@
+/// Baseline backend: a single pass straight from the IR to x86-64 machine
+/// code, written out as an ELF object without going through LLVM. It does
+/// no optimization at all (every value lives in a stack slot) so that debug
+/// builds are as fast as possible; optimized builds use the LLVM target.
+use std::collections::HashMap;
+use std::fs;
+use std::path::Path;
+
+use super::super::timings;
+use super::super::trace;
+use super::ir::{
+    self as ir, collect_all_func_values, FuncId, FuncValue, LocalValue, Module, RealType,
+};
+use super::{link_executable, LinkError};
+
+pub mod elf;
+mod x86;
+
+use x86::{Assembler, Condition, Reg, ARGUMENT_REGS};
+
+/// Compile the modules into `out.o` in the build directory and link it into
+/// `out`.
+pub fn compile_modules(modules: &Vec<Module>, build_dir: &Path) -> Result<(), LinkError> {
+    compile_modules_to(modules, &build_dir.join("out.o"), &build_dir.join("out"))
+}
+
+pub fn compile_modules_to(
+    modules: &Vec<Module>,
+    object: &Path,
+    executable: &Path,
+) -> Result<(), LinkError> {
+    let object_bytes = timings::time("baseline-codegen", None, || emit_object(modules));
+    fs::write(object, object_bytes).unwrap();
+    link_executable(&[object], executable)
+}
+
+pub fn emit_object(modules: &Vec<Module>) -> Vec<u8> {
+    let func_values = collect_all_func_values(modules);
+    let indices = func_values
+        .iter()
+        .enumerate()
+        .map(|(index, func_value)| (func_value.id(), index))
+        .collect::<HashMap<_, _>>();
+
+    let mut assembler = Assembler::new();
+    let mut symbols = vec![];
+    let mut offsets = vec![];
+    for func_value in func_values.iter() {
+        // Keep every func 16-byte aligned like a C compiler would.
+        while assembler.len() % 16 != 0 {
+            assembler.nop();
+        }
+        let offset = assembler.len();
+        {
+            let _span = trace::span(
+                "emit",
+                "baseline",
+                None,
+                Some(func_value.get_qualified_name()),
+            );
+            FunctionCompiler::new(&mut assembler, &indices, func_value).compile();
+        }
+        let (name, global) = if func_value.is_main() {
+            ("main".to_string(), true)
+        } else {
+            (func_value.get_qualified_name().to_owned(), false)
+        };
+        symbols.push(elf::Symbol {
+            name,
+            offset,
+            size: assembler.len() - offset,
+            global,
+        });
+        offsets.push(offset);
+    }
+
+    let code = assembler.finish(&offsets);
+    elf::write_object(&code, &symbols)
+}
+
+/// Every local in the stack frame and every value defined by an instruction
+/// gets its own 8-byte slot below the frame pointer for each of its scalars;
+/// tuples are flattened into consecutive slots going up from the lowest
+/// address. Constants and statics are materialized into registers where
+/// they're used.
+///
+/// Tuples are passed between funcs flattened too: each scalar takes the next
+/// argument register (or stack slot). Return values of up to two scalars come
+/// back in rax and rdx; bigger ones are written through a pointer to the
+/// caller's slots that's passed in rdi, like `sret` in the System V ABI.
+struct FunctionCompiler<'a> {
+    assembler: &'a mut Assembler,
+    indices: &'a HashMap<FuncId, usize>,
+    func_value: &'a FuncValue,
+    /// Displacements of the stack frame's locals.
+    locals: Vec<i32>,
+    /// Displacements of values by their `ValueId`.
+    values: HashMap<usize, i32>,
+    next_slot: usize,
+    /// Slot saving the pointer that the return value is written through if
+    /// it's returned in memory.
+    sret: Option<i32>,
+    /// Jumps whose displacements are patched once every block has been
+    /// placed: the offset of the displacement and the index of the block.
+    jumps: Vec<(usize, usize)>,
+}
+
+impl<'a> FunctionCompiler<'a> {
+    fn new(
+        assembler: &'a mut Assembler,
+        indices: &'a HashMap<FuncId, usize>,
+        func_value: &'a FuncValue,
+    ) -> Self {
+        let mut compiler = Self {
+            assembler,
+            indices,
+            func_value,
+            locals: vec![],
+            values: HashMap::new(),
+            next_slot: 0,
+            sret: None,
+            jumps: vec![],
+        };
+        for (_, real_type) in func_value.get_stack_frame().iter() {
+            let displacement = compiler.allocate(width(real_type));
+            compiler.locals.push(displacement);
+        }
+        if returns_in_memory(&func_value.get_retrn()) {
+            compiler.sret = Some(compiler.allocate(1));
+        }
+        compiler
+    }
+
+    fn compile(mut self) {
+        let func_value = self.func_value;
+        self.assembler.push(Reg::Rbp);
+        self.assembler.mov_reg_reg(Reg::Rbp, Reg::Rsp);
+        // The size of the frame isn't known until the body's been compiled.
+        let frame_size = self.assembler.sub_rsp(0);
+        if let Some(sret) = self.sret {
+            self.assembler.store(sret, Reg::Rdi);
+        }
+
+        // Copy parameters into the stack slots with matching names the same
+        // way that the target compiler does.
+        let registers = argument_regs(self.sret.is_some());
+        let parameters = func_value.get_parameters();
+        for (index, (name, real_type)) in func_value.get_stack_frame().iter().enumerate() {
+            if let Some(parameter) = parameters
+                .iter()
+                .position(|(parameter_name, _)| parameter_name == name)
+            {
+                let first = parameters[..parameter]
+                    .iter()
+                    .map(|(_, real_type)| width(real_type))
+                    .sum::<usize>();
+                for scalar in 0..width(real_type) {
+                    let position = first + scalar;
+                    let register = if position < registers.len() {
+                        registers[position]
+                    } else {
+                        // Above the return address and saved frame pointer.
+                        let displacement = 16 + 8 * (position - registers.len());
+                        self.assembler.load(Reg::Rax, displacement as i32);
+                        Reg::Rax
+                    };
+                    let displacement = self.locals[index] + 8 * scalar as i32;
+                    self.assembler.store(displacement, register);
+                }
+            }
+        }
+
+        let basic_block_manager = func_value.borrow_basic_blocks();
+        let basic_blocks = basic_block_manager.basic_blocks.borrow();
+        if basic_blocks.is_empty() {
+            panic!("Cannot compile an empty function");
+        }
+
+        // Phis get their slots up front so that the blocks branching to them
+        // can store their values before jumping.
+        for basic_block in basic_blocks.iter() {
+            for instruction in basic_block.instructions.iter() {
+                if let ir::Instruction::Phi(retrn, _) = instruction {
+                    self.define(retrn);
+                }
+            }
+        }
+
+        let mut offsets = vec![];
+        for index in 0..basic_blocks.len() {
+            offsets.push(self.assembler.len());
+            self.compile_basic_block(&basic_blocks, index);
+        }
+        for (jump, target) in self.jumps.drain(..) {
+            self.assembler.patch_jump(jump, offsets[target]);
+        }
+
+        // Keep the stack 16-byte aligned for calls.
+        let size = (self.next_slot * 8 + 15) / 16 * 16;
+        self.assembler.patch_u32(frame_size, size as u32);
+    }
+
+    fn compile_basic_block(&mut self, basic_blocks: &Vec<ir::BasicBlock>, index: usize) {
+        for instruction in basic_blocks[index].instructions.iter() {
+            use ir::Instruction::*;
+            match instruction {
+                Branch(target) => {
+                    self.store_phis(&basic_blocks[target.get()], index);
+                    // Fall through when the target is the next block.
+                    if target.get() != index + 1 {
+                        let jump = self.assembler.jmp();
+                        self.jumps.push((jump, target.get()));
+                    }
+                }
+                CondBranch(condition, then, els) => {
+                    self.load_value(Reg::Rax, condition);
+                    self.assembler.test_reg_reg(Reg::Rax, Reg::Rax);
+                    let jump = self.assembler.jz();
+                    self.jumps.push((jump, els.get()));
+                    if then.get() != index + 1 {
+                        let jump = self.assembler.jmp();
+                        self.jumps.push((jump, then.get()));
+                    }
+                }
+                CallFunc(retrn, callee, arguments) => {
+                    let callee = self.indices[&callee.id()];
+                    let displacement = self.define(retrn);
+                    let cleanup = self.load_arguments(arguments, retrn, displacement);
+                    self.assembler.call_function(callee);
+                    self.finish_call(retrn, displacement, cleanup);
+                }
+                CallFuncPtr(retrn, target, arguments) => {
+                    let displacement = self.define(retrn);
+                    let cleanup = self.load_arguments(arguments, retrn, displacement);
+                    // R11 isn't used for arguments.
+                    self.load_value(Reg::R11, &ir::Value::Local(target.clone()));
+                    self.assembler.call_reg(Reg::R11);
+                    self.finish_call(retrn, displacement, cleanup);
+                }
+                GetLocal(value, index) => {
+                    let displacement = self.define(value);
+                    for scalar in 0..value_width(value) as i32 {
+                        self.assembler
+                            .load(Reg::Rax, self.locals[*index] + 8 * scalar);
+                        self.assembler.store(displacement + 8 * scalar, Reg::Rax);
+                    }
+                }
+                GetLocalMember(value, index, member) => {
+                    let offset = match &self.func_value.get_stack_frame()[*index].1 {
+                        RealType::Tuple(tuple_type) => tuple_type.scalar_offset(*member),
+                        other @ _ => unreachable!("Cannot get member of non-Tuple: {:?}", other),
+                    };
+                    let displacement = self.define(value);
+                    let local = self.locals[*index] + 8 * offset as i32;
+                    for scalar in 0..value_width(value) as i32 {
+                        self.assembler.load(Reg::Rax, local + 8 * scalar);
+                        self.assembler.store(displacement + 8 * scalar, Reg::Rax);
+                    }
+                }
+                // The member's slots are already part of the tuple's.
+                GetTupleMember(member, tuple, index) => {
+                    let offset = match tuple.typ().into_real() {
+                        RealType::Tuple(tuple_type) => tuple_type.scalar_offset(*index),
+                        other @ _ => unreachable!("Cannot get member of non-Tuple: {:?}", other),
+                    };
+                    let displacement = self.values[&tuple.value_id().get()] + 8 * offset as i32;
+                    self.values.insert(member.value_id().get(), displacement);
+                }
+                IntArithmetic(retrn, op, lhs, rhs) => {
+                    self.load_value(Reg::Rax, lhs);
+                    self.load_value(Reg::Rcx, rhs);
+                    use ir::IntOp::*;
+                    let result = match op {
+                        Add => {
+                            self.assembler.add_reg_reg(Reg::Rax, Reg::Rcx);
+                            Reg::Rax
+                        }
+                        Sub => {
+                            self.assembler.sub_reg_reg(Reg::Rax, Reg::Rcx);
+                            Reg::Rax
+                        }
+                        Mul => {
+                            self.assembler.imul_reg_reg(Reg::Rax, Reg::Rcx);
+                            Reg::Rax
+                        }
+                        Div => {
+                            self.assembler.checked_idiv(Reg::Rcx);
+                            Reg::Rax
+                        }
+                        Rem => {
+                            self.assembler.checked_idiv(Reg::Rcx);
+                            Reg::Rdx
+                        }
+                    };
+                    let displacement = self.define(retrn);
+                    self.assembler.store(displacement, result);
+                }
+                IntCompare(retrn, comparison, lhs, rhs) => {
+                    self.load_value(Reg::Rax, lhs);
+                    self.load_value(Reg::Rcx, rhs);
+                    self.assembler.cmp_reg_reg(Reg::Rax, Reg::Rcx);
+                    use ir::IntComparison::*;
+                    self.assembler.set_rax(match comparison {
+                        Equal => Condition::Equal,
+                        NotEqual => Condition::NotEqual,
+                        LessThan => Condition::Less,
+                        LessThanOrEqual => Condition::LessOrEqual,
+                        GreaterThan => Condition::Greater,
+                        GreaterThanOrEqual => Condition::GreaterOrEqual,
+                    });
+                    let displacement = self.define(retrn);
+                    self.assembler.store(displacement, Reg::Rax);
+                }
+                MakeTuple(tuple, members) => {
+                    let mut displacement = self.define(tuple);
+                    for member in members.iter() {
+                        self.store_scalars(displacement, member);
+                        displacement += 8 * value_width(member) as i32;
+                    }
+                }
+                // Already stored by the predecessor.
+                Phi(_, _) => (),
+                Return(value) => {
+                    match self.sret {
+                        Some(sret) => {
+                            self.assembler.load(Reg::Rcx, sret);
+                            for scalar in 0..value_width(value) {
+                                self.load_scalar(Reg::Rax, value, scalar);
+                                self.assembler
+                                    .store_to(Reg::Rcx, 8 * scalar as i32, Reg::Rax);
+                            }
+                            self.assembler.mov_reg_reg(Reg::Rax, Reg::Rcx);
+                        }
+                        None => {
+                            self.load_value(Reg::Rax, value);
+                            if value_width(value) == 2 {
+                                self.load_scalar(Reg::Rdx, value, 1);
+                            }
+                        }
+                    }
+                    self.assembler.mov_reg_reg(Reg::Rsp, Reg::Rbp);
+                    self.assembler.pop(Reg::Rbp);
+                    self.assembler.ret();
+                }
+                SetLocal(index, value) => {
+                    self.store_scalars(self.locals[*index], value);
+                }
+            }
+        }
+    }
+
+    /// Stores the values that the target's phis take when coming from the
+    /// block at `predecessor`.
+    fn store_phis(&mut self, target: &ir::BasicBlock, predecessor: usize) {
+        for instruction in target.instructions.iter() {
+            if let ir::Instruction::Phi(retrn, incoming) = instruction {
+                let (value, _) = incoming
+                    .iter()
+                    .find(|(_, block)| block.get() == predecessor)
+                    .expect("Phi has no value for the predecessor");
+                let displacement = self.values[&retrn.value_id().get()];
+                self.store_scalars(displacement, value);
+            }
+        }
+    }
+
+    /// Put the first six scalars of the arguments in registers and push the
+    /// rest onto the stack. If the return value is returned in memory then
+    /// its slots are passed first. Returns how many bytes need to be popped
+    /// after the call.
+    fn load_arguments(
+        &mut self,
+        arguments: &Vec<ir::Value>,
+        retrn: &ir::Value,
+        displacement: i32,
+    ) -> u32 {
+        let sret = returns_in_memory(&retrn.typ().into_real());
+        let registers = argument_regs(sret);
+        let scalars = arguments
+            .iter()
+            .flat_map(|argument| (0..value_width(argument)).map(move |scalar| (argument, scalar)))
+            .collect::<Vec<_>>();
+        let stack_scalars = scalars.len().saturating_sub(registers.len());
+        // The stack has to be 16-byte aligned at the call.
+        let padding = if stack_scalars % 2 == 1 { 8 } else { 0 };
+        if padding > 0 {
+            self.assembler.sub_rsp(padding);
+        }
+        for (argument, scalar) in scalars.iter().skip(registers.len()).rev() {
+            self.load_scalar(Reg::Rax, argument, *scalar);
+            self.assembler.push(Reg::Rax);
+        }
+        for ((argument, scalar), register) in scalars.iter().zip(registers.iter()) {
+            self.load_scalar(*register, argument, *scalar);
+        }
+        if sret {
+            self.assembler.lea(Reg::Rdi, displacement);
+        }
+        padding + 8 * stack_scalars as u32
+    }
+
+    fn finish_call(&mut self, retrn: &ir::Value, displacement: i32, cleanup: u32) {
+        if cleanup > 0 {
+            self.assembler.add_rsp(cleanup);
+        }
+        match value_width(retrn) {
+            // Unit has no slots and big values have already been written.
+            0 => (),
+            1 => self.assembler.store(displacement, Reg::Rax),
+            2 => {
+                self.assembler.store(displacement, Reg::Rax);
+                self.assembler.store(displacement + 8, Reg::Rdx);
+            }
+            _ => (),
+        }
+    }
+
+    /// Reserve slots for a value and return the displacement of its first
+    /// (lowest) slot.
+    fn define(&mut self, value: &ir::Value) -> i32 {
+        let displacement = self.allocate(value_width(value));
+        self.values.insert(value.value_id().get(), displacement);
+        displacement
+    }
+
+    fn allocate(&mut self, width: usize) -> i32 {
+        // Unit doesn't take up any slots.
+        if width == 0 {
+            return 0;
+        }
+        self.next_slot += width;
+        slot_displacement(self.next_slot - 1)
+    }
+
+    /// Copy all of the value's scalars into the slots at `displacement`.
+    fn store_scalars(&mut self, displacement: i32, value: &ir::Value) {
+        for scalar in 0..value_width(value) {
+            self.load_scalar(Reg::Rax, value, scalar);
+            self.assembler
+                .store(displacement + 8 * scalar as i32, Reg::Rax);
+        }
+    }
+
+    fn load_value(&mut self, register: Reg, value: &ir::Value) {
+        self.load_scalar(register, value, 0)
+    }
+
+    fn load_scalar(&mut self, register: Reg, value: &ir::Value, scalar: usize) {
+        match value {
+            ir::Value::Local(local_value) => match local_value {
+                LocalValue::Bool(_, Some(const_value)) => {
+                    self.assembler.mov_imm(register, *const_value as i64)
+                }
+                LocalValue::Int64(_, Some(const_value)) => {
+                    self.assembler.mov_imm(register, *const_value as i64)
+                }
+                // Unit doesn't have any slots; it's only loaded when main
+                // returns it as its status.
+                LocalValue::Tuple(_, tuple_type) if tuple_type.members.is_empty() => {
+                    self.assembler.mov_imm(register, 0)
+                }
+                _ => {
+                    let id = local_value.value_id().get();
+                    let displacement = *self
+                        .values
+                        .get(&id)
+                        .expect(&format!("Missing value: {}", id));
+                    self.assembler
+                        .load(register, displacement + 8 * scalar as i32);
+                }
+            },
+            ir::Value::Static(ir::StaticValue::Func(func_value)) => {
+                let index = self.indices[&func_value.id()];
+                self.assembler.lea_function(register, index);
+            }
+            ir::Value::Abstract(_) => unreachable!("Cannot compile an Abstract value"),
+        }
+    }
+}
+
+/// Number of slots (and argument registers) taken up by a value of the type.
+fn width(real_type: &RealType) -> usize {
+    real_type.scalar_count()
+}
+
+fn value_width(value: &ir::Value) -> usize {
+    width(&value.typ().into_real())
+}
+
+/// Values that don't fit in rax and rdx are returned through a pointer.
+fn returns_in_memory(real_type: &RealType) -> bool {
+    width(real_type) > 2
+}
+
+/// The pointer to return a value through takes up the first register.
+fn argument_regs(sret: bool) -> &'static [Reg] {
+    if sret {
+        &ARGUMENT_REGS[1..]
+    } else {
+        &ARGUMENT_REGS[..]
+    }
+}
+
+fn slot_displacement(slot: usize) -> i32 {
+    -8 * (slot as i32 + 1)
+}
+
+// The generated code is x86-64 and running it needs the linker.
+#[cfg(all(test, target_arch = "x86_64"))]
+mod tests {
+    use std::fs;
+    use std::path::{Path, PathBuf};
+    use std::process::Command;
+
+    use super::super::super::frontend::Manager;
+    use super::super::linker;
+    use super::compile_modules_to;
+
+    /// A directory that's removed when dropped, even if the test panics.
+    struct TempDir(PathBuf);
+
+    impl TempDir {
+        fn new(name: &str) -> Self {
+            let dir = std::env::temp_dir().join(format!("{}-{}", name, std::process::id()));
+            fs::create_dir_all(&dir).unwrap();
+            TempDir(dir)
+        }
+
+        fn path(&self) -> &Path {
+            &self.0
+        }
+    }
+
+    impl Drop for TempDir {
+        fn drop(&mut self) {
+            let _ = fs::remove_dir_all(&self.0);
+        }
+    }
+
+    #[test]
+    fn test_compile_and_run() {
+        let command = linker();
+        if Command::new(&command[0]).arg("--version").output().is_err() {
+            eprintln!("Skipping: {} is not on the PATH", command[0]);
+            return;
+        }
+        let source = "
+            func second(a, b) { b }
+            func many(a, b, c, d, e, f, g, h) { second(h, g) }
+            func main() {
+              func identity(a) { a }
+              identity(many(1, 2, 3, 4, 5, 6, 7, 8) * 6 / 4 % 8 + 5)
+            }
+        ";
+        let dir = TempDir::new("hummingbird-baseline");
+        let path = dir.path().join("main.hb");
+        fs::write(&path, source).unwrap();
+        let manager = Manager::new();
+        let entry = manager.load(path).unwrap();
+        let modules = manager.compile_ir(&entry);
+
+        let executable = dir.path().join("out");
+        compile_modules_to(&modules, &dir.path().join("out.o"), &executable).unwrap();
+        let status = Command::new(&executable).status().unwrap();
+        assert_eq!(status.code(), Some(7));
+    }
+}
@@ -0,0 +1,399 @@
+/// Just enough of an x86-64 assembler for the baseline backend. Memory
+/// operands are always `[base + disp32]` (or RIP-relative) to keep the
+/// encodings uniform. The base is usually rbp; rsp and r12 can't be bases
+/// since they'd need a SIB byte.
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Reg {
+    Rax = 0,
+    Rcx = 1,
+    Rdx = 2,
+    Rbx = 3,
+    Rsp = 4,
+    Rbp = 5,
+    Rsi = 6,
+    Rdi = 7,
+    R8 = 8,
+    R9 = 9,
+    R10 = 10,
+    R11 = 11,
+}
+
+impl Reg {
+    fn low(self) -> u8 {
+        (self as u8) & 0b111
+    }
+
+    fn is_extended(self) -> bool {
+        (self as u8) >= 8
+    }
+}
+
+/// Condition codes for `setcc` (signed comparisons).
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Condition {
+    Equal = 0x4,
+    NotEqual = 0x5,
+    Less = 0xc,
+    GreaterOrEqual = 0xd,
+    LessOrEqual = 0xe,
+    Greater = 0xf,
+}
+
+/// Integer argument registers in the System V calling convention.
+pub const ARGUMENT_REGS: [Reg; 6] = [Reg::Rdi, Reg::Rsi, Reg::Rdx, Reg::Rcx, Reg::R8, Reg::R9];
+
+/// A 32-bit displacement that needs to be filled in with the distance to
+/// a function once all the functions have been laid out.
+pub struct Fixup {
+    /// Offset of the displacement in the code.
+    pub offset: usize,
+    /// Index of the function being referenced.
+    pub function: usize,
+}
+
+pub struct Assembler {
+    pub code: Vec<u8>,
+    pub fixups: Vec<Fixup>,
+}
+
+impl Assembler {
+    pub fn new() -> Self {
+        Self {
+            code: vec![],
+            fixups: vec![],
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.code.len()
+    }
+
+    /// Resolve the fixups given the offset of every function.
+    pub fn finish(mut self, function_offsets: &Vec<usize>) -> Vec<u8> {
+        for fixup in self.fixups.iter() {
+            // Displacements are relative to the end of the instruction, which
+            // is always right after the displacement.
+            let target = function_offsets[fixup.function] as i64;
+            let displacement = (target - (fixup.offset as i64 + 4)) as i32;
+            self.code[fixup.offset..fixup.offset + 4].copy_from_slice(&displacement.to_le_bytes());
+        }
+        self.code
+    }
+
+    fn emit(&mut self, bytes: &[u8]) {
+        self.code.extend_from_slice(bytes);
+    }
+
+    fn emit_u32(&mut self, value: u32) {
+        self.code.extend_from_slice(&value.to_le_bytes());
+    }
+
+    /// REX prefix with W set (64-bit operands).
+    fn rex_w(&mut self, reg: Reg, rm: Reg) {
+        let mut rex = 0x48;
+        if reg.is_extended() {
+            rex |= 0b100;
+        }
+        if rm.is_extended() {
+            rex |= 0b001;
+        }
+        self.emit(&[rex]);
+    }
+
+    /// ModRM for `[base + disp32]`.
+    fn modrm_disp32(&mut self, reg: Reg, base: Reg, displacement: i32) {
+        assert!(
+            base.low() != Reg::Rsp.low(),
+            "Cannot encode base: {:?}",
+            base
+        );
+        self.emit(&[0b10_000_000 | (reg.low() << 3) | base.low()]);
+        self.emit_u32(displacement as u32);
+    }
+
+    pub fn push(&mut self, reg: Reg) {
+        if reg.is_extended() {
+            self.emit(&[0x41]);
+        }
+        self.emit(&[0x50 + reg.low()]);
+    }
+
+    pub fn pop(&mut self, reg: Reg) {
+        if reg.is_extended() {
+            self.emit(&[0x41]);
+        }
+        self.emit(&[0x58 + reg.low()]);
+    }
+
+    /// mov dst, src
+    pub fn mov_reg_reg(&mut self, dst: Reg, src: Reg) {
+        self.rex_w(src, dst);
+        self.emit(&[0x89, 0b11_000_000 | (src.low() << 3) | dst.low()]);
+    }
+
+    /// mov reg, [rbp + displacement]
+    pub fn load(&mut self, reg: Reg, displacement: i32) {
+        self.load_from(reg, Reg::Rbp, displacement);
+    }
+
+    /// mov [rbp + displacement], reg
+    pub fn store(&mut self, displacement: i32, reg: Reg) {
+        self.store_to(Reg::Rbp, displacement, reg);
+    }
+
+    /// mov reg, [base + displacement]
+    pub fn load_from(&mut self, reg: Reg, base: Reg, displacement: i32) {
+        self.rex_w(reg, base);
+        self.emit(&[0x8b]);
+        self.modrm_disp32(reg, base, displacement);
+    }
+
+    /// mov [base + displacement], reg
+    pub fn store_to(&mut self, base: Reg, displacement: i32, reg: Reg) {
+        self.rex_w(reg, base);
+        self.emit(&[0x89]);
+        self.modrm_disp32(reg, base, displacement);
+    }
+
+    /// lea reg, [rbp + displacement]
+    pub fn lea(&mut self, reg: Reg, displacement: i32) {
+        self.rex_w(reg, Reg::Rbp);
+        self.emit(&[0x8d]);
+        self.modrm_disp32(reg, Reg::Rbp, displacement);
+    }
+
+    /// mov reg, imm
+    pub fn mov_imm(&mut self, reg: Reg, value: i64) {
+        if value >= i32::min_value() as i64 && value <= i32::max_value() as i64 {
+            // Sign-extended 32-bit immediate.
+            self.rex_w(Reg::Rax, reg);
+            self.emit(&[0xc7, 0b11_000_000 | reg.low()]);
+            self.emit_u32(value as i32 as u32);
+        } else {
+            self.rex_w(Reg::Rax, reg);
+            self.emit(&[0xb8 + reg.low()]);
+            self.code.extend_from_slice(&value.to_le_bytes());
+        }
+    }
+
+    /// add dst, src
+    pub fn add_reg_reg(&mut self, dst: Reg, src: Reg) {
+        self.rex_w(src, dst);
+        self.emit(&[0x01, 0b11_000_000 | (src.low() << 3) | dst.low()]);
+    }
+
+    /// sub dst, src
+    pub fn sub_reg_reg(&mut self, dst: Reg, src: Reg) {
+        self.rex_w(src, dst);
+        self.emit(&[0x29, 0b11_000_000 | (src.low() << 3) | dst.low()]);
+    }
+
+    /// imul dst, src
+    pub fn imul_reg_reg(&mut self, dst: Reg, src: Reg) {
+        self.rex_w(dst, src);
+        self.emit(&[0x0f, 0xaf, 0b11_000_000 | (dst.low() << 3) | src.low()]);
+    }
+
+    /// cqo; idiv reg. Divides rdx:rax (rax sign-extended) by the register,
+    /// leaving the quotient in rax and the remainder in rdx. Raises SIGFPE
+    /// when dividing by zero or when the quotient overflows.
+    pub fn idiv(&mut self, reg: Reg) {
+        self.emit(&[0x48, 0x99]);
+        self.rex_w(Reg::Rax, reg);
+        self.emit(&[0xf7, 0b11_111_000 | reg.low()]);
+    }
+
+    /// `idiv` that executes ud2 instead when dividing by zero or dividing
+    /// `i64::MIN` by -1, same as code compiled by LLVM. The register can't be
+    /// rax or rdx.
+    pub fn checked_idiv(&mut self, reg: Reg) {
+        self.test_reg_reg(reg, reg);
+        let by_zero = self.jz();
+        self.mov_imm(Reg::Rdx, -1);
+        self.cmp_reg_reg(reg, Reg::Rdx);
+        let not_minus_one = self.jnz();
+        self.mov_imm(Reg::Rdx, i64::min_value());
+        self.cmp_reg_reg(Reg::Rax, Reg::Rdx);
+        let not_min = self.jnz();
+        let trap = self.len();
+        self.ud2();
+        let divide = self.len();
+        self.patch_jump(by_zero, trap);
+        self.patch_jump(not_minus_one, divide);
+        self.patch_jump(not_min, divide);
+        self.idiv(reg);
+    }
+
+    /// cmp lhs, rhs
+    pub fn cmp_reg_reg(&mut self, lhs: Reg, rhs: Reg) {
+        self.rex_w(rhs, lhs);
+        self.emit(&[0x39, 0b11_000_000 | (rhs.low() << 3) | lhs.low()]);
+    }
+
+    /// test reg, reg
+    pub fn test_reg_reg(&mut self, lhs: Reg, rhs: Reg) {
+        self.rex_w(rhs, lhs);
+        self.emit(&[0x85, 0b11_000_000 | (rhs.low() << 3) | lhs.low()]);
+    }
+
+    /// jmp rel32. Returns the offset of the displacement so that it can be
+    /// patched with `patch_jump` once the target is known.
+    pub fn jmp(&mut self) -> usize {
+        self.emit(&[0xe9]);
+        let offset = self.code.len();
+        self.emit_u32(0);
+        offset
+    }
+
+    /// jz rel32. Returns the offset of the displacement like `jmp`.
+    pub fn jz(&mut self) -> usize {
+        self.emit(&[0x0f, 0x84]);
+        let offset = self.code.len();
+        self.emit_u32(0);
+        offset
+    }
+
+    /// jnz rel32. Returns the offset of the displacement like `jmp`.
+    pub fn jnz(&mut self) -> usize {
+        self.emit(&[0x0f, 0x85]);
+        let offset = self.code.len();
+        self.emit_u32(0);
+        offset
+    }
+
+    /// Point the jump whose displacement is at `offset` to `target`.
+    pub fn patch_jump(&mut self, offset: usize, target: usize) {
+        let displacement = (target as i64 - (offset as i64 + 4)) as i32;
+        self.patch_u32(offset, displacement as u32);
+    }
+
+    /// setcc al; movzx eax, al. Sets rax to 1 if the condition holds and 0
+    /// otherwise.
+    pub fn set_rax(&mut self, condition: Condition) {
+        self.emit(&[0x0f, 0x90 | condition as u8, 0xc0]);
+        self.emit(&[0x0f, 0xb6, 0xc0]);
+    }
+
+    /// lea reg, [rip + function]
+    pub fn lea_function(&mut self, reg: Reg, function: usize) {
+        self.rex_w(reg, Reg::Rax);
+        self.emit(&[0x8d, 0b00_000_101 | (reg.low() << 3)]);
+        self.fixup(function);
+    }
+
+    /// call function
+    pub fn call_function(&mut self, function: usize) {
+        self.emit(&[0xe8]);
+        self.fixup(function);
+    }
+
+    /// call reg
+    pub fn call_reg(&mut self, reg: Reg) {
+        if reg.is_extended() {
+            self.emit(&[0x41]);
+        }
+        self.emit(&[0xff, 0b11_010_000 | reg.low()]);
+    }
+
+    /// sub rsp, imm32. Returns the offset of the immediate so that it can be
+    /// patched later.
+    pub fn sub_rsp(&mut self, value: u32) -> usize {
+        self.emit(&[0x48, 0x81, 0xec]);
+        let offset = self.code.len();
+        self.emit_u32(value);
+        offset
+    }
+
+    /// add rsp, imm32
+    pub fn add_rsp(&mut self, value: u32) {
+        self.emit(&[0x48, 0x81, 0xc4]);
+        self.emit_u32(value);
+    }
+
+    pub fn ret(&mut self) {
+        self.emit(&[0xc3]);
+    }
+
+    pub fn nop(&mut self) {
+        self.emit(&[0x90]);
+    }
+
+    /// Raises SIGILL.
+    pub fn ud2(&mut self) {
+        self.emit(&[0x0f, 0x0b]);
+    }
+
+    pub fn patch_u32(&mut self, offset: usize, value: u32) {
+        self.code[offset..offset + 4].copy_from_slice(&value.to_le_bytes());
+    }
+
+    fn fixup(&mut self, function: usize) {
+        self.fixups.push(Fixup {
+            offset: self.code.len(),
+            function,
+        });
+        self.emit_u32(0);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{Assembler, Condition, Reg};
+
+    #[test]
+    fn test_encodings() {
+        let mut assembler = Assembler::new();
+        assembler.push(Reg::Rbp);
+        assembler.mov_reg_reg(Reg::Rbp, Reg::Rsp);
+        assembler.load(Reg::R9, -8);
+        assembler.store(-16, Reg::Rax);
+        assembler.load_from(Reg::Rax, Reg::Rcx, 8);
+        assembler.store_to(Reg::Rcx, 16, Reg::Rdx);
+        assembler.lea(Reg::Rdi, -24);
+        assembler.mov_imm(Reg::Rdi, 42);
+        assembler.mov_imm(Reg::R11, 1 << 40);
+        assembler.call_reg(Reg::R11);
+        assembler.sub_reg_reg(Reg::Rax, Reg::Rcx);
+        assembler.imul_reg_reg(Reg::Rax, Reg::R11);
+        assembler.idiv(Reg::Rcx);
+        assembler.cmp_reg_reg(Reg::Rax, Reg::Rcx);
+        assembler.set_rax(Condition::LessOrEqual);
+        assembler.test_reg_reg(Reg::Rax, Reg::Rax);
+        let jz = assembler.jz();
+        let jmp = assembler.jmp();
+        assembler.patch_jump(jz, jmp + 4);
+        assembler.patch_jump(jmp, jz - 2);
+        let jnz = assembler.jnz();
+        assembler.patch_jump(jnz, jnz + 4);
+        assembler.ud2();
+        assembler.ret();
+        assert_eq!(
+            assembler.finish(&vec![]),
+            vec![
+                0x55, // push rbp
+                0x48, 0x89, 0xe5, // mov rbp, rsp
+                0x4c, 0x8b, 0x8d, 0xf8, 0xff, 0xff, 0xff, // mov r9, [rbp-8]
+                0x48, 0x89, 0x85, 0xf0, 0xff, 0xff, 0xff, // mov [rbp-16], rax
+                0x48, 0x8b, 0x81, 0x08, 0x00, 0x00, 0x00, // mov rax, [rcx+8]
+                0x48, 0x89, 0x91, 0x10, 0x00, 0x00, 0x00, // mov [rcx+16], rdx
+                0x48, 0x8d, 0xbd, 0xe8, 0xff, 0xff, 0xff, // lea rdi, [rbp-24]
+                0x48, 0xc7, 0xc7, 0x2a, 0x00, 0x00, 0x00, // mov rdi, 42
+                0x49, 0xbb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+                0x00, // movabs r11, 1<<40
+                0x41, 0xff, 0xd3, // call r11
+                0x48, 0x29, 0xc8, // sub rax, rcx
+                0x49, 0x0f, 0xaf, 0xc3, // imul rax, r11
+                0x48, 0x99, 0x48, 0xf7, 0xf9, // cqo; idiv rcx
+                0x48, 0x39, 0xc8, // cmp rax, rcx
+                0x0f, 0x9e, 0xc0, 0x0f, 0xb6, 0xc0, // setle al; movzx eax, al
+                0x48, 0x85, 0xc0, // test rax, rax
+                0x0f, 0x84, 0x05, 0x00, 0x00, 0x00, // jz +5
+                0xe9, 0xf5, 0xff, 0xff, 0xff, // jmp -11 (back to the jz)
+                0x0f, 0x85, 0x00, 0x00, 0x00, 0x00, // jnz +0
+                0x0f, 0x0b, // ud2
+                0xc3, // ret
+            ]
+        );
+    }
+}
@@ -0,0 +1,497 @@
+use std::collections::HashMap;
+use std::convert::TryFrom;
+
+use super::super::interpreter::InterpreterError;
+use super::super::ir::{
+    self as ir, collect_all_func_values, FuncId, FuncValue, LocalValue, Module, RealType,
+    StaticValue,
+};
+use super::{Function, Instruction, Opcode, Program};
+
+/// Lower every func in the modules into a single bytecode program. Fails if
+/// a func needs more registers than instructions can address.
+pub fn lower_modules(modules: &Vec<Module>) -> Result<Program, InterpreterError> {
+    let func_values = collect_all_func_values(modules);
+    let indices = func_values
+        .iter()
+        .enumerate()
+        .map(|(index, func_value)| (func_value.id(), index as u16))
+        .collect::<HashMap<_, _>>();
+    let main = func_values
+        .iter()
+        .position(|func_value| func_value.is_main())
+        .expect("Missing main func");
+
+    let mut program = Program {
+        constants: vec![],
+        functions: vec![],
+        code: vec![],
+        main: main as u32,
+    };
+    for func_value in func_values.iter() {
+        let function = FunctionLowerer::new(&mut program, &indices, func_value).lower()?;
+        program.functions.push(function);
+    }
+    Ok(program)
+}
+
+/// A constant operand, which is loaded into a register of its own once.
+#[derive(Clone, Copy, Hash, PartialEq, Eq)]
+enum Constant {
+    Int64(i64),
+    Func(u16),
+}
+
+/// Registers are allocated in a single pass: parameters first, then the
+/// stack frame's locals, then everything else in the order it's needed.
+/// Each distinct constant gets one register, loaded at the function's entry,
+/// below any call's window.
+/// SSA values keep their registers; the arguments of a call are copied into
+/// a window at the top which is released once the call has been made. Any
+/// register above those allocated so far is free to be clobbered by a
+/// callee's window.
+///
+/// Every value takes up `width` consecutive registers (see the module docs).
+struct FunctionLowerer<'a> {
+    program: &'a mut Program,
+    indices: &'a HashMap<FuncId, u16>,
+    func_value: &'a FuncValue,
+    /// The first register of each of the stack frame's locals.
+    locals: Vec<u16>,
+    /// First registers holding SSA values by their `ValueId`.
+    values: HashMap<usize, u16>,
+    constants: HashMap<Constant, u16>,
+    /// Loads of the constants, which go before the function's code.
+    constant_loads: Vec<Instruction>,
+    next_register: usize,
+    /// The most registers in use at any point.
+    register_count: usize,
+    /// Jumps whose targets are patched in once every block has been placed:
+    /// the offset of the jump and the index of the block it targets.
+    fixups: Vec<(usize, usize)>,
+}
+
+impl<'a> FunctionLowerer<'a> {
+    fn new(
+        program: &'a mut Program,
+        indices: &'a HashMap<FuncId, u16>,
+        func_value: &'a FuncValue,
+    ) -> Self {
+        let mut next_register = func_value
+            .get_parameters()
+            .iter()
+            .map(|(_, real_type)| width(real_type) as usize)
+            .sum::<usize>();
+        let mut locals = vec![];
+        for (_, real_type) in func_value.get_stack_frame().iter() {
+            // Past the limit `lower` fails anyway.
+            locals.push(u16::try_from(next_register).unwrap_or(0));
+            next_register += width(real_type) as usize;
+        }
+        Self {
+            program,
+            indices,
+            func_value,
+            locals,
+            values: HashMap::new(),
+            constants: HashMap::new(),
+            constant_loads: vec![],
+            next_register,
+            register_count: next_register,
+            fixups: vec![],
+        }
+    }
+
+    fn lower(mut self) -> Result<Function, InterpreterError> {
+        let entry = self.program.code.len();
+        let func_value = self.func_value;
+
+        // Copy parameters into the stack slots with matching names the same
+        // way that the target compiler does.
+        let parameters = func_value.get_parameters();
+        for (index, (name, real_type)) in func_value.get_stack_frame().iter().enumerate() {
+            if let Some(parameter) = parameters
+                .iter()
+                .position(|(parameter_name, _)| parameter_name == name)
+            {
+                let register = parameters[..parameter]
+                    .iter()
+                    .map(|(_, real_type)| width(real_type))
+                    .sum();
+                self.emit_moves(self.locals[index], register, width(real_type));
+            }
+        }
+
+        let basic_block_manager = func_value.borrow_basic_blocks();
+        let basic_blocks = basic_block_manager.basic_blocks.borrow();
+        if basic_blocks.is_empty() {
+            panic!("Cannot lower an empty function");
+        }
+
+        // Phis get their registers up front so that the blocks branching to
+        // them can move their values in before jumping.
+        for basic_block in basic_blocks.iter() {
+            for instruction in basic_block.instructions.iter() {
+                if let ir::Instruction::Phi(retrn, _) = instruction {
+                    self.define(retrn);
+                }
+            }
+        }
+        // So do constants since they're only loaded once: if one came after
+        // a call's window, running the call again in a loop would clobber it.
+        for basic_block in basic_blocks.iter() {
+            for instruction in basic_block.instructions.iter() {
+                for operand in operands(instruction) {
+                    if let Some(constant) = self.constant(&operand) {
+                        self.allocate_constant(constant);
+                    }
+                }
+            }
+        }
+
+        let mut offsets = vec![];
+        for index in 0..basic_blocks.len() {
+            offsets.push(self.program.code.len());
+            self.lower_basic_block(&basic_blocks, index);
+        }
+        let registers = match u16::try_from(self.register_count) {
+            Ok(registers) if self.register_count < MAX_REGISTERS => registers,
+            _ => {
+                return Err(InterpreterError::TooManyRegisters {
+                    function: func_value.get_qualified_name().to_owned(),
+                })
+            }
+        };
+
+        // Everything after the entry moves along to make room for the
+        // constants.
+        let shift = self.constant_loads.len();
+        self.program
+            .code
+            .splice(entry..entry, self.constant_loads.drain(..));
+        for (jump, target) in self.fixups.drain(..) {
+            let instruction = self.program.code[jump + shift];
+            self.program.code[jump + shift] = Instruction::new_bc(
+                instruction.opcode(),
+                instruction.a() as u16,
+                (offsets[target] + shift) as u32,
+            );
+        }
+
+        Ok(Function {
+            name: func_value.get_qualified_name().to_owned(),
+            arity: parameters
+                .iter()
+                .map(|(_, real_type)| width(real_type))
+                .sum(),
+            returns: width(&func_value.get_retrn()),
+            registers,
+            entry: entry as u32,
+            length: (self.program.code.len() - entry) as u32,
+        })
+    }
+
+    fn lower_basic_block(&mut self, basic_blocks: &Vec<ir::BasicBlock>, index: usize) {
+        for instruction in basic_blocks[index].instructions.iter() {
+            use ir::Instruction::*;
+            match instruction {
+                Branch(target) => {
+                    self.lower_phi_moves(&basic_blocks[target.get()], index);
+                    // Fall through when the target is the next block.
+                    if target.get() != index + 1 {
+                        self.emit_jump(Opcode::Jump, 0, target.get());
+                    }
+                }
+                CondBranch(condition, then, els) => {
+                    for target in [then, els].iter() {
+                        if has_phis(&basic_blocks[target.get()]) {
+                            unreachable!("Cannot lower a conditional branch to a phi");
+                        }
+                    }
+                    let condition = self.use_value(condition);
+                    self.emit_jump(Opcode::JumpIfFalse, condition, els.get());
+                    if then.get() != index + 1 {
+                        self.emit_jump(Opcode::Jump, 0, then.get());
+                    }
+                }
+                CallFunc(retrn, callee, arguments) => {
+                    let callee = self.indices[&callee.id()];
+                    let (retrn, base) = self.lower_call(retrn, arguments);
+                    self.emit(Opcode::Call, retrn, callee, base);
+                    self.next_register = base as usize;
+                }
+                CallFuncPtr(retrn, target, arguments) => {
+                    let target = self.use_value(&ir::Value::Local(target.clone()));
+                    let (retrn, base) = self.lower_call(retrn, arguments);
+                    self.emit(Opcode::CallIndirect, retrn, target, base);
+                    self.next_register = base as usize;
+                }
+                GetLocal(value, index) => {
+                    let register = self.define(value);
+                    self.emit_moves(register, self.locals[*index], value_width(value));
+                }
+                GetLocalMember(value, index, member) => {
+                    let offset = match &self.func_value.get_stack_frame()[*index].1 {
+                        RealType::Tuple(tuple_type) => tuple_type.scalar_offset(*member),
+                        other @ _ => unreachable!("Cannot get member of non-Tuple: {:?}", other),
+                    };
+                    let register = self.define(value);
+                    let local = self.locals[*index] + offset as u16;
+                    self.emit_moves(register, local, value_width(value));
+                }
+                // Members are already in registers of their own, so the
+                // member's value is just those registers.
+                GetTupleMember(member, tuple, index) => {
+                    let register = self.use_value(tuple);
+                    let offset = match tuple.typ().into_real() {
+                        RealType::Tuple(tuple_type) => tuple_type.scalar_offset(*index),
+                        other @ _ => unreachable!("Cannot get member of non-Tuple: {:?}", other),
+                    };
+                    self.values
+                        .insert(member.value_id().get(), register + offset as u16);
+                }
+                IntArithmetic(retrn, op, lhs, rhs) => {
+                    use ir::IntOp::*;
+                    let opcode = match op {
+                        Add => Opcode::Add,
+                        Sub => Opcode::Sub,
+                        Mul => Opcode::Mul,
+                        Div => Opcode::Div,
+                        Rem => Opcode::Rem,
+                    };
+                    self.lower_binary(opcode, retrn, lhs, rhs);
+                }
+                IntCompare(retrn, comparison, lhs, rhs) => {
+                    use ir::IntComparison::*;
+                    let opcode = match comparison {
+                        Equal => Opcode::Equal,
+                        NotEqual => Opcode::NotEqual,
+                        LessThan => Opcode::LessThan,
+                        LessThanOrEqual => Opcode::LessThanOrEqual,
+                        GreaterThan => Opcode::GreaterThan,
+                        GreaterThanOrEqual => Opcode::GreaterThanOrEqual,
+                    };
+                    self.lower_binary(opcode, retrn, lhs, rhs);
+                }
+                MakeTuple(tuple, members) => {
+                    let members = members
+                        .iter()
+                        .map(|member| (self.use_value(member), value_width(member)))
+                        .collect::<Vec<_>>();
+                    let mut register = self.define(tuple);
+                    for (member, width) in members.into_iter() {
+                        self.emit_moves(register, member, width);
+                        register += width;
+                    }
+                }
+                // Already filled in by the predecessor.
+                Phi(_, _) => (),
+                Return(value) => {
+                    let register = self.use_value(value);
+                    self.emit(Opcode::Return, register, value_width(value), 0);
+                }
+                SetLocal(index, value) => {
+                    let register = self.use_value(value);
+                    self.emit_moves(self.locals[*index], register, value_width(value));
+                }
+            }
+        }
+    }
+
+    /// Moves the values that the target's phis take when coming from the
+    /// block at `predecessor`.
+    fn lower_phi_moves(&mut self, target: &ir::BasicBlock, predecessor: usize) {
+        for instruction in target.instructions.iter() {
+            if let ir::Instruction::Phi(retrn, incoming) = instruction {
+                let (value, _) = incoming
+                    .iter()
+                    .find(|(_, block)| block.get() == predecessor)
+                    .expect("Phi has no value for the predecessor");
+                let source = self.use_value(value);
+                let register = self.values[&retrn.value_id().get()];
+                self.emit_moves(register, source, value_width(retrn));
+            }
+        }
+    }
+
+    /// Moves the arguments into a fresh window at the top of the registers,
+    /// which the caller releases after emitting the call. Returns the
+    /// register for the return value and the base of the window.
+    fn lower_call(&mut self, retrn: &ir::Value, arguments: &Vec<ir::Value>) -> (u16, u16) {
+        let arguments = arguments
+            .iter()
+            .map(|argument| (self.use_value(argument), value_width(argument)))
+            .collect::<Vec<_>>();
+        let retrn = self.define(retrn);
+        let base = self.reserve(arguments.iter().map(|(_, width)| *width).sum());
+        let mut register = base;
+        for (argument, width) in arguments.into_iter() {
+            self.emit_moves(register, argument, width);
+            register += width;
+        }
+        (retrn, base)
+    }
+
+    fn lower_binary(
+        &mut self,
+        opcode: Opcode,
+        retrn: &ir::Value,
+        lhs: &ir::Value,
+        rhs: &ir::Value,
+    ) {
+        let lhs = self.use_value(lhs);
+        let rhs = self.use_value(rhs);
+        let retrn = self.define(retrn);
+        self.emit(opcode, retrn, lhs, rhs);
+    }
+
+    fn define(&mut self, value: &ir::Value) -> u16 {
+        let register = self.reserve(value_width(value));
+        self.values.insert(value.value_id().get(), register);
+        register
+    }
+
+    /// Get the register holding a value, which for constants and statics is
+    /// the register they're loaded into at the entry.
+    fn use_value(&mut self, value: &ir::Value) -> u16 {
+        if let Some(constant) = self.constant(value) {
+            return self.constants[&constant];
+        }
+        match value {
+            ir::Value::Local(local_value) => match local_value {
+                // Unit doesn't take up any registers, so any register will do.
+                LocalValue::Tuple(_, tuple_type) if tuple_type.members.is_empty() => 0,
+                _ => {
+                    let id = local_value.value_id().get();
+                    *self
+                        .values
+                        .get(&id)
+                        .expect(&format!("Missing value: {}", id))
+                }
+            },
+            ir::Value::Static(_) => unreachable!("Statics are constants"),
+            ir::Value::Abstract(_) => unreachable!("Cannot lower an Abstract value"),
+        }
+    }
+
+    fn constant(&self, value: &ir::Value) -> Option<Constant> {
+        match value {
+            ir::Value::Local(LocalValue::Bool(_, Some(const_value))) => {
+                Some(Constant::Int64(*const_value as i64))
+            }
+            ir::Value::Local(LocalValue::Int64(_, Some(const_value))) => {
+                Some(Constant::Int64(*const_value as i64))
+            }
+            ir::Value::Static(StaticValue::Func(func_value)) => {
+                Some(Constant::Func(self.indices[&func_value.id()]))
+            }
+            _ => None,
+        }
+    }
+
+    fn allocate_constant(&mut self, constant: Constant) {
+        if self.constants.contains_key(&constant) {
+            return;
+        }
+        let register = self.reserve(1);
+        let load = match constant {
+            Constant::Int64(value) => self.load_int64(register, value),
+            Constant::Func(index) => Instruction::new_bc(Opcode::LoadFunc, register, index as u32),
+        };
+        self.constant_loads.push(load);
+        self.constants.insert(constant, register);
+    }
+
+    fn load_int64(&mut self, register: u16, value: i64) -> Instruction {
+        if let Ok(immediate) = i32::try_from(value) {
+            return Instruction::new_bc(Opcode::LoadImm, register, immediate as u32);
+        }
+        let constants = &mut self.program.constants;
+        let index = match constants.iter().position(|constant| *constant == value) {
+            Some(index) => index,
+            None => {
+                constants.push(value);
+                constants.len() - 1
+            }
+        };
+        Instruction::new_bc(Opcode::LoadConst, register, index as u32)
+    }
+
+    /// Allocate `width` registers at the top. Once the registers run out
+    /// this keeps handing out the first one so that lowering can carry on,
+    /// and `lower` fails at the end.
+    fn reserve(&mut self, width: u16) -> u16 {
+        let register = self.next_register;
+        self.next_register += width as usize;
+        self.register_count = self.register_count.max(self.next_register);
+        if self.next_register < MAX_REGISTERS {
+            register as u16
+        } else {
+            0
+        }
+    }
+
+    fn emit_moves(&mut self, destination: u16, source: u16, width: u16) {
+        for offset in 0..width {
+            self.emit(Opcode::Move, destination + offset, source + offset, 0);
+        }
+    }
+
+    fn emit(&mut self, opcode: Opcode, a: u16, b: u16, c: u16) {
+        self.program.code.push(Instruction::new(opcode, a, b, c));
+    }
+
+    fn emit_bc(&mut self, opcode: Opcode, a: u16, bc: u32) {
+        self.program.code.push(Instruction::new_bc(opcode, a, bc));
+    }
+
+    /// Emits a jump to the start of a block, which gets patched in once
+    /// every block has been lowered.
+    fn emit_jump(&mut self, opcode: Opcode, a: u16, target: usize) {
+        self.fixups.push((self.program.code.len(), target));
+        self.emit_bc(opcode, a, 0);
+    }
+}
+
+/// Register operands are 16 bits, and the count has to fit too.
+const MAX_REGISTERS: usize = u16::max_value() as usize;
+
+/// Number of registers taken up by a value of the type.
+fn width(real_type: &RealType) -> u16 {
+    real_type.scalar_count() as u16
+}
+
+fn value_width(value: &ir::Value) -> u16 {
+    width(&value.typ().into_real())
+}
+
+/// The values an instruction reads.
+fn operands(instruction: &ir::Instruction) -> Vec<ir::Value> {
+    use ir::Instruction::*;
+    match instruction {
+        CallFunc(_, _, arguments) => arguments.clone(),
+        CallFuncPtr(_, target, arguments) => {
+            let mut operands = vec![ir::Value::Local(target.clone())];
+            operands.extend(arguments.iter().cloned());
+            operands
+        }
+        Branch(_) | GetLocal(_, _) | GetLocalMember(_, _, _) => vec![],
+        CondBranch(value, _, _) | GetTupleMember(_, value, _) => vec![value.clone()],
+        IntArithmetic(_, _, lhs, rhs) | IntCompare(_, _, lhs, rhs) => {
+            vec![lhs.clone(), rhs.clone()]
+        }
+        MakeTuple(_, members) => members.clone(),
+        Phi(_, incoming) => incoming.iter().map(|(value, _)| value.clone()).collect(),
+        Return(value) | SetLocal(_, value) => vec![value.clone()],
+    }
+}
+
+fn has_phis(basic_block: &ir::BasicBlock) -> bool {
+    basic_block
+        .instructions
+        .iter()
+        .any(|instruction| match instruction {
+            ir::Instruction::Phi(_, _) => true,
+            _ => false,
+        })
+}
@@ -0,0 +1,498 @@
+/// A compact, serializable bytecode for a register-based VM.
+///
+/// Every instruction is a fixed-width 64-bit word:
+///
+///     bits  0..8   opcode
+///     bits  8..24  A operand
+///     bits 24..40  B operand
+///     bits 40..56  C operand
+///
+/// Some instructions treat B and C together as a single 32-bit BC operand.
+/// Jump targets are absolute offsets into the program's code.
+/// Each func gets a window of registers; its parameters are always in the
+/// first registers of the window so that callers can place arguments at the
+/// top of their own window and the callee's window starts there.
+///
+/// Tuples are flattened: a value takes up one register for each of its
+/// scalars (so the unit tuple takes up none), and is returned by copying
+/// that many registers back into the caller's window.
+use std::fs::{self, File};
+use std::io::{self, BufReader, BufWriter, Read, Write};
+use std::path::Path;
+
+use super::interpreter::InterpreterError;
+
+mod lower;
+mod vm;
+
+pub use lower::lower_modules;
+pub use vm::run;
+
+/// Identifies a serialized program.
+const MAGIC: &[u8; 4] = b"HBBC";
+/// Bump this whenever the encoding of programs or instructions changes.
+const VERSION: u32 = 4;
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+#[repr(u8)]
+pub enum Opcode {
+    /// A = BC (as a sign-extended 32-bit immediate)
+    LoadImm = 0,
+    /// A = constants[BC]
+    LoadConst,
+    /// A = functions[BC]
+    LoadFunc,
+    /// A = B
+    Move,
+    /// A = functions[B](C...)
+    Call,
+    /// A = B(C...)
+    CallIndirect,
+    /// Return(A..A+B)
+    Return,
+    /// A = B + C
+    Add,
+    /// A = B - C
+    Sub,
+    /// A = B * C
+    Mul,
+    /// A = B / C
+    Div,
+    /// A = B % C
+    Rem,
+    /// A = B == C
+    Equal,
+    /// A = B != C
+    NotEqual,
+    /// A = B < C
+    LessThan,
+    /// A = B <= C
+    LessThanOrEqual,
+    /// A = B > C
+    GreaterThan,
+    /// A = B >= C
+    GreaterThanOrEqual,
+    /// Jump to BC
+    Jump,
+    /// Jump to BC if A is zero
+    JumpIfFalse,
+}
+
+impl Opcode {
+    fn decode(byte: u8) -> Option<Opcode> {
+        use Opcode::*;
+        Some(match byte {
+            0 => LoadImm,
+            1 => LoadConst,
+            2 => LoadFunc,
+            3 => Move,
+            4 => Call,
+            5 => CallIndirect,
+            6 => Return,
+            7 => Add,
+            8 => Sub,
+            9 => Mul,
+            10 => Div,
+            11 => Rem,
+            12 => Equal,
+            13 => NotEqual,
+            14 => LessThan,
+            15 => LessThanOrEqual,
+            16 => GreaterThan,
+            17 => GreaterThanOrEqual,
+            18 => Jump,
+            19 => JumpIfFalse,
+            _ => return None,
+        })
+    }
+}
+
+#[derive(Clone, Copy, PartialEq)]
+pub struct Instruction(u64);
+
+impl Instruction {
+    pub fn new(opcode: Opcode, a: u16, b: u16, c: u16) -> Self {
+        Self((opcode as u64) | (a as u64) << 8 | (b as u64) << 24 | (c as u64) << 40)
+    }
+
+    pub fn new_bc(opcode: Opcode, a: u16, bc: u32) -> Self {
+        Self((opcode as u64) | (a as u64) << 8 | (bc as u64) << 24)
+    }
+
+    /// Only safe to call on instructions from a validated `Program`.
+    #[inline(always)]
+    pub fn opcode(&self) -> Opcode {
+        unsafe { std::mem::transmute::<u8, Opcode>(self.0 as u8) }
+    }
+
+    #[inline(always)]
+    pub fn a(&self) -> usize {
+        (self.0 >> 8) as u16 as usize
+    }
+
+    #[inline(always)]
+    pub fn b(&self) -> usize {
+        (self.0 >> 24) as u16 as usize
+    }
+
+    #[inline(always)]
+    pub fn c(&self) -> usize {
+        (self.0 >> 40) as u16 as usize
+    }
+
+    #[inline(always)]
+    pub fn bc(&self) -> u32 {
+        (self.0 >> 24) as u32
+    }
+}
+
+impl std::fmt::Debug for Instruction {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        match Opcode::decode(self.0 as u8) {
+            Some(opcode) => write!(f, "{:?}({}, {}, {})", opcode, self.a(), self.b(), self.c()),
+            None => write!(f, "Invalid({:#018x})", self.0),
+        }
+    }
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct Function {
+    /// The qualified name of the func this was lowered from.
+    pub name: String,
+    /// Number of registers taken up by the parameters.
+    pub arity: u16,
+    /// Number of registers taken up by the return value.
+    pub returns: u16,
+    /// Size of the register window (including the parameters).
+    pub registers: u16,
+    /// Offset of the first instruction in the program's code.
+    pub entry: u32,
+    /// Number of instructions.
+    pub length: u32,
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct Program {
+    pub constants: Vec<i64>,
+    pub functions: Vec<Function>,
+    pub code: Vec<Instruction>,
+    /// Index of the main function.
+    pub main: u32,
+}
+
+impl Program {
+    pub fn write_to<W: Write>(&self, output: &mut W) -> io::Result<()> {
+        output.write_all(MAGIC)?;
+        write_u32(output, VERSION)?;
+        write_u32(output, self.main)?;
+        write_u32(output, self.constants.len() as u32)?;
+        for constant in self.constants.iter() {
+            output.write_all(&constant.to_le_bytes())?;
+        }
+        write_u32(output, self.functions.len() as u32)?;
+        for function in self.functions.iter() {
+            write_u32(output, function.name.len() as u32)?;
+            output.write_all(function.name.as_bytes())?;
+            output.write_all(&function.arity.to_le_bytes())?;
+            output.write_all(&function.returns.to_le_bytes())?;
+            output.write_all(&function.registers.to_le_bytes())?;
+            write_u32(output, function.entry)?;
+            write_u32(output, function.length)?;
+        }
+        write_u32(output, self.code.len() as u32)?;
+        for instruction in self.code.iter() {
+            output.write_all(&instruction.0.to_le_bytes())?;
+        }
+        Ok(())
+    }
+
+    /// Read and validate a program.
+    pub fn read_from<R: Read>(input: &mut R) -> Result<Program, InterpreterError> {
+        let program = Self::read_unvalidated(input).map_err(|err| invalid(err.to_string()))?;
+        program.validate()?;
+        Ok(program)
+    }
+
+    fn read_unvalidated<R: Read>(input: &mut R) -> io::Result<Program> {
+        let mut magic = [0; 4];
+        input.read_exact(&mut magic)?;
+        if &magic != MAGIC {
+            return Err(io::Error::new(io::ErrorKind::InvalidData, "Bad magic"));
+        }
+        let version = read_u32(input)?;
+        if version != VERSION {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                format!("Unsupported version: {}", version),
+            ));
+        }
+        let main = read_u32(input)?;
+        let mut constants = vec![];
+        for _ in 0..read_u32(input)? {
+            let mut bytes = [0; 8];
+            input.read_exact(&mut bytes)?;
+            constants.push(i64::from_le_bytes(bytes));
+        }
+        let mut functions = vec![];
+        for _ in 0..read_u32(input)? {
+            let mut name = vec![0; read_u32(input)? as usize];
+            input.read_exact(&mut name)?;
+            let name = String::from_utf8(name)
+                .map_err(|err| io::Error::new(io::ErrorKind::InvalidData, err))?;
+            let arity = read_u16(input)?;
+            let returns = read_u16(input)?;
+            let registers = read_u16(input)?;
+            let entry = read_u32(input)?;
+            let length = read_u32(input)?;
+            functions.push(Function {
+                name,
+                arity,
+                returns,
+                registers,
+                entry,
+                length,
+            });
+        }
+        let mut code = vec![];
+        for _ in 0..read_u32(input)? {
+            let mut bytes = [0; 8];
+            input.read_exact(&mut bytes)?;
+            code.push(Instruction(u64::from_le_bytes(bytes)));
+        }
+        Ok(Program {
+            constants,
+            functions,
+            code,
+            main,
+        })
+    }
+
+    /// Check that every instruction is well-formed so that the VM can skip
+    /// checking opcodes, registers, and indices while it's running.
+    fn validate(&self) -> Result<(), InterpreterError> {
+        let main = self
+            .functions
+            .get(self.main as usize)
+            .ok_or_else(|| invalid("Main function out of bounds"))?;
+        if main.arity != 0 {
+            return Err(invalid("Main function cannot have parameters"));
+        }
+        for function in self.functions.iter() {
+            let start = function.entry as usize;
+            let end = start + function.length as usize;
+            if end > self.code.len() || function.length == 0 {
+                return Err(invalid(format!("Bad code range: {}", function.name)));
+            }
+            if function.arity > function.registers {
+                return Err(invalid(format!("Too few registers: {}", function.name)));
+            }
+            let registers = function.registers as usize;
+            let check_register = |register: usize| {
+                if register < registers {
+                    Ok(())
+                } else {
+                    Err(invalid(format!(
+                        "Register {} out of bounds in {}",
+                        register, function.name
+                    )))
+                }
+            };
+            // Registers `start..start + count`; empty ranges are always valid.
+            let check_registers = |start: usize, count: usize| {
+                if count == 0 {
+                    Ok(())
+                } else {
+                    check_register(start + count - 1)
+                }
+            };
+            for instruction in self.code[start..end].iter() {
+                use Opcode::*;
+                let opcode = Opcode::decode(instruction.0 as u8)
+                    .ok_or_else(|| invalid(format!("Invalid instruction: {:?}", instruction)))?;
+                // Calls and returns check their own ranges of registers.
+                if opcode != Call && opcode != CallIndirect && opcode != Return {
+                    check_register(instruction.a())?;
+                }
+                match opcode {
+                    LoadImm => (),
+                    LoadConst => {
+                        if instruction.bc() as usize >= self.constants.len() {
+                            return Err(invalid("Constant out of bounds"));
+                        }
+                    }
+                    LoadFunc => {
+                        if instruction.bc() as usize >= self.functions.len() {
+                            return Err(invalid("Function out of bounds"));
+                        }
+                    }
+                    Move => check_register(instruction.b())?,
+                    Call => {
+                        let callee = self
+                            .functions
+                            .get(instruction.b())
+                            .ok_or_else(|| invalid("Function out of bounds"))?;
+                        // The arguments and the return value must fit in the
+                        // caller's window.
+                        check_registers(instruction.c(), callee.arity as usize)?;
+                        check_registers(instruction.a(), callee.returns as usize)?;
+                    }
+                    // The callee isn't known until runtime, so neither is the
+                    // size of its arguments or return value: the VM checks
+                    // those when it makes the call.
+                    CallIndirect => check_register(instruction.b())?,
+                    Return => {
+                        if instruction.b() != function.returns as usize {
+                            return Err(invalid(format!("Bad return in {}", function.name)));
+                        }
+                        check_registers(instruction.a(), instruction.b())?;
+                    }
+                    Add | Sub | Mul | Div | Rem | Equal | NotEqual | LessThan | LessThanOrEqual
+                    | GreaterThan | GreaterThanOrEqual => {
+                        check_register(instruction.b())?;
+                        check_register(instruction.c())?;
+                    }
+                    // Jumps can't leave the function.
+                    Jump | JumpIfFalse => {
+                        let target = instruction.bc() as usize;
+                        if target < start || target >= end {
+                            return Err(invalid(format!(
+                                "Jump out of bounds in {}",
+                                function.name
+                            )));
+                        }
+                    }
+                }
+            }
+            // Every function has to end by returning or jumping so that the
+            // VM can't run off the end of it into the next one.
+            match self.code[end - 1].opcode() {
+                Opcode::Return | Opcode::Jump => (),
+                _ => return Err(invalid(format!("Missing return: {}", function.name))),
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Write the program to a file (conventionally with the `.hbc` extension).
+pub fn write_file(program: &Program, path: &Path) -> io::Result<()> {
+    if let Some(parent) = path.parent() {
+        fs::create_dir_all(parent)?;
+    }
+    let mut output = BufWriter::new(File::create(path)?);
+    program.write_to(&mut output)?;
+    output.flush()
+}
+
+/// Load a program written by `write_file` and run it.
+pub fn run_file(path: &Path) -> Result<i64, InterpreterError> {
+    let file = File::open(path)
+        .map_err(|err| invalid(format!("Cannot read {}: {}", path.to_str().unwrap(), err)))?;
+    let program = Program::read_from(&mut BufReader::new(file))?;
+    run(&program)
+}
+
+fn invalid<S: Into<String>>(message: S) -> InterpreterError {
+    InterpreterError::InvalidBytecode {
+        message: message.into(),
+    }
+}
+
+fn write_u32<W: Write>(output: &mut W, value: u32) -> io::Result<()> {
+    output.write_all(&value.to_le_bytes())
+}
+
+fn read_u16<R: Read>(input: &mut R) -> io::Result<u16> {
+    let mut bytes = [0; 2];
+    input.read_exact(&mut bytes)?;
+    Ok(u16::from_le_bytes(bytes))
+}
+
+fn read_u32<R: Read>(input: &mut R) -> io::Result<u32> {
+    let mut bytes = [0; 4];
+    input.read_exact(&mut bytes)?;
+    Ok(u32::from_le_bytes(bytes))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::interpreter::InterpreterError;
+    use super::super::ir::compile_source;
+    use super::{lower_modules, run, Function, Instruction, Opcode, Program};
+
+    #[test]
+    fn test_lower_serialize_and_run() {
+        let (modules, _main) = compile_source(
+            "bytecode-calls",
+            "func main() {\n  func identity(a) {\n    a\n  }\n  identity(1234567890123)\n}\n",
+        );
+        let program = lower_modules(&modules).unwrap();
+
+        let mut bytes = vec![];
+        program.write_to(&mut bytes).unwrap();
+        let loaded = Program::read_from(&mut bytes.as_slice()).unwrap();
+        assert_eq!(loaded, program);
+        assert_eq!(run(&loaded).unwrap(), 1234567890123);
+    }
+
+    #[test]
+    fn test_registers_are_reused() {
+        // Each line takes three registers for its results; the constants
+        // and the call's arguments reuse the same ones every time.
+        let source = |lines: usize| {
+            format!(
+                "func first(a, b) {{\n  a\n}}\nfunc main() {{\n  var x = 0\n{}  x\n}}\n",
+                "  x = x + first(1, 2)\n".repeat(lines)
+            )
+        };
+        let (modules, _main) = compile_source("bytecode-registers", &source(20_000));
+        assert_eq!(run(&lower_modules(&modules).unwrap()).unwrap(), 20_000);
+
+        let (modules, _main) = compile_source("bytecode-too-many-registers", &source(25_000));
+        match lower_modules(&modules) {
+            Err(InterpreterError::TooManyRegisters { .. }) => (),
+            other => panic!("Expected too many registers: {:?}", other.map(|_| ())),
+        }
+    }
+
+    #[test]
+    fn test_validate_and_check_indirect_calls() {
+        let main = Function {
+            name: "main".to_string(),
+            arity: 0,
+            returns: 1,
+            registers: 2,
+            entry: 0,
+            length: 3,
+        };
+        let program = |code: Vec<Instruction>| Program {
+            constants: vec![],
+            functions: vec![main.clone()],
+            code,
+            main: 0,
+        };
+        fn is_invalid<T>(result: Result<T, InterpreterError>) -> bool {
+            match result {
+                Err(InterpreterError::InvalidBytecode { .. }) => true,
+                _ => false,
+            }
+        }
+
+        // Calling a function that doesn't exist.
+        let out_of_bounds = program(vec![
+            Instruction::new_bc(Opcode::LoadImm, 0, 999),
+            Instruction::new(Opcode::CallIndirect, 1, 0, 1),
+            Instruction::new(Opcode::Return, 1, 1, 0),
+        ]);
+        assert!(out_of_bounds.validate().is_ok());
+        assert!(is_invalid(run(&out_of_bounds)));
+
+        // Falling through the end of the function.
+        let unterminated = program(vec![
+            Instruction::new_bc(Opcode::LoadImm, 0, 0),
+            Instruction::new(Opcode::Return, 0, 1, 0),
+            Instruction::new_bc(Opcode::JumpIfFalse, 0, 0),
+        ]);
+        assert!(is_invalid(unterminated.validate()));
+    }
+}
@@ -0,0 +1,157 @@
+use std::convert::TryFrom;
+
+use super::super::interpreter::InterpreterError;
+use super::{invalid, Instruction, Opcode, Program};
+
+/// How deep the call stack can get before we give up. Calls don't recurse on
+/// the Rust stack, so this only bounds the size of the register file.
+const MAX_DEPTH: usize = 1_000_000;
+
+struct Frame {
+    return_pc: usize,
+    base: usize,
+    /// Size of the caller's window.
+    registers: usize,
+    /// First register (relative to `base`) that receives the return value.
+    retrn: usize,
+}
+
+/// Run the program's main function and return its result.
+///
+/// Dispatch is a single `match` on the opcode, which compiles to a jump
+/// table. The program must have been validated (see `Program::read_from`),
+/// which is always the case for programs produced by `lower_modules`. The
+/// only operands validation can't check are the callees of indirect calls,
+/// so those are checked as they're made.
+pub fn run(program: &Program) -> Result<i64, InterpreterError> {
+    let code = &program.code[..];
+    let constants = &program.constants[..];
+    let functions = &program.functions[..];
+
+    let main = &functions[program.main as usize];
+    let mut registers = vec![0i64; main.registers as usize];
+    let mut frames: Vec<Frame> = vec![];
+    let mut base = 0;
+    // Size of the current function's window.
+    let mut window = main.registers as usize;
+    let mut pc = main.entry as usize;
+
+    loop {
+        let instruction = code[pc];
+        pc += 1;
+        match instruction.opcode() {
+            Opcode::LoadImm => {
+                registers[base + instruction.a()] = instruction.bc() as i32 as i64;
+            }
+            Opcode::LoadConst => {
+                registers[base + instruction.a()] = constants[instruction.bc() as usize];
+            }
+            Opcode::LoadFunc => {
+                registers[base + instruction.a()] = instruction.bc() as i64;
+            }
+            Opcode::Move => {
+                registers[base + instruction.a()] = registers[base + instruction.b()];
+            }
+            opcode @ Opcode::Call | opcode @ Opcode::CallIndirect => {
+                let callee = if opcode == Opcode::Call {
+                    &functions[instruction.b()]
+                } else {
+                    let index = registers[base + instruction.b()];
+                    let callee = usize::try_from(index)
+                        .ok()
+                        .and_then(|index| functions.get(index))
+                        .ok_or_else(|| invalid(format!("Function out of bounds: {}", index)))?;
+                    // The arguments and the return value must fit in the
+                    // caller's window, same as `validate` checks for `Call`.
+                    let arguments = instruction.c() + callee.arity as usize;
+                    let retrn = instruction.a() + callee.returns as usize;
+                    if arguments > window || retrn > window {
+                        return Err(invalid(format!("Bad indirect call to {}", callee.name)));
+                    }
+                    callee
+                };
+                if frames.len() >= MAX_DEPTH {
+                    return Err(InterpreterError::StackOverflow {
+                        depth: frames.len(),
+                    });
+                }
+                frames.push(Frame {
+                    return_pc: pc,
+                    base,
+                    registers: window,
+                    retrn: instruction.a(),
+                });
+                window = callee.registers as usize;
+                // The callee's window starts at the arguments.
+                base += instruction.c();
+                let size = base + callee.registers as usize;
+                if registers.len() < size {
+                    registers.resize(size, 0);
+                }
+                pc = callee.entry as usize;
+            }
+            Opcode::Add => binary(&mut registers, base, instruction, i64::wrapping_add),
+            Opcode::Sub => binary(&mut registers, base, instruction, i64::wrapping_sub),
+            Opcode::Mul => binary(&mut registers, base, instruction, i64::wrapping_mul),
+            opcode @ Opcode::Div | opcode @ Opcode::Rem => {
+                let (lhs, rhs) = (
+                    registers[base + instruction.b()],
+                    registers[base + instruction.c()],
+                );
+                let value = if opcode == Opcode::Div {
+                    lhs.checked_div(rhs)
+                } else {
+                    lhs.checked_rem(rhs)
+                };
+                registers[base + instruction.a()] =
+                    value.ok_or_else(|| InterpreterError::division(rhs))?;
+            }
+            Opcode::Equal => binary(&mut registers, base, instruction, |b, c| (b == c) as i64),
+            Opcode::NotEqual => binary(&mut registers, base, instruction, |b, c| (b != c) as i64),
+            Opcode::LessThan => binary(&mut registers, base, instruction, |b, c| (b < c) as i64),
+            Opcode::LessThanOrEqual => {
+                binary(&mut registers, base, instruction, |b, c| (b <= c) as i64)
+            }
+            Opcode::GreaterThan => binary(&mut registers, base, instruction, |b, c| (b > c) as i64),
+            Opcode::GreaterThanOrEqual => {
+                binary(&mut registers, base, instruction, |b, c| (b >= c) as i64)
+            }
+            Opcode::Jump => pc = instruction.bc() as usize,
+            Opcode::JumpIfFalse => {
+                if registers[base + instruction.a()] == 0 {
+                    pc = instruction.bc() as usize;
+                }
+            }
+            Opcode::Return => {
+                let start = base + instruction.a();
+                let count = instruction.b();
+                match frames.pop() {
+                    Some(frame) => {
+                        pc = frame.return_pc;
+                        base = frame.base;
+                        window = frame.registers;
+                        // The callee's window starts at the caller's
+                        // arguments, so the ranges can overlap, which
+                        // `copy_within` handles like `memmove`.
+                        registers.copy_within(start..start + count, base + frame.retrn);
+                    }
+                    None => return Ok(if count > 0 { registers[start] } else { 0 }),
+                }
+            }
+        }
+    }
+}
+
+/// A = op(B, C)
+#[inline(always)]
+fn binary<F: Fn(i64, i64) -> i64>(
+    registers: &mut Vec<i64>,
+    base: usize,
+    instruction: Instruction,
+    op: F,
+) {
+    registers[base + instruction.a()] = op(
+        registers[base + instruction.b()],
+        registers[base + instruction.c()],
+    );
+}
@@ -0,0 +1,166 @@
+/// Compile-time evaluation of calls with constant arguments.
+use super::super::ir::{
+    self as ir, collect_all_func_values, FuncValue, Instruction, LocalValue, Module, StaticValue,
+    Value,
+};
+use super::{Interpreter, RuntimeValue};
+
+/// Replace calls that have only constant arguments with their result. Every
+/// func is pure since the IR has no side effects, so the only requirement is
+/// that the callee returns (without trapping) within `budget` executed
+/// instructions, otherwise the call is left alone. Returns the number of
+/// calls replaced.
+pub fn fold_constant_calls(modules: &Vec<Module>, budget: usize) -> usize {
+    collect_all_func_values(modules)
+        .iter()
+        .map(|func_value| fold_func(func_value, budget))
+        .sum()
+}
+
+fn fold_func(func_value: &FuncValue, budget: usize) -> usize {
+    let basic_block_manager = func_value.borrow_basic_blocks();
+    let basic_blocks_len = basic_block_manager.basic_blocks.borrow().len();
+    let mut folded = 0;
+    for basic_block_index in 0..basic_blocks_len {
+        let mut index = 0;
+        loop {
+            // Don't hold the borrow while evaluating since the callee could
+            // be this func.
+            let candidate = {
+                let basic_blocks = basic_block_manager.basic_blocks.borrow();
+                let instructions = &basic_blocks[basic_block_index].instructions;
+                match instructions.get(index) {
+                    Some(Instruction::CallFunc(retrn, callee, arguments)) => {
+                        constant_arguments(arguments)
+                            .map(|arguments| (retrn.clone(), callee.clone(), arguments))
+                    }
+                    Some(_) => None,
+                    None => break,
+                }
+            };
+            let constant = candidate.and_then(|(retrn, callee, arguments)| {
+                let result = Interpreter::new_with_budget(budget)
+                    .call(&callee, arguments)
+                    .ok()?;
+                into_constant(&retrn, result).map(|constant| (retrn, constant))
+            });
+            let (retrn, constant) = match constant {
+                Some(constant) => constant,
+                None => {
+                    index += 1;
+                    continue;
+                }
+            };
+
+            let mut basic_blocks = basic_block_manager.basic_blocks.borrow_mut();
+            basic_blocks[basic_block_index].instructions.remove(index);
+            for basic_block in basic_blocks.iter_mut() {
+                for instruction in basic_block.instructions.iter_mut() {
+                    replace_uses(instruction, &retrn, &constant);
+                }
+            }
+            folded += 1;
+        }
+    }
+    folded
+}
+
+fn constant_arguments(arguments: &Vec<Value>) -> Option<Vec<RuntimeValue>> {
+    arguments
+        .iter()
+        .map(|argument| match argument {
+            Value::Local(LocalValue::Bool(_, Some(const_value))) => {
+                Some(RuntimeValue::Bool(*const_value))
+            }
+            Value::Local(LocalValue::Int64(_, Some(const_value))) => {
+                Some(RuntimeValue::Int64(*const_value as i64))
+            }
+            Value::Local(LocalValue::Tuple(_, tuple_type)) if tuple_type.members.is_empty() => {
+                Some(RuntimeValue::Tuple(vec![]))
+            }
+            Value::Static(StaticValue::Func(func_value)) => {
+                Some(RuntimeValue::FuncPtr(func_value.clone()))
+            }
+            _ => None,
+        })
+        .collect()
+}
+
+/// Build a constant with the same ID as the value it replaces.
+fn into_constant(retrn: &Value, result: RuntimeValue) -> Option<Value> {
+    let id = retrn.value_id();
+    match (retrn, result) {
+        (Value::Local(LocalValue::Bool(_, _)), RuntimeValue::Bool(value)) => {
+            Some(Value::Local(LocalValue::Bool(id, Some(value))))
+        }
+        (Value::Local(LocalValue::Int64(_, _)), RuntimeValue::Int64(value)) => {
+            Some(Value::Local(LocalValue::Int64(id, Some(value as u64))))
+        }
+        (Value::Local(LocalValue::Tuple(_, tuple_type)), RuntimeValue::Tuple(members))
+            if members.is_empty() =>
+        {
+            Some(Value::Local(LocalValue::Tuple(id, tuple_type.clone())))
+        }
+        // Func pointers can't be replaced since `CallFuncPtr` needs a local.
+        _ => None,
+    }
+}
+
+fn replace_uses(instruction: &mut Instruction, retrn: &Value, constant: &Value) {
+    let id = retrn.value_id();
+    let replace = |value: &mut Value| {
+        if let Value::Local(local_value) = value {
+            if local_value.value_id() == id {
+                *value = constant.clone();
+            }
+        }
+    };
+    use Instruction::*;
+    match instruction {
+        CallFunc(_, _, arguments) | CallFuncPtr(_, _, arguments) => {
+            arguments.iter_mut().for_each(replace)
+        }
+        Branch(_) | GetLocal(_, _) | GetLocalMember(_, _, _) => (),
+        CondBranch(condition, _, _) | GetTupleMember(_, condition, _) => replace(condition),
+        IntArithmetic(_, _, lhs, rhs) | IntCompare(_, _, lhs, rhs) => {
+            replace(lhs);
+            replace(rhs);
+        }
+        MakeTuple(_, members) => members.iter_mut().for_each(replace),
+        Phi(_, incoming) => incoming.iter_mut().for_each(|(value, _)| replace(value)),
+        Return(value) | SetLocal(_, value) => replace(value),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::super::ir::{compile_source, Instruction, LocalValue, Value};
+    use super::fold_constant_calls;
+
+    #[test]
+    fn test_fold_constant_calls() {
+        let (modules, main) = compile_source(
+            "const-eval",
+            "func first(a, b) {\n  a\n}\nfunc main() {\n  first(first(7, 8), 9)\n}\n",
+        );
+
+        assert_eq!(fold_constant_calls(&modules, 1_000), 2);
+        let basic_block_manager = main.borrow_basic_blocks();
+        let basic_blocks = basic_block_manager.basic_blocks.borrow();
+        match basic_blocks[0].instructions.as_slice() {
+            [Instruction::Return(Value::Local(LocalValue::Int64(_, Some(7))))] => (),
+            _ => panic!("Expected main to return a constant"),
+        }
+    }
+
+    #[test]
+    fn test_fold_respects_budget() {
+        let (modules, _main) = compile_source(
+            "const-eval-budget",
+            "func first(a, b) {\n  a\n}\nfunc main() {\n  first(7, 8)\n}\n",
+        );
+
+        // Evaluating `first` takes 2 instructions (get the local and return).
+        assert_eq!(fold_constant_calls(&modules, 1), 0);
+    }
+}
@@ -0,0 +1,525 @@
+/// Executes the IR directly instead of lowering it to LLVM. This has
+/// practically no startup cost compared to the JIT and also serves as the
+/// reference implementation of the IR's semantics for testing the other
+/// backends against.
+use std::cell::{Cell, RefCell};
+use std::fmt::{Debug, Display, Error, Formatter};
+
+use super::ir::{
+    self as ir, collect_all_func_values, FuncValue, Instruction, LocalValue, Module, StaticValue,
+};
+use super::CodegenOptions;
+
+mod const_eval;
+mod tiered;
+
+pub use const_eval::fold_constant_calls;
+
+use tiered::Tiers;
+
+/// How deep the call stack can get before we give up. Every IR call recurses
+/// on the Rust stack, so this needs to be low enough to not overflow it.
+const MAX_DEPTH: usize = 10_000;
+
+#[derive(Clone)]
+pub enum RuntimeValue {
+    Bool(bool),
+    FuncPtr(FuncValue),
+    Int64(i64),
+    Tuple(Vec<RuntimeValue>),
+}
+
+impl RuntimeValue {
+    /// Convert the value returned by main into the status code that the
+    /// process should exit with.
+    pub fn into_status(self) -> i64 {
+        match self {
+            RuntimeValue::Int64(value) => value,
+            RuntimeValue::Tuple(members) if members.is_empty() => 0,
+            other @ _ => unreachable!("Cannot convert to a status code: {:?}", other),
+        }
+    }
+}
+
+impl Debug for RuntimeValue {
+    fn fmt(&self, f: &mut Formatter) -> Result<(), Error> {
+        use RuntimeValue::*;
+        match self {
+            Bool(value) => write!(f, "Bool({})", value),
+            FuncPtr(func_value) => write!(f, "FuncPtr({})", func_value.get_qualified_name()),
+            Int64(value) => write!(f, "Int64({})", value),
+            Tuple(members) => f.debug_tuple("Tuple").field(members).finish(),
+        }
+    }
+}
+
+#[derive(Debug)]
+pub enum InterpreterError {
+    StackOverflow {
+        depth: usize,
+    },
+    InvalidBytecode {
+        message: String,
+    },
+    /// Lowering the function to bytecode needs more registers than
+    /// instructions can address.
+    TooManyRegisters {
+        function: String,
+    },
+    DivisionByZero,
+    /// Dividing `i64::MIN` by -1.
+    DivisionOverflow,
+    /// Compile-time evaluation executed more instructions than allowed.
+    BudgetExhausted,
+}
+
+impl Display for InterpreterError {
+    fn fmt(&self, f: &mut Formatter) -> Result<(), Error> {
+        use InterpreterError::*;
+        match self {
+            StackOverflow { depth } => write!(f, "Stack overflow (depth {})", depth),
+            InvalidBytecode { message } => write!(f, "Invalid bytecode: {}", message),
+            TooManyRegisters { function } => {
+                write!(f, "Too many registers needed to lower {}", function)
+            }
+            DivisionByZero => write!(f, "Division by zero"),
+            DivisionOverflow => write!(f, "Division overflowed"),
+            BudgetExhausted => write!(f, "Exceeded the step budget"),
+        }
+    }
+}
+
+impl InterpreterError {
+    /// The error for a division by `rhs` that `IntOp::evaluate` rejected.
+    pub fn division(rhs: i64) -> Self {
+        if rhs == 0 {
+            InterpreterError::DivisionByZero
+        } else {
+            InterpreterError::DivisionOverflow
+        }
+    }
+}
+
+type InterpreterResult<T> = Result<T, InterpreterError>;
+
+/// Find the main func in the modules and interpret it. Returns the value
+/// returned by main.
+pub fn run_modules(modules: &Vec<Module>) -> InterpreterResult<i64> {
+    run_main(modules, Interpreter::new())
+}
+
+/// Same as `run_modules`, but funcs that get hot are compiled with the JIT
+/// according to the options and called natively from then on.
+pub fn run_modules_tiered(
+    modules: &Vec<Module>,
+    options: &CodegenOptions,
+) -> InterpreterResult<i64> {
+    run_main(
+        modules,
+        Interpreter::new_tiered(tiered::DEFAULT_THRESHOLD, options),
+    )
+}
+
+fn run_main(modules: &Vec<Module>, interpreter: Interpreter) -> InterpreterResult<i64> {
+    let main = collect_all_func_values(modules)
+        .into_iter()
+        .find(|func| func.is_main())
+        .expect("Missing main func");
+    interpreter
+        .call(&main, vec![])
+        .map(|retrn| retrn.into_status())
+}
+
+pub struct Interpreter {
+    depth: Cell<usize>,
+    tiers: Option<RefCell<Tiers>>,
+    /// Instructions left to execute when evaluating at compile time.
+    budget: Option<Cell<usize>>,
+}
+
+impl Interpreter {
+    pub fn new() -> Self {
+        Self {
+            depth: Cell::new(0),
+            tiers: None,
+            budget: None,
+        }
+    }
+
+    pub fn new_tiered(threshold: usize, options: &CodegenOptions) -> Self {
+        Self {
+            depth: Cell::new(0),
+            tiers: Some(RefCell::new(Tiers::new(threshold, options))),
+            budget: None,
+        }
+    }
+
+    /// For evaluating at compile time: fails if it executes more than
+    /// `steps` instructions. No instruction has side effects (there's no
+    /// I/O or global state in the IR), so anything else can be evaluated.
+    pub fn new_with_budget(steps: usize) -> Self {
+        Self {
+            depth: Cell::new(0),
+            tiers: None,
+            budget: Some(Cell::new(steps)),
+        }
+    }
+
+    pub fn call(
+        &self,
+        func_value: &FuncValue,
+        arguments: Vec<RuntimeValue>,
+    ) -> InterpreterResult<RuntimeValue> {
+        if let Some(tiers) = &self.tiers {
+            // Don't hold the borrow while calling into native code.
+            let native = tiers.borrow_mut().enter(func_value);
+            if let Some(native) = native {
+                return Ok(native.call(arguments));
+            }
+        }
+        let depth = self.depth.get();
+        if depth >= MAX_DEPTH {
+            return Err(InterpreterError::StackOverflow { depth });
+        }
+        self.depth.set(depth + 1);
+        let result = self.execute(func_value, arguments);
+        self.depth.set(depth);
+        result
+    }
+
+    fn execute(
+        &self,
+        func_value: &FuncValue,
+        arguments: Vec<RuntimeValue>,
+    ) -> InterpreterResult<RuntimeValue> {
+        let mut frame = Frame::new(func_value, arguments);
+
+        let basic_block_manager = func_value.borrow_basic_blocks();
+        let basic_blocks = basic_block_manager.basic_blocks.borrow();
+        if basic_blocks.is_empty() {
+            panic!("Cannot execute an empty function");
+        }
+
+        // Track where we came from so that phis can pick their value.
+        let mut previous = None;
+        let mut current = 0;
+        loop {
+            let basic_block = &basic_blocks[current];
+            let next = self.execute_basic_block(basic_block, previous, &mut frame)?;
+            let next = match next {
+                Next::Branch(next) => next,
+                Next::Return(value) => return Ok(value),
+            };
+            if next <= current {
+                if let Some(tiers) = &self.tiers {
+                    tiers.borrow_mut().back_edge(func_value);
+                }
+            }
+            previous = Some(current);
+            current = next;
+        }
+    }
+
+    /// Runs a block until it branches or returns.
+    fn execute_basic_block(
+        &self,
+        basic_block: &ir::BasicBlock,
+        previous: Option<usize>,
+        frame: &mut Frame,
+    ) -> InterpreterResult<Next> {
+        for instruction in basic_block.instructions.iter() {
+            self.step()?;
+            use Instruction::*;
+            match instruction {
+                Branch(target) => return Ok(Next::Branch(target.get())),
+                CondBranch(condition, then, els) => {
+                    let target = if frame.get_bool(condition) { then } else { els };
+                    return Ok(Next::Branch(target.get()));
+                }
+                CallFunc(retrn, callee, arguments) => {
+                    let arguments = frame.get_all(arguments);
+                    let value = self.call(callee, arguments)?;
+                    frame.set(retrn, value);
+                }
+                CallFuncPtr(retrn, target, arguments) => {
+                    let callee = match frame.get(&ir::Value::Local(target.clone())) {
+                        RuntimeValue::FuncPtr(callee) => callee,
+                        other @ _ => unreachable!("Cannot call non-FuncPtr: {:?}", other),
+                    };
+                    let arguments = frame.get_all(arguments);
+                    let value = self.call(&callee, arguments)?;
+                    frame.set(retrn, value);
+                }
+                GetLocal(value, index) => {
+                    let local = frame.get_local(*index);
+                    frame.set(value, local);
+                }
+                GetLocalMember(value, index, member) => {
+                    let member = match frame.get_local(*index) {
+                        RuntimeValue::Tuple(mut members) => members.swap_remove(*member),
+                        other @ _ => unreachable!("Cannot get member of non-Tuple: {:?}", other),
+                    };
+                    frame.set(value, member);
+                }
+                GetTupleMember(member, tuple, index) => {
+                    let value = match frame.get(tuple) {
+                        RuntimeValue::Tuple(mut members) => members.swap_remove(*index),
+                        other @ _ => unreachable!("Cannot get member of non-Tuple: {:?}", other),
+                    };
+                    frame.set(member, value);
+                }
+                IntArithmetic(retrn, op, lhs, rhs) => {
+                    let (lhs, rhs) = (frame.get_int64(lhs), frame.get_int64(rhs));
+                    let value = op
+                        .evaluate(lhs, rhs)
+                        .ok_or_else(|| InterpreterError::division(rhs))?;
+                    frame.set(retrn, RuntimeValue::Int64(value));
+                }
+                IntCompare(retrn, comparison, lhs, rhs) => {
+                    let (lhs, rhs) = (frame.get_int64(lhs), frame.get_int64(rhs));
+                    let value = comparison.evaluate(lhs, rhs);
+                    frame.set(retrn, RuntimeValue::Bool(value));
+                }
+                MakeTuple(tuple, members) => {
+                    let members = frame.get_all(members);
+                    frame.set(tuple, RuntimeValue::Tuple(members));
+                }
+                Phi(retrn, incoming) => {
+                    let (value, _) = incoming
+                        .iter()
+                        .find(|(_, predecessor)| Some(predecessor.get()) == previous)
+                        .expect("Phi has no value for the predecessor");
+                    let value = frame.get(value);
+                    frame.set(retrn, value);
+                }
+                Return(value) => return Ok(Next::Return(frame.get(value))),
+                SetLocal(index, value) => {
+                    let value = frame.get(value);
+                    frame.locals[*index] = Some(value);
+                }
+            }
+        }
+        unreachable!(
+            "Basic block fell through without returning: {}",
+            basic_block.name
+        )
+    }
+
+    /// Charge an instruction against the budget when evaluating at
+    /// compile time.
+    fn step(&self) -> InterpreterResult<()> {
+        if let Some(budget) = &self.budget {
+            let remaining = budget.get();
+            if remaining == 0 {
+                return Err(InterpreterError::BudgetExhausted);
+            }
+            budget.set(remaining - 1);
+        }
+        Ok(())
+    }
+}
+
+/// Where execution goes after a basic block.
+enum Next {
+    Branch(usize),
+    Return(RuntimeValue),
+}
+
+/// The state of a single func call.
+struct Frame {
+    /// Slots for the func's stack frame.
+    locals: Vec<Option<RuntimeValue>>,
+    /// SSA values indexed by their `ValueId`.
+    values: Vec<Option<RuntimeValue>>,
+}
+
+impl Frame {
+    fn new(func_value: &FuncValue, arguments: Vec<RuntimeValue>) -> Self {
+        let parameters = func_value.get_parameters();
+        // Copy parameters into the stack slots with matching names the same
+        // way that the target compiler does.
+        let locals = func_value
+            .get_stack_frame()
+            .iter()
+            .map(|(name, _)| {
+                parameters
+                    .iter()
+                    .position(|(parameter_name, _)| parameter_name == name)
+                    .map(|index| arguments[index].clone())
+            })
+            .collect::<Vec<_>>();
+        Self {
+            locals,
+            values: vec![],
+        }
+    }
+
+    fn get_local(&self, index: usize) -> RuntimeValue {
+        self.locals[index]
+            .clone()
+            .expect(&format!("Local not initialized: {}", index))
+    }
+
+    fn get(&self, value: &ir::Value) -> RuntimeValue {
+        match value {
+            ir::Value::Local(local_value) => {
+                // Handle constant values that haven't actually been stored.
+                match local_value {
+                    LocalValue::Bool(_, Some(const_value)) => {
+                        return RuntimeValue::Bool(*const_value);
+                    }
+                    LocalValue::Int64(_, Some(const_value)) => {
+                        return RuntimeValue::Int64(*const_value as i64);
+                    }
+                    LocalValue::Tuple(_, tuple_type) if tuple_type.members.is_empty() => {
+                        return RuntimeValue::Tuple(vec![]);
+                    }
+                    _ => (),
+                }
+                let id = local_value.value_id().get();
+                self.values
+                    .get(id)
+                    .and_then(|value| value.clone())
+                    .expect(&format!("Missing value: {}", id))
+            }
+            ir::Value::Static(static_value) => match static_value {
+                StaticValue::Func(func_value) => RuntimeValue::FuncPtr(func_value.clone()),
+            },
+            ir::Value::Abstract(_) => unreachable!("Cannot interpret an Abstract value"),
+        }
+    }
+
+    fn get_int64(&self, value: &ir::Value) -> i64 {
+        match self.get(value) {
+            RuntimeValue::Int64(value) => value,
+            other @ _ => unreachable!("Expected Int64: {:?}", other),
+        }
+    }
+
+    fn get_bool(&self, value: &ir::Value) -> bool {
+        match self.get(value) {
+            RuntimeValue::Bool(value) => value,
+            other @ _ => unreachable!("Expected Bool: {:?}", other),
+        }
+    }
+
+    fn get_all(&self, values: &Vec<ir::Value>) -> Vec<RuntimeValue> {
+        values.iter().map(|value| self.get(value)).collect()
+    }
+
+    fn set(&mut self, value: &ir::Value, runtime_value: RuntimeValue) {
+        let id = value.value_id().get();
+        if id >= self.values.len() {
+            self.values.resize(id + 1, None);
+        }
+        self.values[id] = Some(runtime_value);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::bytecode;
+    use super::super::ir::{compile_source, Module};
+    use super::super::CodegenOptions;
+    use super::{run_main, run_modules, Interpreter, InterpreterError};
+
+    fn compile(name: &str, source: &str) -> Vec<Module> {
+        compile_source(&format!("interpreter-{}", name), source).0
+    }
+
+    fn interpret(name: &str, source: &str) -> i64 {
+        run_modules(&compile(name, source)).unwrap()
+    }
+
+    #[test]
+    fn test_interpret_calls() {
+        assert_eq!(
+            interpret(
+                "calls",
+                "func main() {\n  func identity(a) {\n    a\n  }\n  identity(42)\n}\n",
+            ),
+            42
+        );
+    }
+
+    #[test]
+    fn test_interpret_static_calls() {
+        assert_eq!(
+            interpret(
+                "static-calls",
+                "func first(a, b) {\n  a\n}\nfunc main() {\n  first(7, 8)\n}\n",
+            ),
+            7
+        );
+    }
+
+    #[test]
+    fn test_interpret_arithmetic() {
+        assert_eq!(
+            interpret(
+                "arithmetic",
+                "func f(a, b) {\n  a * b - a / b + (a % b) * if a < b { 1 } else { 0 }\n}\nfunc main() {\n  f(-7, 2)\n}\n",
+            ),
+            -7 * 2 - (-7 / 2) + (-7 % 2) * 1
+        );
+    }
+
+    #[test]
+    fn test_invalid_divisions_fail() {
+        let cases = [
+            ("division-by-zero", "7, 0", false),
+            ("division-overflow", "-9223372036854775807 - 1, -1", true),
+        ];
+        for (name, arguments, overflows) in cases.iter() {
+            let modules = compile(
+                name,
+                &format!(
+                    "func f(a, b) {{\n  a / b + a % b\n}}\nfunc main() {{\n  f({})\n}}\n",
+                    arguments
+                ),
+            );
+            let vm = bytecode::lower_modules(&modules).and_then(|program| bytecode::run(&program));
+            for result in vec![run_modules(&modules), vm] {
+                match result {
+                    Err(InterpreterError::DivisionByZero) if !overflows => (),
+                    Err(InterpreterError::DivisionOverflow) if *overflows => (),
+                    other => panic!("{}: {:?}", name, other),
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn test_interpret_control_flow() {
+        assert_eq!(
+            interpret(
+                "control-flow",
+                "func main() {\n  var sum = 0\n  var i = 0\n  while i < 10 {\n    sum = sum + if i % 3 == 0 { i } else { 1 }\n    i = i + 1\n  }\n  sum\n}\n",
+            ),
+            (0 + 3 + 6 + 9) + 6
+        );
+    }
+
+    #[test]
+    fn test_interpret_tuples() {
+        assert_eq!(
+            interpret(
+                "tuples",
+                "func divmod(a, b) {\n  (a / b, a % b)\n}\nfunc main() {\n  let qr = divmod(17, 5)\n  qr.0 * 10 + qr.1\n}\n",
+            ),
+            32
+        );
+    }
+
+    #[test]
+    fn test_tiered_compiles_hot_funcs() {
+        let modules = compile(
+            "tiered",
+            "func main() {\n  func identity(a) {\n    a\n  }\n  identity(42)\n}\n",
+        );
+        // A threshold of 1 compiles every func on its first call, so main
+        // runs natively.
+        let tiered = Interpreter::new_tiered(1, &CodegenOptions::default());
+        assert_eq!(run_main(&modules, tiered).unwrap(), 42);
+    }
+}
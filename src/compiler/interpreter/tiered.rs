@@ -0,0 +1,169 @@
+/// Tiered execution: every func starts out interpreted and is compiled with
+/// the JIT once it gets hot. Hotness is tracked per func by counting calls
+/// and loop back-edges.
+use std::collections::{HashMap, HashSet};
+use std::mem::transmute;
+
+use super::super::ir::{FuncId, FuncValue, RealType};
+use super::super::target::Jit;
+use super::super::CodegenOptions;
+use super::RuntimeValue;
+
+/// How hot a func has to get before it's compiled.
+pub const DEFAULT_THRESHOLD: usize = 1_000;
+
+/// Natively-compiled funcs can only be called from the interpreter if all
+/// their arguments fit in registers.
+const MAX_NATIVE_ARITY: usize = 6;
+
+#[derive(Default)]
+struct Counters {
+    calls: usize,
+    back_edges: usize,
+}
+
+/// A func's entry once it's been compiled.
+#[derive(Clone)]
+pub struct NativeFunc {
+    address: usize,
+    retrn: RealType,
+}
+
+impl NativeFunc {
+    pub fn call(&self, arguments: Vec<RuntimeValue>) -> RuntimeValue {
+        let arguments = arguments
+            .into_iter()
+            .filter_map(|argument| match argument {
+                RuntimeValue::Int64(value) => Some(value),
+                // Unit is erased from signatures (see the target's
+                // `TypeTracker`).
+                RuntimeValue::Tuple(ref members) if members.is_empty() => None,
+                other @ _ => unreachable!("Cannot pass to native code: {:?}", other),
+            })
+            .collect::<Vec<_>>();
+        let retrn = unsafe { call_native(self.address, &arguments) };
+        match self.retrn {
+            RealType::Int64 => RuntimeValue::Int64(retrn),
+            // Funcs returning unit are void so `retrn` is garbage.
+            _ => RuntimeValue::Tuple(vec![]),
+        }
+    }
+}
+
+unsafe fn call_native(address: usize, arguments: &[i64]) -> i64 {
+    type F0 = extern "C" fn() -> i64;
+    type F1 = extern "C" fn(i64) -> i64;
+    type F2 = extern "C" fn(i64, i64) -> i64;
+    type F3 = extern "C" fn(i64, i64, i64) -> i64;
+    type F4 = extern "C" fn(i64, i64, i64, i64) -> i64;
+    type F5 = extern "C" fn(i64, i64, i64, i64, i64) -> i64;
+    type F6 = extern "C" fn(i64, i64, i64, i64, i64, i64) -> i64;
+    match *arguments {
+        [] => transmute::<usize, F0>(address)(),
+        [a] => transmute::<usize, F1>(address)(a),
+        [a, b] => transmute::<usize, F2>(address)(a, b),
+        [a, b, c] => transmute::<usize, F3>(address)(a, b, c),
+        [a, b, c, d] => transmute::<usize, F4>(address)(a, b, c, d),
+        [a, b, c, d, e] => transmute::<usize, F5>(address)(a, b, c, d, e),
+        [a, b, c, d, e, f] => transmute::<usize, F6>(address)(a, b, c, d, e, f),
+        _ => unreachable!("Too many arguments for a native call: {}", arguments.len()),
+    }
+}
+
+pub struct Tiers {
+    threshold: usize,
+    counters: HashMap<FuncId, Counters>,
+    /// Funcs which have been compiled; the interpreter checks this before
+    /// interpreting a func so that compiling a func patches its entry.
+    entries: HashMap<FuncId, NativeFunc>,
+    jit: Option<Jit>,
+    /// For compiling hot funcs.
+    options: CodegenOptions,
+}
+
+impl Tiers {
+    pub fn new(threshold: usize, options: &CodegenOptions) -> Self {
+        Self {
+            threshold,
+            counters: HashMap::new(),
+            entries: HashMap::new(),
+            jit: None,
+            options: options.clone(),
+        }
+    }
+
+    /// Called on every interpreted call. Returns the native entry if the func
+    /// has been (or just got) compiled.
+    pub fn enter(&mut self, func_value: &FuncValue) -> Option<NativeFunc> {
+        if let Some(entry) = self.entries.get(&func_value.id()) {
+            return Some(entry.clone());
+        }
+        let counters = self.counters.entry(func_value.id()).or_default();
+        counters.calls += 1;
+        self.check_hot(func_value)
+    }
+
+    /// Called whenever the interpreter branches backwards in a func. A func
+    /// that loops is compiled the next time it's entered, since there's no
+    /// on-stack replacement of the running interpreted frame.
+    pub fn back_edge(&mut self, func_value: &FuncValue) {
+        let counters = self.counters.entry(func_value.id()).or_default();
+        counters.back_edges += 1;
+    }
+
+    fn check_hot(&mut self, func_value: &FuncValue) -> Option<NativeFunc> {
+        let counters = &self.counters[&func_value.id()];
+        if counters.calls + counters.back_edges < self.threshold || !can_call_natively(func_value) {
+            return None;
+        }
+
+        let options = &self.options;
+        let jit = self.jit.get_or_insert_with(|| Jit::new(options));
+        // Compile everything the func can reach that isn't compiled yet.
+        let funcs = collect_reachable(func_value)
+            .into_iter()
+            .filter(|func_value| !jit.is_compiled(func_value))
+            .collect::<Vec<_>>();
+        jit.compile(&funcs);
+
+        let entry = NativeFunc {
+            address: jit.get_address(func_value),
+            retrn: func_value.get_retrn(),
+        };
+        self.entries.insert(func_value.id(), entry.clone());
+        self.counters.remove(&func_value.id());
+        Some(entry)
+    }
+}
+
+fn can_call_natively(func_value: &FuncValue) -> bool {
+    fn is_scalar(real_type: &RealType) -> bool {
+        match real_type {
+            RealType::Int64 => true,
+            RealType::Tuple(tuple_type) => tuple_type.members.is_empty(),
+            // Only the low bit of an `i1` is defined so it can't be passed
+            // around as an i64.
+            RealType::Bool | RealType::FuncPtr(_) => false,
+        }
+    }
+    let parameters = func_value.get_parameters();
+    parameters.len() <= MAX_NATIVE_ARITY
+        && parameters.iter().all(|(_, real_type)| is_scalar(real_type))
+        && is_scalar(&func_value.get_retrn())
+}
+
+/// Find the func and every func that it can call (directly or through a
+/// pointer to a static func).
+fn collect_reachable(func_value: &FuncValue) -> Vec<FuncValue> {
+    let mut seen = HashSet::new();
+    let mut reachable = vec![];
+    let mut stack = vec![func_value.clone()];
+    while let Some(func_value) = stack.pop() {
+        if !seen.insert(func_value.id()) {
+            continue;
+        }
+        stack.extend(func_value.referenced_funcs());
+        reachable.push(func_value);
+    }
+    reachable
+}
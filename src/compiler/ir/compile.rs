@@ -4,6 +4,8 @@ use std::rc::Rc;
 use std::sync::Arc;
 
 use super::super::super::frontend::Module as FrontendModule;
+use super::super::super::parser::Token;
+use super::super::super::trace;
 use super::super::super::type_ast::{self as ast};
 use super::super::path_to_name::path_to_name;
 use super::super::vecs_equal::vecs_equal;
@@ -19,9 +21,16 @@ pub struct BasicBlockManager {
 }
 
 // Pointer to a basic block.
-#[derive(Clone, Eq, Hash, PartialEq)]
+#[derive(Clone, Debug, Eq, Hash, PartialEq)]
 pub struct BasicBlockIndex(usize);
 
+impl BasicBlockIndex {
+    /// Position of the block in its func's `basic_blocks`.
+    pub fn get(&self) -> usize {
+        self.0
+    }
+}
+
 impl BasicBlockManager {
     pub fn new() -> Self {
         Self {
@@ -89,18 +98,60 @@ pub fn compile_modules<'m, M: Iterator<Item = &'m FrontendModule>>(
     if !is_immediately_specializable(&main_func) {
         panic!("Main func cannot be specialized");
     }
-    let ast_func = &main_func.0.ast_func;
+    let func_value = compile_entry_func(main_func, &typer);
+    // Mark is as the main func for the target compiler.
+    func_value.set_main(true);
+
+    root
+}
+
+/// Compiles batches of funcs into a single module, keeping the funcs from
+/// earlier batches so that later ones can call them. Used by the REPL.
+pub struct IncrementalCompiler {
+    root: Root,
+    module: Module,
+}
+
+impl IncrementalCompiler {
+    pub fn new(qualified_name: String) -> Self {
+        let root = Root::new(Typer::new(None));
+        let module = root.add_module(0, qualified_name);
+        Self { root, module }
+    }
+
+    pub fn define_funcs(&self, ast_funcs: Vec<ast::Func>) {
+        for ast_func in ast_funcs.into_iter() {
+            self.module.define_func(ast_func);
+        }
+    }
+
+    /// Compile a previously-defined func which doesn't take any arguments.
+    /// Returns `None` if its type is generic and so it can't be compiled.
+    pub fn compile_entry(&self, name: &str) -> Option<FuncValue> {
+        let func = self
+            .module
+            .find_func_by_name(name)
+            .expect(&format!("Func not defined: {}", name));
+        if !is_immediately_specializable(&func) {
+            return None;
+        }
+        Some(compile_entry_func(func, &self.root.0.typer))
+    }
+
+    pub fn get_modules(&self) -> Vec<Module> {
+        self.root.get_modules()
+    }
+}
+
+fn compile_entry_func(func: Func, typer: &Typer) -> FuncValue {
+    let ast_func = &func.0.ast_func;
     let parameters = ast_func
         .arguments
         .iter()
         .map(|argument| typer.build_type(&argument.typ))
         .collect::<Vec<_>>();
     let retrn = typer.build_type(&ast_func.typ.unwrap_func().retrn.borrow());
-    let func_value = compile_func_specialization(main_func, parameters, retrn);
-    // Mark is as the main func for the target compiler.
-    func_value.set_main(true);
-
-    root
+    compile_func_specialization(func, parameters, retrn)
 }
 
 fn compile_func_specialization(func: Func, parameters: Vec<Type>, retrn: Type) -> FuncValue {
@@ -111,7 +162,10 @@ fn compile_func_specialization(func: Func, parameters: Vec<Type>, retrn: Type) -
         .collect::<Vec<_>>();
     let retrn = retrn.into_real();
 
-    let func_value = func.get_or_insert_specialization(parameters, retrn);
+    let func_value = {
+        let _span = trace::span("specialize", "ir", None, Some(func.name()));
+        func.get_or_insert_specialization(parameters, retrn)
+    };
 
     // `create_basic_blocks` returns a `Some` if it just created the basic
     // block manager (indicating this specialization hasn't been compiled).
@@ -119,6 +173,8 @@ fn compile_func_specialization(func: Func, parameters: Vec<Type>, retrn: Type) -
         let builder = Builder {
             buildable: Box::new(func_value.clone()),
             basic_blocks,
+            lets: RefCell::new(HashMap::new()),
+            tuples: RefCell::new(HashMap::new()),
         };
         compile_func_body(&builder, func_value.clone(), &func.0.ast_func.body);
     }
@@ -143,6 +199,13 @@ pub trait Buildable: Container {
 struct Builder<'a> {
     buildable: Box<dyn Buildable>,
     basic_blocks: Ref<'a, BasicBlockManager>,
+    /// Values bound with `let` that are in scope. They're used directly
+    /// instead of going through the stack frame, so constants propagate
+    /// into their uses.
+    lets: RefCell<HashMap<String, Value>>,
+    /// Members of the tuples built in this func, so that getting a member of
+    /// one is just the member and the tuple itself never has to exist.
+    tuples: RefCell<HashMap<ValueId, Vec<Value>>>,
 }
 
 impl<'a> Builder<'a> {
@@ -158,6 +221,14 @@ impl<'a> Builder<'a> {
         self.buildable.find_local(name)
     }
 
+    fn find_let(&self, name: &str) -> Option<Value> {
+        self.lets.borrow().get(name).cloned()
+    }
+
+    fn find_static_func(&self, name: &str) -> Option<Func> {
+        self.buildable.find_static_func(name)
+    }
+
     fn build_type(&self, ast_type: &ast::Type) -> Type {
         self.buildable.get_typer().build_type(ast_type)
     }
@@ -165,6 +236,7 @@ impl<'a> Builder<'a> {
     fn build_value(&self, typ: Type) -> Value {
         match typ {
             Type::Real(real_type) => match real_type {
+                RealType::Bool => Value::Local(LocalValue::Bool(self.get_next_value_id(), None)),
                 RealType::FuncPtr(func_ptr_type) => {
                     Value::Local(LocalValue::FuncPtr(self.get_next_value_id(), func_ptr_type))
                 }
@@ -181,6 +253,14 @@ impl<'a> Builder<'a> {
         self.basic_blocks.append_basic_block(name)
     }
 
+    fn current_index(&self) -> BasicBlockIndex {
+        self.basic_blocks.current_index()
+    }
+
+    fn position_at_end(&self, index: BasicBlockIndex) {
+        self.basic_blocks.position_at_end(index)
+    }
+
     fn get_next_value_id(&self) -> ValueId {
         self.basic_blocks.get_next_value_id()
     }
@@ -199,6 +279,11 @@ impl<'a> Builder<'a> {
         Value::Local(LocalValue::Int64(id, Some(const_value)))
     }
 
+    fn const_bool(&self, const_value: bool) -> Value {
+        let id = self.get_next_value_id();
+        Value::Local(LocalValue::Bool(id, Some(const_value)))
+    }
+
     fn build_call_func(
         &self,
         retrn: RealType,
@@ -221,24 +306,111 @@ impl<'a> Builder<'a> {
         retrn
     }
 
+    /// Folds to a constant when both operands are constants (unless the
+    /// operation would fail at runtime, eg. dividing by zero).
+    fn build_int_arithmetic(&self, op: IntOp, lhs: Value, rhs: Value) -> Value {
+        if let (Some(lhs), Some(rhs)) = (lhs.const_int64(), rhs.const_int64()) {
+            if let Some(result) = op.evaluate(lhs, rhs) {
+                return self.const_int64(result as u64);
+            }
+        }
+        let retrn = self.build_value(Type::Real(RealType::Int64));
+        self.push_instruction(Instruction::IntArithmetic(retrn.clone(), op, lhs, rhs));
+        retrn
+    }
+
+    /// Produces a `Bool`. Folds to a constant when both operands are
+    /// constants.
+    fn build_int_compare(&self, comparison: IntComparison, lhs: Value, rhs: Value) -> Value {
+        if let (Some(lhs), Some(rhs)) = (lhs.const_int64(), rhs.const_int64()) {
+            return self.const_bool(comparison.evaluate(lhs, rhs));
+        }
+        let retrn = self.build_value(Type::Real(RealType::Bool));
+        self.push_instruction(Instruction::IntCompare(retrn.clone(), comparison, lhs, rhs));
+        retrn
+    }
+
+    fn build_tuple(&self, members: Vec<Value>) -> Value {
+        if members.is_empty() {
+            return self.const_unit();
+        }
+        let tuple_type = TupleType::new(
+            members
+                .iter()
+                .map(|member| member.typ().into_real())
+                .collect(),
+        );
+        self.build_struct(tuple_type, members)
+    }
+
+    /// Like `build_tuple` but with a given type, which for structs carries
+    /// the layout. The members must be in the type's order.
+    fn build_struct(&self, tuple_type: TupleType, members: Vec<Value>) -> Value {
+        let tuple = self.build_value(Type::Real(RealType::Tuple(tuple_type)));
+        self.push_instruction(Instruction::MakeTuple(tuple.clone(), members.clone()));
+        self.tuples.borrow_mut().insert(tuple.value_id(), members);
+        tuple
+    }
+
+    /// Folds to the member itself if the tuple was built in this func.
+    fn build_get_tuple_member(&self, tuple: Value, index: usize) -> Value {
+        if let Some(members) = self.tuples.borrow().get(&tuple.value_id()) {
+            return members[index].clone();
+        }
+        let member_type = match tuple.typ() {
+            Type::Real(RealType::Tuple(tuple_type)) => tuple_type.members[index].clone(),
+            other @ _ => unreachable!("Cannot get member of non-Tuple: {:?}", other),
+        };
+        let member = self.build_value(Type::Real(member_type));
+        self.push_instruction(Instruction::GetTupleMember(member.clone(), tuple, index));
+        member
+    }
+
     fn build_get_local(&self, index: usize, real_type: RealType) -> Value {
         let value = self.build_value(Type::Real(real_type));
         self.push_instruction(Instruction::GetLocal(value.clone(), index));
         value
     }
 
+    fn build_get_local_member(&self, index: usize, member: usize, real_type: RealType) -> Value {
+        let value = self.build_value(Type::Real(real_type));
+        self.push_instruction(Instruction::GetLocalMember(value.clone(), index, member));
+        value
+    }
+
+    fn build_set_local(&self, index: usize, value: Value) {
+        self.push_instruction(Instruction::SetLocal(index, value));
+    }
+
+    fn build_branch(&self, target: BasicBlockIndex) {
+        self.push_instruction(Instruction::Branch(target));
+    }
+
+    fn build_cond_branch(&self, condition: Value, then: BasicBlockIndex, els: BasicBlockIndex) {
+        self.push_instruction(Instruction::CondBranch(condition, then, els));
+    }
+
+    fn build_phi(&self, typ: Type, incoming: Vec<(Value, BasicBlockIndex)>) -> Value {
+        let value = self.build_value(typ);
+        self.push_instruction(Instruction::Phi(value.clone(), incoming));
+        value
+    }
+
     fn build_return(&self, value: Value) {
         self.push_instruction(Instruction::Return(value));
     }
 }
 
 fn compile_func_body(builder: &Builder, func_value: FuncValue, body: &ast::Block) {
+    let _span = trace::span("lower", "ir", None, Some(func_value.get_qualified_name()));
     builder.append_basic_block(Some("entry"));
     let implicit_retrn = compile_block(builder, body);
     builder.build_return(implicit_retrn);
 }
 
 fn compile_block(builder: &Builder, block: &ast::Block) -> Value {
+    // Lets bound in this block go out of scope at the end of it.
+    let outer_lets = builder.lets.borrow().clone();
     // Implicit return is the unit tuple or the value produced by the
     // last statement.
     let mut implicit_value = builder.const_unit();
@@ -253,7 +425,31 @@ fn compile_block(builder: &Builder, block: &ast::Block) -> Value {
                     let func = builder.define_func(func.clone());
                     Value::Abstract(AbstractValue::UnspecializedFunc(func))
                 }
-                other @ _ => unreachable!("Cannot compile BlockStatement: {:?}", other),
+                ast::BlockStatement::Assignment(assignment) => {
+                    let value = compile_expression(builder, &assignment.value);
+                    compile_set_local(builder, &assignment.name.name, value);
+                    builder.const_unit()
+                }
+                ast::BlockStatement::Let(let_) => {
+                    let value = compile_expression(builder, &let_.initializer);
+                    builder
+                        .lets
+                        .borrow_mut()
+                        .insert(let_.name.name.clone(), value.clone());
+                    value
+                }
+                ast::BlockStatement::Var(var) => match &var.initializer {
+                    Some(initializer) => {
+                        let value = compile_expression(builder, initializer);
+                        compile_set_local(builder, &var.name.name, value.clone());
+                        value
+                    }
+                    None => builder.const_unit(),
+                },
+                ast::BlockStatement::While(while_) => {
+                    compile_while(builder, while_);
+                    builder.const_unit()
+                }
             };
             if index == last_index {
                 implicit_value = value
@@ -261,39 +457,156 @@ fn compile_block(builder: &Builder, block: &ast::Block) -> Value {
         }
     }
 
+    builder.lets.replace(outer_lets);
     implicit_value
 }
 
 fn compile_expression(builder: &Builder, expression: &ast::Expression) -> Value {
     match expression {
         ast::Expression::Identifier(identifier) => compile_identifier(builder, identifier),
+        ast::Expression::If(if_) => compile_if(builder, if_),
+        ast::Expression::Infix(infix) => compile_infix(builder, infix),
         ast::Expression::LiteralInt(literal) => builder.const_int64(literal.value as u64),
         ast::Expression::PostfixCall(call) => compile_postfix_call(builder, call),
+        ast::Expression::PostfixProperty(property) => compile_postfix_property(builder, property),
+        ast::Expression::Tuple(tuple) => {
+            let members = tuple
+                .members
+                .iter()
+                .map(|member| compile_expression(builder, member))
+                .collect::<Vec<_>>();
+            builder.build_tuple(members)
+        }
+        ast::Expression::StructLiteral(literal) => compile_struct_literal(builder, literal),
         other @ _ => unreachable!("Cannot compile Expression: {:?}", other),
     }
 }
 
+fn compile_infix(builder: &Builder, infix: &ast::Infix) -> Value {
+    let lhs = compile_expression(builder, &infix.lhs);
+    let rhs = compile_expression(builder, &infix.rhs);
+    for operand in [&lhs, &rhs].iter() {
+        match operand {
+            Value::Local(LocalValue::Int64(_, _)) => (),
+            other @ _ => unreachable!("Cannot compile Infix on {:?}", other.typ()),
+        }
+    }
+    use Token::*;
+    let op = match &infix.op {
+        Plus(_) => IntOp::Add,
+        Minus(_) => IntOp::Sub,
+        Star(_) => IntOp::Mul,
+        Slash(_) => IntOp::Div,
+        Percent(_) => IntOp::Rem,
+        other @ _ => {
+            let comparison = match other {
+                EqualsEquals(_) => IntComparison::Equal,
+                BangEquals(_) => IntComparison::NotEqual,
+                LessThan(_) => IntComparison::LessThan,
+                LessThanEquals(_) => IntComparison::LessThanOrEqual,
+                GreaterThan(_) => IntComparison::GreaterThan,
+                GreaterThanEquals(_) => IntComparison::GreaterThanOrEqual,
+                _ => unreachable!("Cannot compile Infix operator: {:?}", other),
+            };
+            return builder.build_int_compare(comparison, lhs, rhs);
+        }
+    };
+    builder.build_int_arithmetic(op, lhs, rhs)
+}
+
+fn compile_set_local(builder: &Builder, name: &str, value: Value) {
+    let (index, _) = builder
+        .find_local(name)
+        .expect(&format!("Local not found: {}", name));
+    builder.build_set_local(index, value);
+}
+
+/// Lays out the condition's block, then the `then` block, then the `else`
+/// block (if any), and finally the block where they merge. A constant
+/// condition only compiles the branch that would be taken.
+fn compile_if(builder: &Builder, if_: &ast::If) -> Value {
+    let condition = compile_expression(builder, &if_.condition);
+    // Without an `else` the value of the `then` block is discarded.
+    let produces_value = if_.els.is_some() && !builder.build_type(&if_.typ).is_unit();
+
+    if let Some(condition) = condition.const_bool() {
+        let taken = if condition {
+            Some(&if_.block)
+        } else {
+            if_.els.as_ref()
+        };
+        let value = taken.map(|block| compile_block(builder, block));
+        return match value {
+            Some(value) if produces_value => value,
+            _ => builder.const_unit(),
+        };
+    }
+
+    let entry = builder.current_index();
+    let then = builder.append_basic_block(Some("then"));
+    let then_value = compile_block(builder, &if_.block);
+    let then_end = builder.current_index();
+    let els = if_.els.as_ref().map(|els| {
+        let index = builder.append_basic_block(Some("else"));
+        let value = compile_block(builder, els);
+        (index, value, builder.current_index())
+    });
+    let merge = builder.append_basic_block(Some("merge"));
+
+    builder.position_at_end(entry);
+    let els_target = els
+        .as_ref()
+        .map_or(merge.clone(), |(index, _, _)| index.clone());
+    builder.build_cond_branch(condition, then, els_target);
+    builder.position_at_end(then_end.clone());
+    builder.build_branch(merge.clone());
+    if let Some((_, _, els_end)) = &els {
+        builder.position_at_end(els_end.clone());
+        builder.build_branch(merge.clone());
+    }
+
+    builder.position_at_end(merge);
+    match els {
+        Some((_, els_value, els_end)) if produces_value => builder.build_phi(
+            then_value.typ(),
+            vec![(then_value, then_end), (els_value, els_end)],
+        ),
+        _ => builder.const_unit(),
+    }
+}
+
+/// Lays out the condition's block, then the body (which branches back to
+/// the condition), and finally the block that the loop exits to.
+fn compile_while(builder: &Builder, while_: &ast::While) {
+    let entry = builder.current_index();
+    let header = builder.append_basic_block(Some("while"));
+    builder.position_at_end(entry);
+    builder.build_branch(header.clone());
+
+    builder.position_at_end(header.clone());
+    let condition = compile_expression(builder, &while_.condition);
+    let header_end = builder.current_index();
+    let body = builder.append_basic_block(Some("body"));
+    compile_block(builder, &while_.block);
+    builder.build_branch(header);
+    let exit = builder.append_basic_block(Some("exit"));
+
+    builder.position_at_end(header_end);
+    builder.build_cond_branch(condition, body, exit.clone());
+    builder.position_at_end(exit);
+}
+
 fn compile_identifier(builder: &Builder, identifier: &ast::Identifier) -> Value {
     let resolution = &identifier.resolution;
     match resolution {
         ast::ScopeResolution::Local(name, ast_typ) => {
-            // First search for funcs defined in this func.
+            // Lets are in scope over anything else with the same name.
+            if let Some(value) = builder.find_let(name) {
+                return value;
+            }
+            // Then search for funcs defined in this func.
             if let Some(func) = builder.find_func(name) {
-                // Use the type expected by the AST to preemptively specialize
-                // if possible.
-                if !ast_typ.contains_generics() {
-                    // Using `unwrap` since this type better be callable,
-                    // otherwise we have a huge problem in typing.
-                    let (ast_parameters, ast_retrn) = ast_typ.maybe_callable().unwrap();
-                    let parameters = ast_parameters
-                        .iter()
-                        .map(|ast_parameter| builder.build_type(ast_parameter))
-                        .collect::<Vec<_>>();
-                    let retrn = builder.build_type(&ast_retrn);
-                    let func_value = compile_func_specialization(func, parameters, retrn);
-                    return Value::Static(StaticValue::Func(func_value));
-                }
-                return Value::Abstract(AbstractValue::UnspecializedFunc(func));
+                return compile_func_reference(builder, func, ast_typ);
             }
             // Then search for a slot in the stack frame.
             if let Some((index, typ)) = builder.find_local(name) {
@@ -301,6 +614,12 @@ fn compile_identifier(builder: &Builder, identifier: &ast::Identifier) -> Value
             }
             panic!("Local not found: {}", name)
         }
+        ast::ScopeResolution::Static(name, ast_typ) => {
+            let func = builder
+                .find_static_func(name)
+                .expect(&format!("Static not found: {}", name));
+            compile_func_reference(builder, func, ast_typ)
+        }
         other @ _ => unreachable!(
             "Cannot compile Identifier with ScopeResolution: {:?}",
             other
@@ -308,6 +627,24 @@ fn compile_identifier(builder: &Builder, identifier: &ast::Identifier) -> Value
     }
 }
 
+fn compile_func_reference(builder: &Builder, func: Func, ast_typ: &ast::Type) -> Value {
+    // Use the type expected by the AST to preemptively specialize
+    // if possible.
+    if !ast_typ.contains_generics() {
+        // Using `unwrap` since this type better be callable,
+        // otherwise we have a huge problem in typing.
+        let (ast_parameters, ast_retrn) = ast_typ.maybe_callable().unwrap();
+        let parameters = ast_parameters
+            .iter()
+            .map(|ast_parameter| builder.build_type(ast_parameter))
+            .collect::<Vec<_>>();
+        let retrn = builder.build_type(&ast_retrn);
+        let func_value = compile_func_specialization(func, parameters, retrn);
+        return Value::Static(StaticValue::Func(func_value));
+    }
+    Value::Abstract(AbstractValue::UnspecializedFunc(func))
+}
+
 fn compile_postfix_call(builder: &Builder, call: &ast::PostfixCall) -> Value {
     let target = compile_expression(builder, &call.target);
     let arguments = call
@@ -373,6 +710,70 @@ fn compile_postfix_call(builder: &Builder, call: &ast::PostfixCall) -> Value {
     unreachable!("Cannot compile Call")
 }
 
+/// Fields are compiled in source order and then placed where the struct's
+/// layout wants them.
+fn compile_struct_literal(builder: &Builder, literal: &ast::StructLiteral) -> Value {
+    let declared = match &literal.typ {
+        ast::Type::Object(object) => match &object.class {
+            ast::Class::Derived(derived) => derived.fields.clone(),
+            other @ _ => unreachable!("Cannot compile literal of builtin: {:?}", other),
+        },
+        other @ _ => unreachable!("Cannot compile struct literal of type: {:?}", other),
+    };
+    let mut fields = literal
+        .fields
+        .iter()
+        .map(|field| Some(compile_expression(builder, field)))
+        .collect::<Vec<_>>();
+    let tuple_type = match builder.build_type(&literal.typ).into_real() {
+        RealType::Tuple(tuple_type) => tuple_type,
+        other @ _ => unreachable!("Struct not built as a Tuple: {:?}", other),
+    };
+    let members = tuple_type
+        .layout
+        .as_ref()
+        .expect("Struct built without a layout")
+        .fields
+        .iter()
+        .map(|name| {
+            let position = declared
+                .iter()
+                .position(|field| &field.name == name)
+                .unwrap();
+            fields[position].take().unwrap()
+        })
+        .collect::<Vec<_>>();
+    builder.build_struct(tuple_type, members)
+}
+
+/// Properties are the members of tuples: by index for plain tuples and by
+/// field name for structs. A member of a `var` is read straight out of its
+/// stack slot rather than loading the whole struct first.
+fn compile_postfix_property(builder: &Builder, property: &ast::PostfixProperty) -> Value {
+    let name = &property.property.name;
+    if let ast::Expression::Identifier(identifier) = &*property.target {
+        if let ast::ScopeResolution::Local(local, _) = &identifier.resolution {
+            let is_var = builder.find_let(local).is_none() && builder.find_func(local).is_none();
+            if let (true, Some((index, RealType::Tuple(tuple_type)))) =
+                (is_var, builder.find_local(local))
+            {
+                let member = tuple_type
+                    .find_member(name)
+                    .expect(&format!("Cannot compile property: {}", name));
+                let real_type = tuple_type.members[member].clone();
+                return builder.build_get_local_member(index, member, real_type);
+            }
+        }
+    }
+    let target = compile_expression(builder, &property.target);
+    let member = match target.typ() {
+        Type::Real(RealType::Tuple(tuple_type)) => tuple_type.find_member(name),
+        _ => None,
+    };
+    let member = member.expect(&format!("Cannot compile property: {}", name));
+    builder.build_get_tuple_member(target, member)
+}
+
 fn compile_unspecialized_call(
     builder: &Builder,
     func: Func,
@@ -419,12 +820,155 @@ impl BasicBlock {
 }
 
 pub enum Instruction {
+    // Branch($1)
+    Branch(BasicBlockIndex),
     // $1 = $2($3...)
     CallFunc(Value, FuncValue, Vec<Value>),
     // $1 = $2($3...)
     CallFuncPtr(Value, LocalValue, Vec<Value>),
+    // CondBranch($1, $2, $3): to $2 if $1 is true, otherwise to $3
+    CondBranch(Value, BasicBlockIndex, BasicBlockIndex),
     // $1 = GetLocal($2)
     GetLocal(Value, usize),
+    // $1 = GetLocal($2).$3
+    GetLocalMember(Value, usize, usize),
+    // $1 = $2.$3
+    GetTupleMember(Value, Value, usize),
+    // $1 = $3 $2 $4
+    IntArithmetic(Value, IntOp, Value, Value),
+    // $1 = $3 $2 $4
+    IntCompare(Value, IntComparison, Value, Value),
+    // $1 = ($2...)
+    MakeTuple(Value, Vec<Value>),
+    // $1 = Phi(($2, $3)...): $2 when coming from block $3
+    Phi(Value, Vec<(Value, BasicBlockIndex)>),
     // Return($1)
     Return(Value),
+    // SetLocal($1, $2)
+    SetLocal(usize, Value),
+}
+
+/// Arithmetic on `Int64`s. Overflow wraps around like it does in machine
+/// arithmetic, except that dividing by zero and dividing `i64::MIN` by -1
+/// are errors: the interpreters fail and native code traps.
+#[derive(Clone, Copy, Debug, Hash, PartialEq)]
+pub enum IntOp {
+    Add,
+    Sub,
+    Mul,
+    /// Signed; rounds towards zero.
+    Div,
+    /// Signed; takes the sign of the dividend.
+    Rem,
+}
+
+impl IntOp {
+    /// Returns `None` when the operation is an error.
+    pub fn evaluate(self, lhs: i64, rhs: i64) -> Option<i64> {
+        use IntOp::*;
+        match self {
+            Add => Some(lhs.wrapping_add(rhs)),
+            Sub => Some(lhs.wrapping_sub(rhs)),
+            Mul => Some(lhs.wrapping_mul(rhs)),
+            Div => lhs.checked_div(rhs),
+            Rem => lhs.checked_rem(rhs),
+        }
+    }
+}
+
+/// Signed comparisons of `Int64`s.
+#[derive(Clone, Copy, Debug, Hash, PartialEq)]
+pub enum IntComparison {
+    Equal,
+    NotEqual,
+    LessThan,
+    LessThanOrEqual,
+    GreaterThan,
+    GreaterThanOrEqual,
+}
+
+impl IntComparison {
+    pub fn evaluate(self, lhs: i64, rhs: i64) -> bool {
+        use IntComparison::*;
+        match self {
+            Equal => lhs == rhs,
+            NotEqual => lhs != rhs,
+            LessThan => lhs < rhs,
+            LessThanOrEqual => lhs <= rhs,
+            GreaterThan => lhs > rhs,
+            GreaterThanOrEqual => lhs >= rhs,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::{compile_source, LocalValue, Value};
+    use super::Instruction;
+
+    #[test]
+    fn test_lets_are_ssa_values() {
+        let (_modules, main) = compile_source(
+            "ir-lets",
+            "func main() {\n  let a = 6\n  let b = a * 7\n  b\n}\n",
+        );
+        // No stack slots, and the constants propagate through the lets.
+        assert!(main.get_stack_frame().is_empty());
+        let basic_block_manager = main.borrow_basic_blocks();
+        let basic_blocks = basic_block_manager.basic_blocks.borrow();
+        match basic_blocks[0].instructions.as_slice() {
+            [Instruction::Return(Value::Local(LocalValue::Int64(_, Some(42))))] => (),
+            _ => panic!("Expected main to return a constant"),
+        }
+    }
+
+    #[test]
+    fn test_tuple_members_fold() {
+        let (_modules, main) = compile_source(
+            "ir-tuples",
+            "func main() {\n  let pair = (6, 7)\n  pair.0 * pair.1\n}\n",
+        );
+        // Members of a tuple built in the func are used directly.
+        let basic_block_manager = main.borrow_basic_blocks();
+        let basic_blocks = basic_block_manager.basic_blocks.borrow();
+        assert!(!basic_blocks[0]
+            .instructions
+            .iter()
+            .any(|instruction| match instruction {
+                Instruction::GetTupleMember(_, _, _) => true,
+                _ => false,
+            }));
+    }
+
+    #[test]
+    fn test_var_struct_members_are_read_in_place() {
+        let (_modules, main) = compile_source(
+            "ir-structs",
+            "struct Point { x: Int, y: Int }\nfunc main() {\n  var point = Point(6, 7)\n  point.x * point.y\n}\n",
+        );
+        // Each field is read from the stack slot without loading the struct.
+        let basic_block_manager = main.borrow_basic_blocks();
+        let basic_blocks = basic_block_manager.basic_blocks.borrow();
+        let instructions = &basic_blocks[0].instructions;
+        let count = |predicate: fn(&Instruction) -> bool| {
+            instructions
+                .iter()
+                .filter(|instruction| predicate(instruction))
+                .count()
+        };
+        assert_eq!(
+            count(|instruction| match instruction {
+                Instruction::GetLocalMember(_, _, _) => true,
+                _ => false,
+            }),
+            2
+        );
+        assert_eq!(
+            count(|instruction| match instruction {
+                Instruction::GetLocal(_, _) => true,
+                _ => false,
+            }),
+            0
+        );
+    }
 }
@@ -2,6 +2,7 @@ use std::cell::{Ref, RefCell, RefMut};
 use std::collections::HashMap;
 use std::rc::{Rc, Weak};
 
+use super::super::stats;
 use super::super::type_ast::{self as ast};
 use super::vecs_equal::vecs_equal;
 
@@ -14,7 +15,10 @@ mod value;
 use typ::*;
 use typer::Typer;
 
-pub use compile::{compile_modules, Instruction};
+pub use compile::{
+    compile_modules, BasicBlock, BasicBlockIndex, IncrementalCompiler, Instruction, IntComparison,
+    IntOp,
+};
 pub use error::IrError;
 pub use typ::RealType;
 pub use value::{FuncId, FuncValue, LocalValue, StaticValue, Value, ValueId};
@@ -30,6 +34,10 @@ trait Container {
 
     /// Add an unspecialized func to the container.
     fn define_func(&self, ast_func: ast::Func) -> Func;
+
+    /// Search for a func defined at the root of the module containing
+    /// this container.
+    fn find_static_func(&self, name: &str) -> Option<Func>;
 }
 
 #[derive(Clone)]
@@ -119,6 +127,10 @@ impl Container for Module {
         funcs.push(func.clone());
         func
     }
+
+    fn find_static_func(&self, name: &str) -> Option<Func> {
+        self.find_func_by_name(name)
+    }
 }
 
 /// AbstractType::UnspecializedFunc -> Func -> FuncValue
@@ -205,3 +217,87 @@ impl Func {
         self.0.specializations.borrow()
     }
 }
+
+/// Discover all of the funcs in the modules.
+pub fn collect_all_func_values(modules: &Vec<Module>) -> Vec<FuncValue> {
+    let mut funcs = vec![];
+    for module in modules.iter() {
+        funcs.extend(collect_module_func_values(module));
+    }
+    funcs
+}
+
+/// Compile the source as a program's entry file, for tests. Returns the
+/// modules and the main func. The name keeps the files of different tests
+/// apart.
+#[cfg(test)]
+pub fn compile_source(name: &str, source: &str) -> (Vec<Module>, FuncValue) {
+    use super::super::frontend::Manager;
+    let path = std::env::temp_dir().join(format!("hummingbird-{}-{}.hb", name, std::process::id()));
+    std::fs::write(&path, source).unwrap();
+    let manager = Manager::new();
+    let entry = manager.load(path.clone()).unwrap();
+    let modules = manager.compile_ir(&entry);
+    std::fs::remove_file(path).unwrap();
+    let main = collect_all_func_values(&modules)
+        .into_iter()
+        .find(|func_value| func_value.is_main())
+        .expect("Missing main func");
+    (modules, main)
+}
+
+fn collect_module_func_values(module: &Module) -> Vec<FuncValue> {
+    let mut funcs = vec![];
+    for func in module.borrow_funcs().iter() {
+        funcs.extend(collect_func_func_values(func));
+    }
+    funcs
+}
+
+/// Record how many specializations each func has and how many instructions
+/// each specialization compiled to.
+pub fn record_stats(modules: &Vec<Module>) {
+    for module in modules.iter() {
+        for func in module.borrow_funcs().iter() {
+            record_func_stats(func);
+        }
+    }
+}
+
+fn record_func_stats(func: &Func) {
+    let specializations = func.borrow_specializations();
+    stats::record_specializations(
+        format!("{}_{}", func.0.parent.get_qualified_name(), func.name()),
+        specializations.len(),
+    );
+    for specialization in specializations.iter() {
+        let instructions = specialization
+            .borrow_basic_blocks()
+            .basic_blocks
+            .borrow()
+            .iter()
+            .map(|basic_block| basic_block.instructions.len())
+            .sum();
+        stats::record_ir_instructions(
+            specialization.get_qualified_name().to_string(),
+            instructions,
+        );
+        for inner_func in specialization.borrow_funcs().iter() {
+            record_func_stats(inner_func);
+        }
+    }
+}
+
+fn collect_func_func_values(func: &Func) -> Vec<FuncValue> {
+    let mut funcs = vec![];
+    let specializations = func.borrow_specializations();
+    for specialization in specializations.iter() {
+        funcs.push(specialization.clone());
+        // Recursively collect funcs defined within this specialization.
+        let inner_funcs = specialization.borrow_funcs();
+        for inner_func in inner_funcs.iter() {
+            funcs.extend(collect_func_func_values(inner_func));
+        }
+    }
+    funcs
+}
@@ -1,3 +1,5 @@
+use std::sync::Arc;
+
 use super::super::super::type_ast::{self as ast};
 use super::super::vecs_equal::vecs_equal;
 use super::Func;
@@ -18,6 +20,13 @@ impl Type {
         }
     }
 
+    pub fn is_unit(&self) -> bool {
+        match self {
+            Type::Real(RealType::Tuple(tuple_type)) => tuple_type.members.is_empty(),
+            _ => false,
+        }
+    }
+
     pub fn is_equal(&self, other: &Type) -> bool {
         use Type::*;
         match (self, other) {
@@ -38,12 +47,64 @@ unsafe impl Sync for Type {}
 
 #[derive(Clone, Debug)]
 pub enum RealType {
+    Bool,
     FuncPtr(FuncPtrType),
     Int64,
     Tuple(TupleType),
 }
 
 impl RealType {
+    pub fn is_unit(&self) -> bool {
+        match self {
+            RealType::Tuple(tuple_type) => tuple_type.members.is_empty(),
+            _ => false,
+        }
+    }
+
+    /// Size in bytes when stored in memory. Tuples are laid out like C
+    /// structs: members in order, each one aligned to its own alignment, so
+    /// the unit tuple takes up no space at all.
+    pub fn size(&self) -> usize {
+        use RealType::*;
+        match self {
+            Bool => 1,
+            FuncPtr(_) | Int64 => 8,
+            Tuple(tuple_type) => {
+                let mut size = 0;
+                for member in tuple_type.members.iter() {
+                    size = align_to(size, member.align()) + member.size();
+                }
+                align_to(size, self.align())
+            }
+        }
+    }
+
+    pub fn align(&self) -> usize {
+        use RealType::*;
+        match self {
+            Bool => 1,
+            FuncPtr(_) | Int64 => 8,
+            Tuple(tuple_type) => tuple_type
+                .members
+                .iter()
+                .map(RealType::align)
+                .max()
+                .unwrap_or(1),
+        }
+    }
+
+    /// How many scalars make up the type once tuples are flattened. Backends
+    /// which give every scalar its own register or stack slot use this as the
+    /// width of a value.
+    pub fn scalar_count(&self) -> usize {
+        match self {
+            RealType::Tuple(tuple_type) => {
+                tuple_type.members.iter().map(RealType::scalar_count).sum()
+            }
+            _ => 1,
+        }
+    }
+
     pub fn is_equal(&self, other: &RealType) -> bool {
         use RealType::*;
         match (self, other) {
@@ -60,17 +121,55 @@ impl RealType {
                     .retrn
                     .is_equal(&other_func_ptr_type.retrn)
             }
-            (Int64, Int64) => true,
-            (Tuple(self_tuple_type), Tuple(other_tuple_type)) => vecs_equal(
-                &self_tuple_type.members,
-                &other_tuple_type.members,
-                RealType::is_equal,
-            ),
+            (Bool, Bool) | (Int64, Int64) => true,
+            (Tuple(self_tuple_type), Tuple(other_tuple_type)) => {
+                // A struct is only ever equal to itself.
+                let layouts_match = match (&self_tuple_type.layout, &other_tuple_type.layout) {
+                    (Some(self_layout), Some(other_layout)) => self_layout == other_layout,
+                    (None, None) => true,
+                    _ => false,
+                };
+                layouts_match
+                    && vecs_equal(
+                        &self_tuple_type.members,
+                        &other_tuple_type.members,
+                        RealType::is_equal,
+                    )
+            }
             _ => false,
         }
     }
 }
 
+/// Formats the type the way it's written in the source, eg. `(Int) -> Int`.
+impl std::fmt::Display for RealType {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        use RealType::*;
+        let write_list = |f: &mut std::fmt::Formatter, types: &Vec<RealType>| {
+            write!(f, "(")?;
+            for (index, typ) in types.iter().enumerate() {
+                if index > 0 {
+                    write!(f, ", ")?;
+                }
+                write!(f, "{}", typ)?;
+            }
+            write!(f, ")")
+        };
+        match self {
+            Bool => write!(f, "Bool"),
+            FuncPtr(func_ptr_type) => {
+                write_list(f, &func_ptr_type.parameters)?;
+                write!(f, " -> {}", func_ptr_type.retrn)
+            }
+            Int64 => write!(f, "Int"),
+            Tuple(tuple_type) => match &tuple_type.layout {
+                Some(layout) => write!(f, "{}", layout.name),
+                None => write_list(f, &tuple_type.members),
+            },
+        }
+    }
+}
+
 #[derive(Clone, Debug)]
 pub struct FuncPtrType {
     pub parameters: Vec<RealType>,
@@ -86,9 +185,13 @@ impl FuncPtrType {
     }
 }
 
+/// Structs are tuples too: their fields are the members, in the order
+/// chosen by `layout_struct`.
 #[derive(Clone, Debug)]
 pub struct TupleType {
     pub members: Vec<RealType>,
+    /// Only set for structs.
+    pub layout: Option<Arc<StructLayout>>,
 }
 
 impl TupleType {
@@ -97,10 +200,76 @@ impl TupleType {
     }
 
     pub fn new(members: Vec<RealType>) -> Self {
-        Self { members }
+        Self {
+            members,
+            layout: None,
+        }
+    }
+
+    /// Index of the member for a property: a field name for structs and an
+    /// index (eg. `pair.0`) for plain tuples.
+    pub fn find_member(&self, name: &str) -> Option<usize> {
+        match &self.layout {
+            Some(layout) => layout.fields.iter().position(|field| field == name),
+            None => name
+                .parse::<usize>()
+                .ok()
+                .filter(|index| *index < self.members.len()),
+        }
+    }
+
+    /// Where a member starts in memory, in bytes (see `RealType::size`).
+    pub fn member_offset(&self, index: usize) -> usize {
+        let mut offset = 0;
+        for member in self.members[..index].iter() {
+            offset = align_to(offset, member.align()) + member.size();
+        }
+        align_to(offset, self.members[index].align())
+    }
+
+    /// Where a member starts once the tuple is flattened (see
+    /// `RealType::scalar_count`).
+    pub fn scalar_offset(&self, index: usize) -> usize {
+        self.members[..index]
+            .iter()
+            .map(RealType::scalar_count)
+            .sum()
     }
 }
 
+#[derive(Debug, PartialEq)]
+pub struct StructLayout {
+    /// ID of the struct's class.
+    pub id: ast::TypeId,
+    pub name: String,
+    /// Names of the fields in the order of the members.
+    pub fields: Vec<String>,
+}
+
+/// Lay out a struct's fields (given in declaration order) as the members of
+/// a tuple. Fields are sorted by decreasing alignment, keeping declaration
+/// order between fields with the same alignment. Since every size is a
+/// multiple of its alignment this never needs padding between members, only
+/// at the end to round up to the struct's alignment.
+pub fn layout_struct(id: ast::TypeId, name: &str, fields: Vec<(String, RealType)>) -> TupleType {
+    let mut fields = fields;
+    // `sort_by_key` is stable.
+    fields.sort_by_key(|(_, real_type)| std::cmp::Reverse(real_type.align()));
+    let (names, members): (Vec<_>, Vec<_>) = fields.into_iter().unzip();
+    TupleType {
+        members,
+        layout: Some(Arc::new(StructLayout {
+            id,
+            name: name.to_string(),
+            fields: names,
+        })),
+    }
+}
+
+fn align_to(offset: usize, align: usize) -> usize {
+    (offset + align - 1) / align * align
+}
+
 #[derive(Clone)]
 pub enum AbstractType {
     UnspecializedFunc(Func),
@@ -126,3 +295,25 @@ impl std::fmt::Debug for AbstractType {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::{layout_struct, RealType};
+
+    #[test]
+    fn test_layout_struct_minimizes_padding() {
+        let fields = vec![
+            ("a".to_string(), RealType::Bool),
+            ("b".to_string(), RealType::Int64),
+            ("c".to_string(), RealType::Bool),
+            ("d".to_string(), RealType::Int64),
+        ];
+        let tuple_type = layout_struct(0, "Record", fields);
+        let layout = tuple_type.layout.clone().unwrap();
+        assert_eq!(layout.fields, vec!["b", "d", "a", "c"]);
+        // In declaration order it would take 32 bytes.
+        assert_eq!(RealType::Tuple(tuple_type.clone()).size(), 24);
+        assert_eq!(tuple_type.find_member("a"), Some(2));
+        assert_eq!(tuple_type.find_member("0"), None);
+    }
+}
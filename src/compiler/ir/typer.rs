@@ -4,7 +4,7 @@ use std::rc::Rc;
 use std::sync::Arc;
 
 use super::super::super::type_ast::{self as ast};
-use super::{FuncPtrType, IrError, RealType, TupleType, Type};
+use super::{layout_struct, FuncPtrType, IrError, RealType, TupleType, Type};
 
 /// Used to apply generics and cache AST-type-to-IR-type translations.
 #[derive(Clone)]
@@ -73,6 +73,7 @@ impl Typer {
                     let retrn = self.build_type(&func.retrn.borrow()).into_real();
                     Type::Real(RealType::FuncPtr(FuncPtrType::new(parameters, retrn)))
                 }
+                ast::Type::Object(object) => Type::Real(Self::build_class(&object.class)),
                 other @ _ => unreachable!("Cannot build IR Type from AST Type: {:#?}", other),
             }
         };
@@ -82,6 +83,24 @@ impl Typer {
         typ
     }
 
+    /// Builtins map directly to real types and structs are laid out as
+    /// tuples (see `layout_struct`).
+    fn build_class(class: &ast::Class) -> RealType {
+        match class {
+            ast::Class::Intrinsic(intrinsic) => BuiltinsCache::lookup_intrinsic(intrinsic)
+                .expect(&format!("Builtin not mapped: {}", intrinsic.name))
+                .into_real(),
+            ast::Class::Derived(derived) => {
+                let fields = derived
+                    .fields
+                    .iter()
+                    .map(|field| (field.name.clone(), Self::build_class(&field.class)))
+                    .collect::<Vec<_>>();
+                RealType::Tuple(layout_struct(derived.id, &derived.name, fields))
+            }
+        }
+    }
+
     /// Used when building a func specialization to save the resolution of
     /// possibly-generic parameter types to their appropriate specialization.
     /// Also used by `compile_modules` to add entries for the builtin types.
@@ -103,8 +122,35 @@ impl Typer {
                 return Ok(());
             }
         }
-        let mut types = self.0.types.borrow_mut();
-        types.insert(id, typ);
+        {
+            let mut types = self.0.types.borrow_mut();
+            types.insert(id, typ.clone());
+        }
+        // Tuple members can be generic too, either directly or through the
+        // property constraints (eg. `pair.0` or a struct's `point.x`) of a
+        // generic.
+        if let Type::Real(RealType::Tuple(tuple_type)) = &typ {
+            match ast_type {
+                ast::Type::Tuple(ast_tuple) => {
+                    for (ast_member, member) in ast_tuple.members.iter().zip(&tuple_type.members) {
+                        self.set_type(ast_member, Type::Real(member.clone()))?;
+                    }
+                }
+                ast::Type::Generic(generic) => {
+                    for constraint in generic.borrow().constraints.iter() {
+                        if let ast::GenericConstraint::Property(property) = constraint {
+                            let member = tuple_type
+                                .find_member(&property.name)
+                                .map(|index| &tuple_type.members[index]);
+                            if let Some(member) = member {
+                                self.set_type(&property.typ, Type::Real(member.clone()))?;
+                            }
+                        }
+                    }
+                }
+                _ => (),
+            }
+        }
         Ok(())
     }
 }
@@ -121,6 +167,8 @@ impl BuiltinsCache {
     fn new() -> Self {
         let mut intrinsics = HashMap::new();
 
+        let Bool = ast::Builtins::get("Bool");
+        intrinsics.insert(Bool.id(), Type::Real(RealType::Bool));
         let Int = ast::Builtins::get("Int");
         intrinsics.insert(Int.id(), Type::Real(RealType::Int64));
 
@@ -1,10 +1,12 @@
 use std::cell::{Cell, Ref, RefCell};
+use std::collections::hash_map::DefaultHasher;
 use std::collections::HashMap;
+use std::hash::{Hash, Hasher};
 use std::rc::{Rc, Weak};
 use std::sync::atomic::{AtomicUsize, Ordering};
 
 use super::super::super::type_ast::{self as ast};
-use super::compile::{BasicBlock, BasicBlockManager, Buildable};
+use super::compile::{BasicBlock, BasicBlockManager, Buildable, Instruction};
 use super::typ::{AbstractType, FuncPtrType, RealType, TupleType, Type};
 use super::typer::Typer;
 use super::{Container, Func, InnerFunc};
@@ -37,6 +39,22 @@ impl Value {
         }
     }
 
+    /// The value if it's a constant `Int64`.
+    pub fn const_int64(&self) -> Option<i64> {
+        match self {
+            Value::Local(LocalValue::Int64(_, Some(const_value))) => Some(*const_value as i64),
+            _ => None,
+        }
+    }
+
+    /// The value if it's a constant `Bool`.
+    pub fn const_bool(&self) -> Option<bool> {
+        match self {
+            Value::Local(LocalValue::Bool(_, Some(const_value))) => Some(*const_value),
+            _ => None,
+        }
+    }
+
     pub fn value_id(&self) -> ValueId {
         match self {
             Value::Local(local_value) => local_value.value_id(),
@@ -71,6 +89,7 @@ impl Value {
 
 #[derive(Clone)]
 pub enum LocalValue {
+    Bool(ValueId, Option<bool>),
     FuncPtr(ValueId, FuncPtrType),
     Int64(ValueId, Option<u64>),
     Tuple(ValueId, TupleType),
@@ -79,6 +98,7 @@ pub enum LocalValue {
 impl LocalValue {
     pub fn value_id(&self) -> ValueId {
         match self {
+            LocalValue::Bool(id, _) => id.clone(),
             LocalValue::FuncPtr(id, _) => id.clone(),
             LocalValue::Int64(id, _) => id.clone(),
             LocalValue::Tuple(id, _) => id.clone(),
@@ -87,6 +107,7 @@ impl LocalValue {
 
     pub fn typ(&self) -> Type {
         match self {
+            LocalValue::Bool(_, _) => Type::Real(RealType::Bool),
             LocalValue::FuncPtr(_, func_ptr_type) => {
                 Type::Real(RealType::FuncPtr(func_ptr_type.clone()))
             }
@@ -254,6 +275,182 @@ impl FuncValue {
             basic_blocks.as_ref().unwrap()
         })
     }
+
+    /// Identifies the specialization across separate compilations of the
+    /// same program (unlike its `FuncId`).
+    pub fn signature(&self) -> String {
+        let parameters = self
+            .0
+            .parameters
+            .iter()
+            .map(|(_, typ)| format!("{:?}", typ))
+            .collect::<Vec<_>>();
+        format!(
+            "{}({}) -> {:?}",
+            self.0.qualified_name,
+            parameters.join(", "),
+            self.0.retrn
+        )
+    }
+
+    /// Name for people to read: the func's name in the source and the types
+    /// it was specialized for, eg. `add(Int, Int) -> Int`.
+    pub fn display_name(&self) -> String {
+        let name = match Func::upgrade(&self.0.func) {
+            Some(func) => func.name().to_string(),
+            None => self.0.qualified_name.clone(),
+        };
+        let parameters = self
+            .0
+            .parameters
+            .iter()
+            .map(|(_, typ)| typ.to_string())
+            .collect::<Vec<_>>();
+        format!("{}({}) -> {}", name, parameters.join(", "), self.0.retrn)
+    }
+
+    /// Hash of the compiled body which is the same across separate
+    /// compilations if and only if the func compiled to the same IR. Value
+    /// IDs are numbered in the order they're defined and funcs are
+    /// identified by their `signature`.
+    pub fn fingerprint(&self) -> u64 {
+        let mut hasher = DefaultHasher::new();
+        self.signature().hash(&mut hasher);
+        for (name, typ) in self.0.stack_frame.iter() {
+            (name, format!("{:?}", typ)).hash(&mut hasher);
+        }
+
+        let mut value_ids = HashMap::new();
+        let mut hash_value = |value: &Value, hasher: &mut DefaultHasher| match value {
+            Value::Local(LocalValue::Int64(_, Some(const_value))) => {
+                ("const", const_value).hash(hasher)
+            }
+            Value::Local(LocalValue::Bool(_, Some(const_value))) => {
+                ("const_bool", const_value).hash(hasher)
+            }
+            Value::Local(local_value) => {
+                let next = value_ids.len();
+                let id = *value_ids.entry(local_value.value_id()).or_insert(next);
+                ("local", id, format!("{:?}", local_value.typ())).hash(hasher)
+            }
+            Value::Static(StaticValue::Func(func_value)) => {
+                ("static", func_value.signature()).hash(hasher)
+            }
+            Value::Abstract(_) => unreachable!("Cannot fingerprint an Abstract value"),
+        };
+        let basic_block_manager = self.borrow_basic_blocks();
+        for basic_block in basic_block_manager.basic_blocks.borrow().iter() {
+            basic_block.name.hash(&mut hasher);
+            for instruction in basic_block.instructions.iter() {
+                use Instruction::*;
+                match instruction {
+                    CallFunc(retrn, callee, arguments) => {
+                        ("call", callee.signature()).hash(&mut hasher);
+                        hash_value(retrn, &mut hasher);
+                        for argument in arguments.iter() {
+                            hash_value(argument, &mut hasher);
+                        }
+                    }
+                    Branch(target) => ("branch", target.get()).hash(&mut hasher),
+                    CallFuncPtr(retrn, target, arguments) => {
+                        "call_ptr".hash(&mut hasher);
+                        hash_value(retrn, &mut hasher);
+                        hash_value(&Value::Local(target.clone()), &mut hasher);
+                        for argument in arguments.iter() {
+                            hash_value(argument, &mut hasher);
+                        }
+                    }
+                    CondBranch(condition, then, els) => {
+                        ("cond_branch", then.get(), els.get()).hash(&mut hasher);
+                        hash_value(condition, &mut hasher);
+                    }
+                    GetLocal(value, index) => {
+                        ("get_local", index).hash(&mut hasher);
+                        hash_value(value, &mut hasher);
+                    }
+                    GetLocalMember(value, index, member) => {
+                        ("get_local_member", index, member).hash(&mut hasher);
+                        hash_value(value, &mut hasher);
+                    }
+                    GetTupleMember(member, tuple, index) => {
+                        ("get_tuple_member", index).hash(&mut hasher);
+                        hash_value(member, &mut hasher);
+                        hash_value(tuple, &mut hasher);
+                    }
+                    IntArithmetic(retrn, op, lhs, rhs) => {
+                        ("int_arithmetic", op).hash(&mut hasher);
+                        hash_value(retrn, &mut hasher);
+                        hash_value(lhs, &mut hasher);
+                        hash_value(rhs, &mut hasher);
+                    }
+                    IntCompare(retrn, comparison, lhs, rhs) => {
+                        ("int_compare", comparison).hash(&mut hasher);
+                        hash_value(retrn, &mut hasher);
+                        hash_value(lhs, &mut hasher);
+                        hash_value(rhs, &mut hasher);
+                    }
+                    MakeTuple(tuple, members) => {
+                        "make_tuple".hash(&mut hasher);
+                        hash_value(tuple, &mut hasher);
+                        for member in members.iter() {
+                            hash_value(member, &mut hasher);
+                        }
+                    }
+                    Phi(retrn, incoming) => {
+                        "phi".hash(&mut hasher);
+                        hash_value(retrn, &mut hasher);
+                        for (value, predecessor) in incoming.iter() {
+                            hash_value(value, &mut hasher);
+                            predecessor.get().hash(&mut hasher);
+                        }
+                    }
+                    Return(value) => {
+                        "return".hash(&mut hasher);
+                        hash_value(value, &mut hasher);
+                    }
+                    SetLocal(index, value) => {
+                        ("set_local", index).hash(&mut hasher);
+                        hash_value(value, &mut hasher);
+                    }
+                }
+            }
+        }
+        hasher.finish()
+    }
+
+    /// Funcs that this func calls directly or references as a static value.
+    pub fn referenced_funcs(&self) -> Vec<FuncValue> {
+        let mut funcs = vec![];
+        let basic_block_manager = self.borrow_basic_blocks();
+        for basic_block in basic_block_manager.basic_blocks.borrow().iter() {
+            for instruction in basic_block.instructions.iter() {
+                use Instruction::*;
+                let values = match instruction {
+                    CallFunc(_, callee, arguments) => {
+                        funcs.push(callee.clone());
+                        arguments.iter().collect::<Vec<_>>()
+                    }
+                    CallFuncPtr(_, _, arguments) => arguments.iter().collect(),
+                    Branch(_)
+                    | CondBranch(_, _, _)
+                    | GetLocal(_, _)
+                    | GetLocalMember(_, _, _)
+                    | GetTupleMember(_, _, _)
+                    | IntArithmetic(_, _, _, _)
+                    | IntCompare(_, _, _, _) => vec![],
+                    MakeTuple(_, members) => members.iter().collect(),
+                    Phi(_, incoming) => incoming.iter().map(|(value, _)| value).collect(),
+                    Return(value) | SetLocal(_, value) => vec![value],
+                };
+                for value in values {
+                    if let Value::Static(StaticValue::Func(func_value)) = value {
+                        funcs.push(func_value.clone());
+                    }
+                }
+            }
+        }
+        funcs
+    }
 }
 
 impl Buildable for FuncValue {
@@ -297,4 +494,9 @@ impl Container for FuncValue {
         funcs.push(func.clone());
         func
     }
+
+    fn find_static_func(&self, name: &str) -> Option<Func> {
+        let func = Func::upgrade(&self.0.func).unwrap();
+        func.0.parent.find_static_func(name)
+    }
 }
@@ -1,12 +1,162 @@
+pub mod baseline;
+pub mod bytecode;
+pub mod interpreter;
 pub mod ir;
 mod opaque;
 mod path_to_name;
+pub mod profile;
 pub mod target;
 mod vecs_equal;
 
+use std::fmt::{self, Display, Formatter};
+use std::io;
+use std::path::Path;
+use std::process::Command;
+use std::sync::Arc;
+
+use super::timings;
 use ir::IrError;
+use profile::Profile;
 
 enum CompileError {
     /// Error occurring during the IR sub-stage.
     Ir(IrError),
 }
+
+/// The different ways that the `run` command can execute a program.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Engine {
+    /// Build with LLVM and execute in-process with its JIT.
+    Jit,
+    /// Execute the IR directly without LLVM.
+    Interpreter,
+    /// Lower the IR to bytecode and execute that with the register VM.
+    Vm,
+    /// Start out interpreting the IR and compile funcs with the JIT once
+    /// they get hot.
+    Tiered,
+    /// Execute with the JIT and recompile funcs whose source changes while
+    /// the program is running.
+    HotReload,
+}
+
+/// What generates machine code for compiled executables.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Backend {
+    Llvm,
+    /// Emit x86-64 directly without optimizing (see `baseline`).
+    Baseline,
+}
+
+/// Extra code generated into executables to measure them as they run.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Instrument {
+    /// Count the calls to and cycles spent in every func (see
+    /// `target::instrument`).
+    Functions,
+    /// Count the entries to every func and write them out as a `Profile`.
+    Profile,
+}
+
+/// Options which change the code generated for a program. Everything in
+/// here has to be part of the `fingerprint` since it's used to key the
+/// build cache.
+#[derive(Clone, Debug)]
+pub struct CodegenOptions {
+    /// 0 through 3, same as `-O` in Clang.
+    pub opt_level: u8,
+    pub backend: Backend,
+    pub instrument: Option<Instrument>,
+    /// Profile from an instrumented build to optimize with.
+    pub profile: Option<Arc<Profile>>,
+}
+
+impl CodegenOptions {
+    pub fn fingerprint(&self) -> String {
+        format!(
+            "opt-level={} backend={:?} instrument={:?} profile={:?}",
+            self.opt_level,
+            self.backend,
+            self.instrument,
+            self.profile.as_ref().map(|profile| profile.fingerprint()),
+        )
+    }
+}
+
+impl Default for CodegenOptions {
+    fn default() -> Self {
+        Self {
+            opt_level: 0,
+            backend: Backend::Llvm,
+            instrument: None,
+            profile: None,
+        }
+    }
+}
+
+/// How many instructions compile-time evaluation may execute for each call.
+const CONST_EVAL_BUDGET: usize = 100_000;
+
+/// Run the IR optimizations enabled by the options. This happens before the
+/// IR is handed to any of the engines or backends.
+pub fn optimize_ir(modules: &Vec<ir::Module>, options: &CodegenOptions) {
+    if options.opt_level >= 1 {
+        timings::time("ir-optimize", None, || {
+            interpreter::fold_constant_calls(modules, CONST_EVAL_BUDGET)
+        });
+    }
+}
+
+#[derive(Debug)]
+pub enum LinkError {
+    /// The linker couldn't be started at all.
+    Spawn { linker: String, error: io::Error },
+    /// The linker ran but failed; includes whatever it printed.
+    Failed { linker: String, stderr: String },
+}
+
+impl Display for LinkError {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        use LinkError::*;
+        match self {
+            Spawn { linker, error } => write!(f, "Cannot run linker {}: {}", linker, error),
+            Failed { linker, stderr } => write!(f, "Linker {} failed:\n{}", linker, stderr),
+        }
+    }
+}
+
+/// The command that links executables: clang unless another C compiler is
+/// given in `CC`. Like make, `CC` is split on whitespace so that it can
+/// include a wrapper or flags (eg. `ccache cc` or `clang -fuse-ld=lld`).
+pub fn linker() -> Vec<String> {
+    match std::env::var("CC") {
+        Ok(cc) if !cc.trim().is_empty() => cc.split_whitespace().map(str::to_string).collect(),
+        _ => vec!["clang".to_string()],
+    }
+}
+
+/// Link object files (and any C sources to go with them) into an
+/// executable with the `linker`.
+pub fn link_executable(inputs: &[&Path], executable: &Path) -> Result<(), LinkError> {
+    let command = linker();
+    let linker = command.join(" ");
+    let output = timings::time("link", None, || {
+        Command::new(&command[0])
+            .args(&command[1..])
+            .args(inputs)
+            .arg("-o")
+            .arg(executable)
+            .output()
+    })
+    .map_err(|error| LinkError::Spawn {
+        linker: linker.clone(),
+        error,
+    })?;
+    if !output.status.success() {
+        return Err(LinkError::Failed {
+            linker,
+            stderr: String::from_utf8_lossy(&output.stderr).into_owned(),
+        });
+    }
+    Ok(())
+}
@@ -0,0 +1,210 @@
+/// Profiles for profile-guided optimization. Executables built with
+/// `--profile-generate` count how many times each func was entered and which
+/// way each of its conditional branches went, and write the counts out when
+/// they exit (see `target::instrument`); building again with `--profile-use`
+/// reads them back to decide which funcs are hot and which are cold, and to
+/// give LLVM entry counts and branch weights.
+///
+/// The format is a header line followed by one line per func with its entry
+/// count and `FuncValue::signature` separated by a tab, and one line per
+/// conditional branch: `b`, the branch's index among the func's conditional
+/// branches in IR order, how many times it went to the then and the else
+/// block, and the signature, all separated by tabs. Signatures are the same
+/// across compilations of the same program, so the profile still applies
+/// after unrelated funcs change.
+use std::collections::hash_map::DefaultHasher;
+use std::collections::HashMap;
+use std::fs;
+use std::hash::{Hash, Hasher};
+use std::io;
+use std::path::Path;
+
+pub const HEADER: &str = "# hummingbird profile v2";
+
+/// The hottest funcs which together account for this fraction of all entries
+/// are hot.
+const HOT_CUTOFF: f64 = 0.99;
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Temperature {
+    Hot,
+    /// Never entered while profiling.
+    Cold,
+    /// Neither, or not in the profile at all (eg. a func that was added
+    /// since).
+    Neutral,
+}
+
+/// How many times a conditional branch went each way.
+#[derive(Clone, Copy, Debug, Default, Hash, PartialEq, Eq, PartialOrd, Ord)]
+pub struct BranchCounts {
+    pub then: u64,
+    pub els: u64,
+}
+
+#[derive(Debug)]
+pub struct Profile {
+    entry_counts: HashMap<String, u64>,
+    /// Indexed by the branch's position in the func.
+    branch_counts: HashMap<String, Vec<BranchCounts>>,
+    /// Funcs entered at least this many times are hot.
+    hot_threshold: u64,
+}
+
+impl Profile {
+    pub fn read(path: &Path) -> io::Result<Self> {
+        let contents = fs::read_to_string(path)?;
+        Self::parse(&contents)
+            .map_err(|message| io::Error::new(io::ErrorKind::InvalidData, message))
+    }
+
+    pub fn parse(contents: &str) -> Result<Self, String> {
+        let mut lines = contents.lines();
+        if lines.next() != Some(HEADER) {
+            return Err("Not a profile (missing header)".to_string());
+        }
+        let mut entry_counts = HashMap::new();
+        let mut branch_counts = HashMap::new();
+        for (index, line) in lines.enumerate() {
+            let invalid = || format!("Invalid profile line {}: {}", index + 2, line);
+            // The same func or branch can appear more than once if profiles
+            // were concatenated.
+            if line.starts_with("b\t") {
+                let parts = line.splitn(5, '\t').skip(1).collect::<Vec<_>>();
+                let numbers = parts
+                    .iter()
+                    .take(3)
+                    .map(|part| part.parse::<u64>().ok())
+                    .collect::<Option<Vec<_>>>();
+                match (numbers.as_ref().map(Vec::as_slice), parts.get(3)) {
+                    (Some(&[branch, then, els]), Some(signature)) => {
+                        let branches = branch_counts
+                            .entry(signature.to_string())
+                            .or_insert_with(Vec::new);
+                        let branch = branch as usize;
+                        if branches.len() <= branch {
+                            branches.resize(branch + 1, BranchCounts::default());
+                        }
+                        branches[branch].then += then;
+                        branches[branch].els += els;
+                    }
+                    _ => return Err(invalid()),
+                }
+                continue;
+            }
+            let mut parts = line.splitn(2, '\t');
+            let count = parts.next().and_then(|count| count.parse::<u64>().ok());
+            match (count, parts.next()) {
+                (Some(count), Some(signature)) => {
+                    *entry_counts.entry(signature.to_string()).or_insert(0) += count
+                }
+                _ => return Err(invalid()),
+            }
+        }
+        let hot_threshold = Self::hot_threshold(&entry_counts);
+        Ok(Self {
+            entry_counts,
+            branch_counts,
+            hot_threshold,
+        })
+    }
+
+    fn hot_threshold(entry_counts: &HashMap<String, u64>) -> u64 {
+        let mut counts = entry_counts.values().cloned().collect::<Vec<_>>();
+        counts.sort_by(|a, b| b.cmp(a));
+        let total = counts.iter().sum::<u64>();
+        let mut covered = 0;
+        for count in counts {
+            covered += count;
+            if covered as f64 >= total as f64 * HOT_CUTOFF {
+                return count.max(1);
+            }
+        }
+        1
+    }
+
+    pub fn entry_count(&self, signature: &str) -> Option<u64> {
+        self.entry_counts.get(signature).cloned()
+    }
+
+    /// Counts for the func's conditional branches in IR order. Branches past
+    /// the end weren't in the profile.
+    pub fn branch_counts(&self, signature: &str) -> &[BranchCounts] {
+        self.branch_counts
+            .get(signature)
+            .map(Vec::as_slice)
+            .unwrap_or(&[])
+    }
+
+    pub fn temperature(&self, signature: &str) -> Temperature {
+        match self.entry_count(signature) {
+            Some(0) => Temperature::Cold,
+            Some(count) if count >= self.hot_threshold => Temperature::Hot,
+            _ => Temperature::Neutral,
+        }
+    }
+
+    /// Identifies the profile's contents for `CodegenOptions::fingerprint`.
+    pub fn fingerprint(&self) -> u64 {
+        let mut entries = self.entry_counts.iter().collect::<Vec<_>>();
+        entries.sort();
+        let mut branches = self.branch_counts.iter().collect::<Vec<_>>();
+        branches.sort();
+        let mut hasher = DefaultHasher::new();
+        entries.hash(&mut hasher);
+        branches.hash(&mut hasher);
+        hasher.finish()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{BranchCounts, Profile, Temperature, HEADER};
+
+    #[test]
+    fn test_temperatures() {
+        let contents = format!(
+            "{}\n100000\tmain_fib0(Int64) -> Int64\n1\tmain_main0() -> Int64\n0\tmain_unused0() -> Int64\n",
+            HEADER
+        );
+        let profile = Profile::parse(&contents).unwrap();
+        assert_eq!(
+            profile.temperature("main_fib0(Int64) -> Int64"),
+            Temperature::Hot
+        );
+        assert_eq!(
+            profile.temperature("main_main0() -> Int64"),
+            Temperature::Neutral
+        );
+        assert_eq!(
+            profile.temperature("main_unused0() -> Int64"),
+            Temperature::Cold
+        );
+        assert_eq!(
+            profile.temperature("main_added0() -> Int64"),
+            Temperature::Neutral
+        );
+
+        assert!(Profile::parse("100\tmain_fib0(Int64) -> Int64\n").is_err());
+        assert!(Profile::parse(&format!("{}\nmain_fib0\n", HEADER)).is_err());
+    }
+
+    #[test]
+    fn test_branch_counts() {
+        let signature = "main_fib0(Int64) -> Int64";
+        let contents = format!(
+            "{header}\n10\t{sig}\nb\t1\t3\t7\t{sig}\nb\t1\t1\t0\t{sig}\n",
+            header = HEADER,
+            sig = signature
+        );
+        let profile = Profile::parse(&contents).unwrap();
+        assert_eq!(
+            profile.branch_counts(signature),
+            &[BranchCounts::default(), BranchCounts { then: 4, els: 7 }]
+        );
+        assert!(profile.branch_counts("main_main0() -> Int64").is_empty());
+
+        let invalid = format!("{}\nb\t0\t1\t{}\n", HEADER, signature);
+        assert!(Profile::parse(&invalid).is_err());
+    }
+}
@@ -0,0 +1,61 @@
+/* Runtime linked into executables built with `--instrument=functions`.
+ * When the program exits it writes how many times each function was called
+ * and the cycles spent in it, most cycles first, to the file named by
+ * `HUMMINGBIRD_INSTRUMENT_OUT` (or `instrument.txt`). The counters are
+ * defined by the generated code; see `instrument.rs`. */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern const int64_t __hb_instrument_count;
+extern const char *const __hb_instrument_names[];
+extern const uint64_t __hb_instrument_calls[];
+extern const uint64_t __hb_instrument_cycles[];
+
+static int compare_cycles(const void *a, const void *b) {
+  uint64_t left = __hb_instrument_cycles[*(const int64_t *)a];
+  uint64_t right = __hb_instrument_cycles[*(const int64_t *)b];
+  return left < right ? 1 : left > right ? -1 : 0;
+}
+
+__attribute__((destructor)) static void write_report(void) {
+  const char *path = getenv("HUMMINGBIRD_INSTRUMENT_OUT");
+  if (!path) {
+    path = "instrument.txt";
+  }
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return;
+  }
+
+  int64_t count = __hb_instrument_count;
+  int64_t *order = malloc(count * sizeof(int64_t));
+  /* Cycles include callees, so the function with the most (usually main)
+   * covers the whole run. */
+  uint64_t most_cycles = 0;
+  for (int64_t index = 0; index < count; index++) {
+    order[index] = index;
+    if (__hb_instrument_cycles[index] > most_cycles) {
+      most_cycles = __hb_instrument_cycles[index];
+    }
+  }
+  qsort(order, count, sizeof(int64_t), compare_cycles);
+
+  fprintf(out, "%12s %16s %12s %7s  %s\n", "Calls", "Cycles", "Cycles/call", "%",
+          "Function");
+  for (int64_t position = 0; position < count; position++) {
+    int64_t index = order[position];
+    uint64_t calls = __hb_instrument_calls[index];
+    uint64_t cycles = __hb_instrument_cycles[index];
+    if (calls == 0) {
+      continue;
+    }
+    fprintf(out, "%12" PRIu64 " %16" PRIu64 " %12" PRIu64 " %6.2f%%  %s\n", calls, cycles,
+            cycles / calls, most_cycles ? cycles * 100.0 / most_cycles : 0.0,
+            __hb_instrument_names[index]);
+  }
+  free(order);
+  fclose(out);
+}
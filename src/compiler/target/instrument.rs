@@ -0,0 +1,286 @@
+/// Instrumentation for `--instrument=functions` and `--profile-generate`:
+/// every emitted function counts its calls into global arrays indexed by the
+/// order the functions were built in. A runtime linked into the executable
+/// (`instrument.c` or `profile.c`) writes out the counters when it exits.
+///
+/// For `--profile-generate` every conditional branch also counts which way
+/// it went, two counters per branch in the order they were built.
+///
+/// For `--instrument=functions` they also accumulate the cycles spent in
+/// them (callees included), read with `llvm.readcyclecounter`, which is
+/// `rdtsc` on x86. Only the outermost call of a recursive function adds to
+/// its cycles so that time isn't counted more than once.
+use inkwell::builder::Builder;
+use inkwell::context::Context;
+use inkwell::module::Module as InkModule;
+use inkwell::values::{FunctionValue, GlobalValue, IntValue, PointerValue};
+use inkwell::{AddressSpace, IntPredicate};
+
+use super::super::ir::{FuncValue, Instruction};
+use super::super::Instrument;
+
+/// Source of the runtime; it's compiled and linked along with the object.
+pub fn runtime(instrument: Instrument) -> &'static str {
+    match instrument {
+        Instrument::Functions => include_str!("instrument.c"),
+        Instrument::Profile => include_str!("profile.c"),
+    }
+}
+
+pub struct Instrumentation<'ctx> {
+    ctx: &'ctx Context,
+    instrument: Instrument,
+    calls: GlobalValue<'ctx>,
+    /// How many calls of each function are currently on the stack.
+    depths: GlobalValue<'ctx>,
+    cycles: GlobalValue<'ctx>,
+    names: GlobalValue<'ctx>,
+    name_pointers: Vec<PointerValue<'ctx>>,
+    /// Taken and not taken counts of each conditional branch.
+    branches: GlobalValue<'ctx>,
+    /// Index of the function each branch is in.
+    branch_funcs: GlobalValue<'ctx>,
+    branch_func_indices: Vec<u64>,
+    read_cycle_counter: FunctionValue<'ctx>,
+}
+
+/// Instrumentation state for the function currently being built.
+pub struct Frame<'ctx> {
+    index: IntValue<'ctx>,
+    /// Cycle counter on entry if cycles are being counted.
+    start: Option<IntValue<'ctx>>,
+    /// Index of the next conditional branch.
+    branch: usize,
+}
+
+/// Number of conditional branches in the func, which is how many
+/// `build_branch` will be called for.
+fn count_branches(func: &FuncValue) -> usize {
+    func.borrow_basic_blocks()
+        .basic_blocks
+        .borrow()
+        .iter()
+        .flat_map(|basic_block| basic_block.instructions.iter())
+        .filter(|instruction| match instruction {
+            Instruction::CondBranch(..) => true,
+            _ => false,
+        })
+        .count()
+}
+
+impl<'ctx> Instrumentation<'ctx> {
+    /// Define the globals for the functions that will be built into the
+    /// module.
+    pub fn new(
+        ctx: &'ctx Context,
+        module: &InkModule<'ctx>,
+        funcs: &Vec<FuncValue>,
+        instrument: Instrument,
+    ) -> Self {
+        let functions = funcs.len();
+        let branch_count = match instrument {
+            Instrument::Functions => 0,
+            Instrument::Profile => funcs.iter().map(count_branches).sum(),
+        };
+        let i64_type = ctx.i64_type();
+        let counters_type = i64_type.array_type(functions as u32);
+        let add_counters = |name: &str| {
+            let global = module.add_global(counters_type, None, name);
+            global.set_initializer(&counters_type.const_zero());
+            global
+        };
+        let calls = add_counters("__hb_instrument_calls");
+        let depths = add_counters("__hb_instrument_depths");
+        let cycles = add_counters("__hb_instrument_cycles");
+
+        let count = module.add_global(i64_type, None, "__hb_instrument_count");
+        count.set_initializer(&i64_type.const_int(functions as u64, false));
+        count.set_constant(true);
+        // Not constant since it's full of pointers which need relocating.
+        let name_type = ctx.i8_type().ptr_type(AddressSpace::Generic);
+        let names = module.add_global(
+            name_type.array_type(functions as u32),
+            None,
+            "__hb_instrument_names",
+        );
+
+        let branches_type = i64_type.array_type(branch_count as u32 * 2);
+        let branches = module.add_global(branches_type, None, "__hb_instrument_branches");
+        branches.set_initializer(&branches_type.const_zero());
+        let branch_funcs = module.add_global(
+            i64_type.array_type(branch_count as u32),
+            None,
+            "__hb_instrument_branch_funcs",
+        );
+        branch_funcs.set_constant(true);
+        let count = module.add_global(i64_type, None, "__hb_instrument_branch_count");
+        count.set_initializer(&i64_type.const_int(branch_count as u64, false));
+        count.set_constant(true);
+
+        let read_cycle_counter =
+            module.add_function("llvm.readcyclecounter", i64_type.fn_type(&[], false), None);
+
+        Self {
+            ctx,
+            instrument,
+            calls,
+            depths,
+            cycles,
+            names,
+            name_pointers: vec![],
+            branches,
+            branch_funcs,
+            branch_func_indices: vec![],
+            read_cycle_counter,
+        }
+    }
+
+    /// Build the start of the function's instrumentation. The functions
+    /// must be built in the same order as their indices.
+    pub fn build_entry(
+        &mut self,
+        builder: &Builder<'ctx>,
+        index: usize,
+        func: &FuncValue,
+    ) -> Frame<'ctx> {
+        assert_eq!(
+            index,
+            self.name_pointers.len(),
+            "Functions built out of order"
+        );
+        // Profiles need names that are the same across compilations.
+        let name = match self.instrument {
+            Instrument::Functions => func.display_name(),
+            Instrument::Profile => func.signature(),
+        };
+        let name = builder.build_global_string_ptr(&name, "");
+        self.name_pointers.push(name.as_pointer_value());
+        let branch = self.branch_func_indices.len();
+        if self.instrument == Instrument::Profile {
+            self.branch_func_indices
+                .extend((0..count_branches(func)).map(|_| index as u64));
+        }
+
+        let index = self.ctx.i64_type().const_int(index as u64, false);
+        let one = self.ctx.i64_type().const_int(1, false);
+        let calls = self.build_counter(builder, self.calls, index);
+        let incremented = builder.build_int_add(self.build_load(builder, calls), one, "");
+        builder.build_store(calls, incremented);
+        if self.instrument != Instrument::Functions {
+            return Frame {
+                index,
+                start: None,
+                branch,
+            };
+        }
+        let depth = self.build_counter(builder, self.depths, index);
+        let incremented = builder.build_int_add(self.build_load(builder, depth), one, "");
+        builder.build_store(depth, incremented);
+
+        let start = self.build_read_cycle_counter(builder);
+        Frame {
+            index,
+            start: Some(start),
+            branch,
+        }
+    }
+
+    /// Count which way the function's next conditional branch goes, right
+    /// before it's built.
+    pub fn build_branch(
+        &self,
+        builder: &Builder<'ctx>,
+        frame: &mut Frame<'ctx>,
+        condition: IntValue<'ctx>,
+    ) {
+        if self.instrument != Instrument::Profile {
+            return;
+        }
+        let i64_type = self.ctx.i64_type();
+        let taken = i64_type.const_int(frame.branch as u64 * 2, false);
+        let not_taken = i64_type.const_int(frame.branch as u64 * 2 + 1, false);
+        frame.branch += 1;
+        let index = builder
+            .build_select(condition, taken, not_taken, "")
+            .into_int_value();
+        let counter = self.build_counter(builder, self.branches, index);
+        let incremented = builder.build_int_add(
+            self.build_load(builder, counter),
+            i64_type.const_int(1, false),
+            "",
+        );
+        builder.build_store(counter, incremented);
+    }
+
+    /// Build the end of the function's instrumentation right before it
+    /// returns.
+    pub fn build_exit(&self, builder: &Builder<'ctx>, frame: &Frame<'ctx>) {
+        let start = match frame.start {
+            Some(start) => start,
+            None => return,
+        };
+        let end = self.build_read_cycle_counter(builder);
+        let i64_type = self.ctx.i64_type();
+        let depth = self.build_counter(builder, self.depths, frame.index);
+        let decremented = builder.build_int_sub(
+            self.build_load(builder, depth),
+            i64_type.const_int(1, false),
+            "",
+        );
+        builder.build_store(depth, decremented);
+
+        // Recursive calls are already covered by the outermost one.
+        let outermost =
+            builder.build_int_compare(IntPredicate::EQ, decremented, i64_type.const_zero(), "");
+        let elapsed = builder
+            .build_select(
+                outermost,
+                builder.build_int_sub(end, start, ""),
+                i64_type.const_zero(),
+                "",
+            )
+            .into_int_value();
+        let cycles = self.build_counter(builder, self.cycles, frame.index);
+        let accumulated = builder.build_int_add(self.build_load(builder, cycles), elapsed, "");
+        builder.build_store(cycles, accumulated);
+    }
+
+    /// Fill in the names and branches' functions once every function has
+    /// been built.
+    pub fn finish(self) {
+        let name_type = self.ctx.i8_type().ptr_type(AddressSpace::Generic);
+        self.names
+            .set_initializer(&name_type.const_array(self.name_pointers.as_slice()));
+        let i64_type = self.ctx.i64_type();
+        let branch_funcs = self
+            .branch_func_indices
+            .iter()
+            .map(|index| i64_type.const_int(*index, false))
+            .collect::<Vec<_>>();
+        self.branch_funcs
+            .set_initializer(&i64_type.const_array(branch_funcs.as_slice()));
+    }
+
+    fn build_counter(
+        &self,
+        builder: &Builder<'ctx>,
+        counters: GlobalValue<'ctx>,
+        index: IntValue<'ctx>,
+    ) -> PointerValue<'ctx> {
+        let zero = self.ctx.i64_type().const_zero();
+        unsafe { builder.build_in_bounds_gep(counters.as_pointer_value(), &[zero, index], "") }
+    }
+
+    fn build_load(&self, builder: &Builder<'ctx>, pointer: PointerValue<'ctx>) -> IntValue<'ctx> {
+        builder.build_load(pointer, "").into_int_value()
+    }
+
+    fn build_read_cycle_counter(&self, builder: &Builder<'ctx>) -> IntValue<'ctx> {
+        builder
+            .build_call(self.read_cycle_counter, &[], "")
+            .try_as_basic_value()
+            .left()
+            .unwrap()
+            .into_int_value()
+    }
+}
@@ -0,0 +1,155 @@
+/// Tells profilers and debuggers about the functions emitted by the JIT,
+/// named by their source name and specialization (see
+/// `FuncValue::display_name`); otherwise all they see is anonymous memory.
+///
+///   - With `--perf-map` every function is appended to
+///     `/tmp/perf-<pid>.map`, which `perf report` reads for JIT-ed code.
+///   - Every batch of functions is registered through GDB's JIT interface
+///     as an in-memory ELF object with just a symbol table.
+///
+/// MCJIT doesn't say how big the functions it emitted are, so each module
+/// ends with an empty marker function (see `add_end_marker`) and the size
+/// of each function is the distance to the next one.
+use std::fs::{File, OpenOptions};
+use std::io::Write;
+use std::ptr;
+use std::sync::Mutex;
+
+use super::super::baseline::elf::{write_symbol_file, Symbol};
+
+lazy_static! {
+    static ref PERF_MAP: Mutex<Option<File>> = Mutex::new(None);
+    /// Serializes registrations with GDB.
+    static ref GDB_LOCK: Mutex<()> = Mutex::new(());
+}
+
+/// Start writing the perf map for this process.
+pub fn enable_perf_map() {
+    let path = format!("/tmp/perf-{}.map", std::process::id());
+    match OpenOptions::new().create(true).append(true).open(&path) {
+        Ok(file) => *PERF_MAP.lock().unwrap() = Some(file),
+        Err(err) => eprintln!("Cannot open perf map {}: {}", path, err),
+    }
+}
+
+/// Register the (name, address) of every function emitted in a module. The
+/// end is the address of the module's end marker.
+pub fn register(functions: Vec<(String, usize)>, end: usize) {
+    let functions = with_sizes(functions, end);
+    if functions.is_empty() {
+        return;
+    }
+    write_perf_map(&functions);
+    register_with_gdb(&functions, end);
+}
+
+/// Returns (name, address, size) sorted by address.
+fn with_sizes(mut functions: Vec<(String, usize)>, end: usize) -> Vec<(String, usize, usize)> {
+    functions.sort_by_key(|(_, address)| *address);
+    let nexts = functions
+        .iter()
+        .skip(1)
+        .map(|(_, address)| *address)
+        .chain(std::iter::once(end))
+        .collect::<Vec<_>>();
+    functions
+        .into_iter()
+        .zip(nexts)
+        .map(|((name, address), next)| (name, address, next.saturating_sub(address)))
+        .collect()
+}
+
+fn write_perf_map(functions: &Vec<(String, usize, usize)>) {
+    let mut perf_map = PERF_MAP.lock().unwrap();
+    let file = match perf_map.as_mut() {
+        Some(file) => file,
+        None => return,
+    };
+    let mut lines = String::new();
+    for (name, address, size) in functions.iter() {
+        lines.push_str(&format!("{:x} {:x} {}\n", address, size, name));
+    }
+    if let Err(err) = file.write_all(lines.as_bytes()) {
+        eprintln!("Cannot write to perf map: {}", err);
+        *perf_map = None;
+    }
+}
+
+// The GDB JIT interface: GDB sets a breakpoint in `__jit_debug_register_code`
+// and reads the new entry from `__jit_debug_descriptor` when it's hit. Both
+// are defined by LLVM's ExecutionEngine library.
+#[repr(C)]
+struct JitCodeEntry {
+    next_entry: *mut JitCodeEntry,
+    prev_entry: *mut JitCodeEntry,
+    symfile_addr: *const u8,
+    symfile_size: u64,
+}
+
+#[repr(C)]
+struct JitDescriptor {
+    version: u32,
+    action_flag: u32,
+    relevant_entry: *mut JitCodeEntry,
+    first_entry: *mut JitCodeEntry,
+}
+
+const JIT_REGISTER_FN: u32 = 1;
+
+extern "C" {
+    static mut __jit_debug_descriptor: JitDescriptor;
+    fn __jit_debug_register_code();
+}
+
+fn register_with_gdb(functions: &Vec<(String, usize, usize)>, end: usize) {
+    let start = functions[0].1;
+    let symbols = functions
+        .iter()
+        .map(|(name, address, size)| Symbol {
+            name: name.clone(),
+            offset: address - start,
+            size: *size,
+            global: true,
+        })
+        .collect::<Vec<_>>();
+    // The code lives for the rest of the process and so does its entry.
+    let symbol_file: &'static [u8] =
+        Box::leak(write_symbol_file(start as u64, end - start, &symbols).into_boxed_slice());
+
+    let _lock = GDB_LOCK.lock().unwrap();
+    unsafe {
+        let entry = Box::into_raw(Box::new(JitCodeEntry {
+            next_entry: __jit_debug_descriptor.first_entry,
+            prev_entry: ptr::null_mut(),
+            symfile_addr: symbol_file.as_ptr(),
+            symfile_size: symbol_file.len() as u64,
+        }));
+        if let Some(first) = __jit_debug_descriptor.first_entry.as_mut() {
+            first.prev_entry = entry;
+        }
+        __jit_debug_descriptor.first_entry = entry;
+        __jit_debug_descriptor.relevant_entry = entry;
+        __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+        __jit_debug_register_code();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::with_sizes;
+
+    #[test]
+    fn test_with_sizes() {
+        let functions = vec![
+            ("b(Int) -> Int".to_string(), 0x1040),
+            ("main() -> Int".to_string(), 0x1000),
+        ];
+        assert_eq!(
+            with_sizes(functions, 0x1070),
+            vec![
+                ("main() -> Int".to_string(), 0x1000, 0x40),
+                ("b(Int) -> Int".to_string(), 0x1040, 0x30),
+            ]
+        );
+    }
+}
@@ -1,50 +1,62 @@
+mod instrument;
+pub mod jit_symbols;
+
 use std::cell::{Ref, RefCell};
 use std::collections::HashMap;
+use std::os::raw::c_char;
 use std::path::Path;
-use std::process::Command;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Once};
 
+use inkwell::attributes::{Attribute, AttributeLoc};
+use inkwell::basic_block::BasicBlock;
+use inkwell::builder::Builder;
 use inkwell::context::Context;
+use inkwell::execution_engine::ExecutionEngine;
 use inkwell::module::Module as InkModule;
+use inkwell::passes::{PassManager, PassManagerBuilder};
 use inkwell::targets::{
     CodeModel, FileType, InitializationConfig, RelocMode, Target, TargetMachine, TargetTriple,
 };
-use inkwell::types::{BasicType, BasicTypeEnum, FunctionType};
-use inkwell::values::{BasicValue, BasicValueEnum, FunctionValue, PointerValue};
-use inkwell::{AddressSpace, OptimizationLevel};
+use inkwell::types::{AsTypeRef, BasicType, BasicTypeEnum, FunctionType};
+use inkwell::values::{
+    AsValueRef, BasicValue, BasicValueEnum, FunctionValue, InstructionOpcode, IntValue,
+    PointerValue,
+};
+use inkwell::{AddressSpace, IntPredicate, OptimizationLevel};
+use llvm_sys::core::{
+    LLVMGetBasicBlockTerminator, LLVMGetInstructionOpcode, LLVMGetMDKindIDInContext,
+    LLVMGetSuccessor, LLVMGetTypeContext, LLVMGlobalSetMetadata, LLVMMDNodeInContext,
+    LLVMMDStringInContext, LLVMSetAlignment, LLVMSetMetadata, LLVMSetOrdering, LLVMValueAsMetadata,
+};
+use llvm_sys::prelude::LLVMValueRef;
+use llvm_sys::support::LLVMParseCommandLineOptions;
+use llvm_sys::{LLVMAtomicOrdering, LLVMOpcode};
 
+use super::super::stats;
+use super::super::timings;
+use super::super::trace;
 use super::ir::{
-    self as ir, Func, FuncId, FuncValue, Instruction, Module, StaticValue, Value, ValueId,
+    self as ir, collect_all_func_values, Func, FuncId, FuncValue, Instruction, Module, StaticValue,
+    Value, ValueId,
 };
+use super::profile::{Profile, Temperature};
+use super::{link_executable, CodegenOptions, Instrument, LinkError};
+use instrument::Instrumentation;
 
-/// Discover all of the funcs in the modules.
-fn collect_all_func_values(modules: &Vec<Module>) -> Vec<FuncValue> {
-    let mut funcs = vec![];
-    for module in modules.iter() {
-        funcs.extend(collect_module_func_values(module));
-    }
-    funcs
-}
+/// Structs bigger than this are returned through a pointer; the System V ABI
+/// only returns up to two eightbytes in registers.
+const MAX_DIRECT_RETURN_SIZE: usize = 16;
 
-fn collect_module_func_values(module: &Module) -> Vec<FuncValue> {
-    let mut funcs = vec![];
-    for func in module.borrow_funcs().iter() {
-        funcs.extend(collect_func_func_values(func));
-    }
-    funcs
-}
-
-fn collect_func_func_values(func: &Func) -> Vec<FuncValue> {
-    let mut funcs = vec![];
-    let specializations = func.borrow_specializations();
-    for specialization in specializations.iter() {
-        funcs.push(specialization.clone());
-        // Recursively collect funcs defined within this specialization.
-        let inner_funcs = specialization.borrow_funcs();
-        for inner_func in inner_funcs.iter() {
-            funcs.extend(collect_func_func_values(inner_func));
-        }
-    }
-    funcs
+/// How a func's return value gets back to its caller.
+enum ReturnKind<'ctx> {
+    /// Zero-sized values (eg. unit) aren't returned at all.
+    Erased,
+    /// Returned in registers.
+    Direct(BasicTypeEnum<'ctx>),
+    /// Written through an `sret` pointer to the caller's slot that's passed
+    /// as the first parameter.
+    Sret(BasicTypeEnum<'ctx>),
 }
 
 struct TypeTracker<'ctx> {
@@ -68,54 +80,605 @@ impl<'ctx> TypeTracker<'ctx> {
             }
         }
         let typ: BasicTypeEnum = match real_type {
+            Bool => self.ctx.bool_type().into(),
             FuncPtr(func_ptr_type) => {
-                let parameters = func_ptr_type
-                    .parameters
+                let function_type =
+                    self.get_fn_type(&func_ptr_type.parameters, &*func_ptr_type.retrn);
+                function_type.ptr_type(AddressSpace::Generic).into()
+            }
+            Int64 => self.ctx.i64_type().into(),
+            // Members are laid out in order with natural alignment, which
+            // matches `RealType::size`.
+            Tuple(tuple_type) => {
+                let members = tuple_type
+                    .members
                     .iter()
                     .map(|real_type| self.get_type(real_type))
                     .collect::<Vec<_>>();
-                let retrn = self.get_type(&*func_ptr_type.retrn);
-                let function_type: FunctionType = retrn.fn_type(parameters.as_slice(), false);
-                function_type.ptr_type(AddressSpace::Generic).into()
+                self.ctx.struct_type(members.as_slice(), false).into()
             }
-            Int64 => self.ctx.i64_type().into(),
-            // FIXME: Actually build tuple types.
-            Tuple(_) => self.ctx.i64_type().into(),
         };
         self.real_types.push((real_type.clone(), typ.clone()));
         typ
     }
+
+    fn get_return(&mut self, real_type: &ir::RealType) -> ReturnKind<'ctx> {
+        let size = real_type.size();
+        if size == 0 {
+            ReturnKind::Erased
+        } else if size > MAX_DIRECT_RETURN_SIZE {
+            ReturnKind::Sret(self.get_type(real_type))
+        } else {
+            ReturnKind::Direct(self.get_type(real_type))
+        }
+    }
+
+    /// Zero-sized parameters are left out of the function type, and so is a
+    /// return value that's erased or returned through a pointer.
+    fn get_fn_type(
+        &mut self,
+        parameters: &[ir::RealType],
+        retrn: &ir::RealType,
+    ) -> FunctionType<'ctx> {
+        let retrn = self.get_return(retrn);
+        let mut types: Vec<BasicTypeEnum> = vec![];
+        if let ReturnKind::Sret(typ) = retrn {
+            types.push(typ.ptr_type(AddressSpace::Generic).into());
+        }
+        for real_type in parameters.iter() {
+            if real_type.size() > 0 {
+                types.push(self.get_type(real_type));
+            }
+        }
+        match retrn {
+            ReturnKind::Direct(typ) => typ.fn_type(types.as_slice(), false),
+            _ => self.ctx.void_type().fn_type(types.as_slice(), false),
+        }
+    }
+
+    /// An undefined value of a zero-sized type, since they're all alike.
+    fn get_erased_value(&mut self, real_type: &ir::RealType) -> BasicValueEnum<'ctx> {
+        self.get_type(real_type)
+            .into_struct_type()
+            .get_undef()
+            .into()
+    }
+}
+
+/// Compile the modules into `out.o` in the build directory and link it into
+/// `out`. The LLVM IR is printed to stderr first if `print_to_stderr` is set.
+pub fn compile_modules(
+    modules: &Vec<Module>,
+    options: &CodegenOptions,
+    print_to_stderr: bool,
+    build_dir: &Path,
+) -> Result<(), LinkError> {
+    enable_pass_timings();
+    let ctx = Context::create();
+    let funcs = collect_all_func_values(modules);
+    let module = timings::time("llvm-build", None, || {
+        build_module(
+            &ctx,
+            "hummingbird",
+            &funcs,
+            &vec![],
+            None,
+            options.instrument,
+        )
+    });
+    if let Some(profile) = &options.profile {
+        apply_profile(&ctx, &module, &funcs, profile, true);
+    }
+    generate_module(module, options, print_to_stderr, build_dir)
 }
 
-pub fn compile_modules(modules: &Vec<Module>) {
+/// Build the modules and then execute their main func in-process with LLVM's
+/// JIT instead of emitting an object and linking an executable. Returns the
+/// value returned by main.
+pub fn run_modules(modules: &Vec<Module>, options: &CodegenOptions) -> i64 {
+    enable_pass_timings();
     let ctx = Context::create();
-    let module = ctx.create_module("hummingbird");
+    let funcs = collect_all_func_values(modules);
+    let module = timings::time("llvm-build", None, || build_llvm_module(&ctx, modules));
+    if let Some(profile) = &options.profile {
+        apply_profile(&ctx, &module, &funcs, profile, false);
+    }
+    let end_marker = add_end_marker(&ctx, &module);
+    execute_module(module, &funcs, &end_marker, options)
+}
+
+/// Build the LLVM module for the IR modules without optimizing it or
+/// generating any code.
+pub fn build_llvm_module<'ctx>(ctx: &'ctx Context, modules: &Vec<Module>) -> InkModule<'ctx> {
+    build_module(
+        ctx,
+        "hummingbird",
+        &collect_all_func_values(modules),
+        &vec![],
+        None,
+        None,
+    )
+}
+
+/// Mark funcs as hot or cold according to the profile. Hot funcs are hinted
+/// for inlining; cold ones are kept out of line and optimized for size. With
+/// `sections` each one also goes into its own section so that the linker
+/// groups the hot code together away from the cold code. The counts
+/// themselves are attached as `!prof` metadata for LLVM's own passes.
+fn apply_profile(
+    ctx: &Context,
+    module: &InkModule,
+    funcs: &Vec<FuncValue>,
+    profile: &Profile,
+    sections: bool,
+) {
+    let add_attributes = |function: FunctionValue, names: &[&str]| {
+        for name in names {
+            let kind = Attribute::get_named_enum_kind_id(name);
+            function.add_attribute(AttributeLoc::Function, ctx.create_enum_attribute(kind, 0));
+        }
+    };
+    for func in funcs.iter() {
+        let name = function_name(func);
+        let function = module.get_function(name).expect("Function not defined");
+        attach_profile_metadata(ctx, function, &func.signature(), profile);
+        match profile.temperature(&func.signature()) {
+            Temperature::Hot => {
+                add_attributes(function, &["inlinehint"]);
+                if sections {
+                    function
+                        .as_global_value()
+                        .set_section(&format!(".text.hot.{}", name));
+                }
+            }
+            Temperature::Cold => {
+                add_attributes(function, &["cold", "noinline", "optsize"]);
+                if sections {
+                    function
+                        .as_global_value()
+                        .set_section(&format!(".text.unlikely.{}", name));
+                }
+            }
+            Temperature::Neutral => (),
+        }
+    }
+}
+
+/// Attach the func's entry count and its conditional branches' weights. The
+/// LLVM function's conditional branches are in the same order as the IR's
+/// since its blocks are built in the same order; the only others are
+/// division checks, which go to the trap block when taken.
+fn attach_profile_metadata(
+    ctx: &Context,
+    function: FunctionValue,
+    signature: &str,
+    profile: &Profile,
+) {
+    let i32_type = ctx.i32_type();
+    let i64_type = ctx.i64_type();
+    unsafe {
+        let ctx_ref = LLVMGetTypeContext(i64_type.as_type_ref());
+        let kind = LLVMGetMDKindIDInContext(ctx_ref, "prof".as_ptr() as *const c_char, 4);
+        let node = |name: &str, values: &[LLVMValueRef]| {
+            let mut operands = vec![LLVMMDStringInContext(
+                ctx_ref,
+                name.as_ptr() as *const c_char,
+                name.len() as u32,
+            )];
+            operands.extend_from_slice(values);
+            LLVMMDNodeInContext(ctx_ref, operands.as_mut_ptr(), operands.len() as u32)
+        };
+
+        if let Some(count) = profile.entry_count(signature) {
+            let count = i64_type.const_int(count, false).as_value_ref();
+            LLVMGlobalSetMetadata(
+                function.as_value_ref(),
+                kind,
+                LLVMValueAsMetadata(node("function_entry_count", &[count])),
+            );
+        }
+
+        let branches = function
+            .get_basic_blocks()
+            .into_iter()
+            .filter_map(|basic_block| basic_block.get_terminator())
+            .filter(|terminator| {
+                terminator.get_opcode() == InstructionOpcode::Br
+                    && terminator.get_num_operands() == 3
+                    && !goes_to_trap(terminator.as_value_ref())
+            });
+        for (branch, counts) in branches.zip(profile.branch_counts(signature)) {
+            // Weights are only 32 bits so scale big counts down.
+            let scale = counts.then.max(counts.els) / u64::from(u32::MAX) + 1;
+            let weights = [
+                i32_type
+                    .const_int(counts.then / scale, false)
+                    .as_value_ref(),
+                i32_type.const_int(counts.els / scale, false).as_value_ref(),
+            ];
+            LLVMSetMetadata(
+                branch.as_value_ref(),
+                kind,
+                node("branch_weights", &weights),
+            );
+        }
+    }
+}
+
+/// Whether the conditional branch is a division check (see
+/// `build_division_check`).
+unsafe fn goes_to_trap(branch: LLVMValueRef) -> bool {
+    let then = LLVMGetBasicBlockTerminator(LLVMGetSuccessor(branch, 0));
+    !then.is_null() && LLVMGetInstructionOpcode(then) == LLVMOpcode::LLVMUnreachable
+}
+
+/// Turn on LLVM's own `-time-passes` if compile times are being reported.
+/// LLVM prints its report when the process exits.
+fn enable_pass_timings() {
+    static ENABLE: Once = Once::new();
+    if !timings::is_enabled() {
+        return;
+    }
+    ENABLE.call_once(|| {
+        let args = [
+            b"hummingbird\0".as_ptr() as *const c_char,
+            b"-time-passes\0".as_ptr() as *const c_char,
+        ];
+        let overview = b"\0".as_ptr() as *const c_char;
+        unsafe { LLVMParseCommandLineOptions(args.len() as i32, args.as_ptr(), overview) };
+    });
+}
+
+fn optimization_level(options: &CodegenOptions) -> OptimizationLevel {
+    match options.opt_level {
+        0 => OptimizationLevel::None,
+        1 => OptimizationLevel::Less,
+        2 => OptimizationLevel::Default,
+        _ => OptimizationLevel::Aggressive,
+    }
+}
+
+/// Run LLVM's standard pipeline of module passes for the optimization level.
+fn optimize_module(module: &InkModule, options: &CodegenOptions) {
+    if options.opt_level == 0 {
+        return;
+    }
+    let pass_manager_builder = PassManagerBuilder::create();
+    pass_manager_builder.set_optimization_level(optimization_level(options));
+    let pass_manager = PassManager::create(());
+    pass_manager_builder.populate_module_pass_manager(&pass_manager);
+    timings::time("llvm-optimize", None, || pass_manager.run_on(module));
+}
+
+/// Record how many instructions each function has after optimization.
+fn record_stats(module: &InkModule) {
+    if !stats::is_enabled() {
+        return;
+    }
+    let mut function = module.get_first_function();
+    while let Some(current) = function {
+        let mut instructions = 0;
+        for basic_block in current.get_basic_blocks() {
+            let mut instruction = basic_block.get_first_instruction();
+            while let Some(current) = instruction {
+                instructions += 1;
+                instruction = current.get_next_instruction();
+            }
+        }
+        let name = current.get_name().to_string_lossy().into_owned();
+        // Skip declarations and end markers.
+        if current.count_basic_blocks() > 0 && !name.starts_with("__hb_end_") {
+            stats::record_llvm_instructions(name, instructions);
+        }
+        function = current.get_next_function();
+    }
+}
+
+/// A JIT that can have funcs added to it incrementally. Funcs compiled later
+/// can call funcs that were compiled earlier. Every batch is optimized
+/// according to the options, same as whole programs.
+pub struct Jit {
+    ctx: &'static Context,
+    engine: ExecutionEngine<'static>,
+    /// Every func that has been compiled so far.
+    compiled: Vec<FuncValue>,
+    /// If given then calls go through the table and compiling a func
+    /// installs it in the table (see `EntryTable`).
+    table: Option<Arc<EntryTable>>,
+    options: CodegenOptions,
+    /// Used to give every `call_for_result` trampoline a unique name.
+    trampolines: usize,
+}
+
+impl Jit {
+    pub fn new(options: &CodegenOptions) -> Self {
+        Self::new_with_table(None, options)
+    }
+
+    pub fn new_with_table(table: Option<Arc<EntryTable>>, options: &CodegenOptions) -> Self {
+        Target::initialize_native(&InitializationConfig::default()).unwrap();
+        // The context has to outlive the engine and every module added to it,
+        // and the JIT is meant to live for the rest of the process anyway.
+        let ctx: &'static Context = Box::leak(Box::new(Context::create()));
+        let module = ctx.create_module("jit");
+        let engine = module
+            .create_jit_execution_engine(optimization_level(options))
+            .unwrap();
+        Self {
+            ctx,
+            engine,
+            compiled: vec![],
+            table,
+            options: options.clone(),
+            trampolines: 0,
+        }
+    }
+
+    pub fn is_compiled(&self, func: &FuncValue) -> bool {
+        self.compiled
+            .iter()
+            .any(|compiled| compiled.id() == func.id())
+    }
+
+    /// Compile the funcs into a new module. Any funcs that they call must
+    /// either be amongst them or have already been compiled.
+    pub fn compile(&mut self, funcs: &Vec<FuncValue>) {
+        let name = format!("jit{}", self.compiled.len());
+        let table = self.table.as_ref().map(|table| &**table);
+        let module = build_module(self.ctx, &name, funcs, &self.compiled, table, None);
+        let end_marker = add_end_marker(self.ctx, &module);
+        optimize_module(&module, &self.options);
+        self.engine
+            .add_module(&module)
+            .expect("Cannot add module to the JIT");
+        self.compiled.extend(funcs.iter().cloned());
+        let end = self
+            .engine
+            .get_function_address(&end_marker)
+            .expect("Missing end marker");
+        jit_symbols::register(
+            funcs
+                .iter()
+                .map(|func| (func.display_name(), self.get_address(func)))
+                .collect(),
+            end,
+        );
+        if let Some(table) = table {
+            for func in funcs.iter() {
+                table.install(func, self.get_address(func));
+            }
+        }
+    }
+
+    /// Get the address of a compiled func's native code.
+    pub fn get_address(&self, func: &FuncValue) -> usize {
+        self.engine
+            .get_function_address(function_name(func))
+            .expect("Func has not been compiled")
+    }
+
+    /// Call a compiled func which takes no parameters and get its result as
+    /// `retrn.size()` bytes, laid out the way `RealType::size` describes.
+    /// How the result comes back depends on its type (see `TypeTracker`), so
+    /// this compiles a trampoline that makes the call following the same
+    /// ABI and stores the result into a buffer.
+    pub fn call_for_result(&mut self, func: &FuncValue) -> Vec<u8> {
+        self.trampolines += 1;
+        let name = format!("__hb_result_{}", self.trampolines);
+        let module = build_module(self.ctx, &name, &vec![], &vec![func.clone()], None, None);
+        let callee = module
+            .get_function(function_name(func))
+            .expect("Function not defined");
+
+        let retrn = func.get_retrn();
+        let mut type_tracker = TypeTracker::new(self.ctx);
+        let out_type = type_tracker
+            .get_type(&retrn)
+            .ptr_type(AddressSpace::Generic);
+        let trampoline = module.add_function(
+            &name,
+            self.ctx.void_type().fn_type(&[out_type.into()], false),
+            None,
+        );
+        let builder = self.ctx.create_builder();
+        builder.position_at_end(self.ctx.append_basic_block(trampoline, "entry"));
+        let out = trampoline
+            .get_first_param()
+            .expect("Missing result parameter")
+            .into_pointer_value();
+        match type_tracker.get_return(&retrn) {
+            ReturnKind::Erased => {
+                builder.build_call(callee, &[], "");
+            }
+            ReturnKind::Direct(_) => {
+                let value = builder
+                    .build_call(callee, &[], "")
+                    .try_as_basic_value()
+                    .left()
+                    .expect("Missing return value");
+                builder.build_store(out, value);
+            }
+            ReturnKind::Sret(_) => {
+                builder.build_call(callee, &[out.into()], "");
+            }
+        }
+        builder.build_return(None);
+        self.engine
+            .add_module(&module)
+            .expect("Cannot add module to the JIT");
+
+        let address = self
+            .engine
+            .get_function_address(&name)
+            .expect("Missing trampoline");
+        let call = unsafe { std::mem::transmute::<usize, extern "C" fn(*mut u64)>(address) };
+        // Words so that the buffer is aligned for any member.
+        let mut buffer = vec![0u64; (retrn.size() + 7) / 8];
+        call(buffer.as_mut_ptr());
+        let mut bytes = buffer
+            .iter()
+            .flat_map(|word| word.to_le_bytes().to_vec())
+            .collect::<Vec<_>>();
+        bytes.truncate(retrn.size());
+        bytes
+    }
+}
+
+/// Entry points of every func in a program running with hot-reloading. All
+/// calls between funcs load the callee's entry from the table, so storing
+/// the address of a recompiled func in its slot switches every caller over
+/// to it (including callers that are already running). Code that has been
+/// replaced is never freed since it may still be executing.
+pub struct EntryTable {
+    slots: Vec<AtomicUsize>,
+    /// Slot indices by func signature.
+    indices: HashMap<String, usize>,
+}
+
+impl EntryTable {
+    /// Create a slot for each func. The set of slots is fixed, so a func
+    /// can only be replaced by one with the same signature.
+    pub fn new(funcs: &Vec<FuncValue>) -> Self {
+        let indices = funcs
+            .iter()
+            .enumerate()
+            .map(|(index, func)| (func.signature(), index))
+            .collect::<HashMap<_, _>>();
+        Self {
+            slots: (0..funcs.len()).map(|_| AtomicUsize::new(0)).collect(),
+            indices,
+        }
+    }
+
+    pub fn contains(&self, func: &FuncValue) -> bool {
+        self.indices.contains_key(&func.signature())
+    }
+
+    /// Get the address of the func's current code.
+    pub fn get(&self, func: &FuncValue) -> usize {
+        self.slot(func).load(Ordering::Acquire)
+    }
+
+    fn install(&self, func: &FuncValue, address: usize) {
+        self.slot(func).store(address, Ordering::Release);
+    }
+
+    fn slot(&self, func: &FuncValue) -> &AtomicUsize {
+        let index = self
+            .indices
+            .get(&func.signature())
+            .expect(&format!("Func not in entry table: {}", func.signature()));
+        &self.slots[*index]
+    }
+
+    /// Build a load of the func's entry from its slot.
+    fn build_load_entry<'ctx>(
+        &self,
+        ctx: &'ctx Context,
+        builder: &Builder<'ctx>,
+        func: &FuncValue,
+        function_value: FunctionValue<'ctx>,
+    ) -> PointerValue<'ctx> {
+        // Slots never move since the table is never resized.
+        let address = self.slot(func) as *const AtomicUsize as u64;
+        let entry_type = function_value.get_type().ptr_type(AddressSpace::Generic);
+        let slot = builder.build_int_to_ptr(
+            ctx.i64_type().const_int(address, false),
+            entry_type.ptr_type(AddressSpace::Generic),
+            "",
+        );
+        // The reloader thread stores to the slot while this code runs, so the
+        // load has to be atomic (acquire, pairing with the release in
+        // `install`) or LLVM is free to merge or hoist it. Atomic loads need
+        // an explicit alignment. On x86-64 it's still a plain `mov`.
+        let entry = builder.build_load(slot, "");
+        unsafe {
+            LLVMSetOrdering(
+                entry.as_value_ref(),
+                LLVMAtomicOrdering::LLVMAtomicOrderingAcquire,
+            );
+            LLVMSetAlignment(entry.as_value_ref(), 8);
+        }
+        entry.into_pointer_value()
+    }
+}
+
+fn function_name(func: &FuncValue) -> &str {
+    if func.is_main() {
+        "main"
+    } else {
+        func.get_qualified_name()
+    }
+}
+
+/// Build the `funcs` into a new module. The `external_funcs` are declared
+/// but not defined so that the `funcs` can call them.
+///
+/// If there's an entry table then every call and func reference goes through
+/// it instead, and any referenced funcs are declared just for their types.
+///
+/// If `instrument` is set then the `funcs` count their calls (see
+/// `instrument`).
+fn build_module<'ctx>(
+    ctx: &'ctx Context,
+    name: &str,
+    funcs: &Vec<FuncValue>,
+    external_funcs: &Vec<FuncValue>,
+    table: Option<&EntryTable>,
+    instrument: Option<Instrument>,
+) -> InkModule<'ctx> {
+    let module = ctx.create_module(name);
+    let mut instrumentation =
+        instrument.map(|instrument| Instrumentation::new(ctx, &module, funcs, instrument));
 
     let mut type_tracker = TypeTracker::new(&ctx);
     let mut function_tracker = HashMap::new();
 
-    let funcs = collect_all_func_values(modules);
+    let mut declared = funcs
+        .iter()
+        .chain(external_funcs.iter())
+        .cloned()
+        .collect::<Vec<_>>();
+    if table.is_some() {
+        for func in funcs.iter() {
+            for referenced in func.referenced_funcs() {
+                if !declared.iter().any(|other| other.id() == referenced.id()) {
+                    declared.push(referenced);
+                }
+            }
+        }
+    }
+
     // Forward-define all of the functions.
-    for func in funcs.iter() {
-        let name = if func.is_main() {
-            "main"
-        } else {
-            func.get_qualified_name()
-        };
+    for func in declared.iter() {
+        let name = function_name(func);
         let parameters = func
             .get_parameters()
             .iter()
-            .map(|(name, real_type)| type_tracker.get_type(real_type))
+            .map(|(_, real_type)| real_type.clone())
             .collect::<Vec<_>>();
-        let retrn = type_tracker.get_type(&func.get_retrn());
-        let function_type = retrn.fn_type(parameters.as_slice(), false);
+        let retrn = func.get_retrn();
+        // Main's result is the exit status so it always returns something.
+        let function_type = if func.is_main() && retrn.size() == 0 {
+            ctx.i64_type().fn_type(&[], false)
+        } else {
+            type_tracker.get_fn_type(parameters.as_slice(), &retrn)
+        };
         let function_value = module.add_function(name, function_type, None);
+        if let ReturnKind::Sret(_) = type_tracker.get_return(&retrn) {
+            for name in &["sret", "noalias"] {
+                let kind = Attribute::get_named_enum_kind_id(name);
+                function_value
+                    .add_attribute(AttributeLoc::Param(0), ctx.create_enum_attribute(kind, 0));
+            }
+        }
         function_tracker.insert(func.id(), function_value);
     }
 
     // Then build the function implementations.
     let builder = ctx.create_builder();
-    for func in funcs.iter() {
+    for (func_index, func) in funcs.iter().enumerate() {
+        let _span = trace::span("emit", "llvm", None, Some(func.get_qualified_name()));
         let function_value = function_tracker
             .get(&func.id())
             .expect("Function not defined");
@@ -140,9 +703,19 @@ pub fn compile_modules(modules: &Vec<Module>) {
         }
 
         // Resolve IR values (local SSA and statics) to LLVM values.
-        let value_resolver = ValueResolver::new(&ctx, &function_tracker);
+        let value_resolver = ValueResolver::new(
+            &ctx,
+            &function_tracker,
+            table.map(|table| (&builder, table)),
+        );
         // Map local indices to LLVM stack pointer values.
         let mut local_tracker = HashMap::new();
+        let retrn_kind = type_tracker.get_return(&func.get_retrn());
+        // Parameters start after the `sret` pointer, if there is one.
+        let first_parameter = match retrn_kind {
+            ReturnKind::Sret(_) => 1,
+            _ => 0,
+        };
 
         // Start by allocating locals and copying parameters.
         let entry_basic_block = ctx.prepend_basic_block(first_basic_block.unwrap(), "entry");
@@ -168,14 +741,51 @@ pub fn compile_modules(modules: &Vec<Module>) {
                         real_type,
                     );
                 }
+                // Zero-sized parameters aren't passed.
+                if parameter_real_type.size() == 0 {
+                    continue;
+                }
+                let llvm_index = first_parameter
+                    + func.get_parameters()[..parameter_index]
+                        .iter()
+                        .filter(|(_, real_type)| real_type.size() > 0)
+                        .count();
                 let value = function_value
-                    .get_nth_param(parameter_index as u32)
+                    .get_nth_param(llvm_index as u32)
                     .expect("Missing parameter");
                 builder.build_store(ptr, value);
             }
         }
+        // Slots for the results of calls that return through a pointer go in
+        // the entry block too so that they're only allocated once.
+        let mut sret_tracker = HashMap::new();
+        for ir_basic_block in ir_basic_blocks.iter() {
+            for instruction in ir_basic_block.instructions.iter() {
+                match instruction {
+                    Instruction::CallFunc(ir_retrn, _, _)
+                    | Instruction::CallFuncPtr(ir_retrn, _, _) => {
+                        if let ReturnKind::Sret(typ) =
+                            type_tracker.get_return(&ir_retrn.typ().into_real())
+                        {
+                            let ptr = builder.build_alloca(typ, "");
+                            sret_tracker.insert(ir_retrn.value_id(), ptr);
+                        }
+                    }
+                    _ => (),
+                }
+            }
+        }
+        let mut frame = instrumentation
+            .as_mut()
+            .map(|instrumentation| instrumentation.build_entry(&builder, func_index, func));
         builder.build_unconditional_branch(first_basic_block.unwrap());
 
+        // Division checks split blocks, so phis need the LLVM block that
+        // each IR block ends in rather than the one it starts in.
+        let mut end_blocks = HashMap::new();
+        // Every division check in the function shares one, built on first
+        // use.
+        let mut trap_block = None;
         for ir_basic_block in ir_basic_blocks.iter() {
             let basic_block = basic_block_tracker
                 .get(&ir_basic_block.get_index())
@@ -186,25 +796,53 @@ pub fn compile_modules(modules: &Vec<Module>) {
             for instruction in ir_basic_block.instructions.iter() {
                 use Instruction::*;
                 match instruction {
+                    Branch(ir_target) => {
+                        let target = basic_block_tracker[ir_target].clone();
+                        builder.build_unconditional_branch(target);
+                    }
+                    CondBranch(ir_condition, ir_then, ir_els) => {
+                        let condition = value_resolver.get(ir_condition).into_int_value();
+                        if let (Some(instrumentation), Some(frame)) = (&instrumentation, &mut frame)
+                        {
+                            instrumentation.build_branch(&builder, frame, condition);
+                        }
+                        builder.build_conditional_branch(
+                            condition,
+                            basic_block_tracker[ir_then].clone(),
+                            basic_block_tracker[ir_els].clone(),
+                        );
+                    }
                     CallFunc(ir_retrn, func_value, ir_arguments) => {
-                        let arguments = ir_arguments
-                            .iter()
-                            .map(|ir_argument| value_resolver.get(ir_argument))
-                            .collect::<Vec<_>>();
+                        let sret = sret_tracker.get(&ir_retrn.value_id()).cloned();
+                        let arguments = resolve_arguments(&value_resolver, sret, ir_arguments);
                         let function_value = function_tracker
                             .get(&func_value.id())
                             .expect("Function not defined")
                             .clone();
-                        let call_site =
-                            builder.build_call(function_value, arguments.as_slice(), "");
-                        let retrn = call_site.try_as_basic_value().left().unwrap();
+                        let call_site = match table {
+                            Some(table) => {
+                                let entry = table.build_load_entry(
+                                    ctx,
+                                    &builder,
+                                    func_value,
+                                    function_value,
+                                );
+                                builder.build_call(entry, arguments.as_slice(), "")
+                            }
+                            None => builder.build_call(function_value, arguments.as_slice(), ""),
+                        };
+                        let retrn = match sret {
+                            Some(ptr) => Some(builder.build_load(ptr, "")),
+                            None => call_site.try_as_basic_value().left(),
+                        };
+                        let retrn = retrn.unwrap_or_else(|| {
+                            type_tracker.get_erased_value(&ir_retrn.typ().into_real())
+                        });
                         value_resolver.set(ir_retrn, retrn);
                     }
                     CallFuncPtr(ir_retrn, ir_value, ir_arguments) => {
-                        let arguments = ir_arguments
-                            .iter()
-                            .map(|ir_argument| value_resolver.get(ir_argument))
-                            .collect::<Vec<_>>();
+                        let sret = sret_tracker.get(&ir_retrn.value_id()).cloned();
+                        let arguments = resolve_arguments(&value_resolver, sret, ir_arguments);
                         // `into_pointer_value` will panic if it's not a
                         // function pointer, so we need to be sure that it's
                         // going to be one.
@@ -212,7 +850,13 @@ pub fn compile_modules(modules: &Vec<Module>) {
                             .get(&Value::Local(ir_value.clone()))
                             .into_pointer_value();
                         let call_site = builder.build_call(value, arguments.as_slice(), "");
-                        let retrn = call_site.try_as_basic_value().left().unwrap();
+                        let retrn = match sret {
+                            Some(ptr) => Some(builder.build_load(ptr, "")),
+                            None => call_site.try_as_basic_value().left(),
+                        };
+                        let retrn = retrn.unwrap_or_else(|| {
+                            type_tracker.get_erased_value(&ir_retrn.typ().into_real())
+                        });
                         value_resolver.set(ir_retrn, retrn);
                     }
                     GetLocal(ir_value, index) => {
@@ -220,29 +864,222 @@ pub fn compile_modules(modules: &Vec<Module>) {
                         let value = builder.build_load(ptr, "");
                         value_resolver.set(ir_value, value);
                     }
+                    // A constant-index GEP into the local's struct type, so
+                    // only the member is loaded.
+                    GetLocalMember(ir_value, index, member) => {
+                        let ptr = local_tracker.get(index).expect("Local not defined").clone();
+                        let indices = [
+                            ctx.i32_type().const_int(0, false),
+                            ctx.i32_type().const_int(*member as u64, false),
+                        ];
+                        let member_ptr = unsafe { builder.build_in_bounds_gep(ptr, &indices, "") };
+                        let value = builder.build_load(member_ptr, "");
+                        value_resolver.set(ir_value, value);
+                    }
+                    GetTupleMember(ir_member, ir_tuple, index) => {
+                        let tuple = value_resolver.get(ir_tuple).into_struct_value();
+                        let member = builder
+                            .build_extract_value(tuple, *index as u32, "")
+                            .expect("Tuple member out of range");
+                        value_resolver.set(ir_member, member);
+                    }
+                    IntArithmetic(ir_retrn, op, ir_lhs, ir_rhs) => {
+                        let lhs = value_resolver.get(ir_lhs).into_int_value();
+                        let rhs = value_resolver.get(ir_rhs).into_int_value();
+                        use ir::IntOp::*;
+                        let value = match op {
+                            Add => builder.build_int_add(lhs, rhs, ""),
+                            Sub => builder.build_int_sub(lhs, rhs, ""),
+                            Mul => builder.build_int_mul(lhs, rhs, ""),
+                            Div | Rem => {
+                                let trap = trap_block
+                                    .get_or_insert_with(|| {
+                                        build_trap_block(ctx, &module, &builder, function_value)
+                                    })
+                                    .clone();
+                                build_division_check(ctx, &builder, trap, lhs, rhs);
+                                if *op == Div {
+                                    builder.build_int_signed_div(lhs, rhs, "")
+                                } else {
+                                    builder.build_int_signed_rem(lhs, rhs, "")
+                                }
+                            }
+                        };
+                        value_resolver.set(ir_retrn, value.into());
+                    }
+                    IntCompare(ir_retrn, comparison, ir_lhs, ir_rhs) => {
+                        let lhs = value_resolver.get(ir_lhs).into_int_value();
+                        let rhs = value_resolver.get(ir_rhs).into_int_value();
+                        use ir::IntComparison::*;
+                        let predicate = match comparison {
+                            Equal => IntPredicate::EQ,
+                            NotEqual => IntPredicate::NE,
+                            LessThan => IntPredicate::SLT,
+                            LessThanOrEqual => IntPredicate::SLE,
+                            GreaterThan => IntPredicate::SGT,
+                            GreaterThanOrEqual => IntPredicate::SGE,
+                        };
+                        let value = builder.build_int_compare(predicate, lhs, rhs, "");
+                        value_resolver.set(ir_retrn, value.into());
+                    }
+                    MakeTuple(ir_tuple, ir_members) => {
+                        let typ = type_tracker.get_type(&ir_tuple.typ().into_real());
+                        let mut tuple = typ.into_struct_type().get_undef();
+                        for (index, ir_member) in ir_members.iter().enumerate() {
+                            let member = value_resolver.get(ir_member);
+                            tuple = builder
+                                .build_insert_value(tuple, member, index as u32, "")
+                                .expect("Tuple member out of range")
+                                .into_struct_value();
+                        }
+                        value_resolver.set(ir_tuple, tuple.into());
+                    }
+                    Phi(ir_retrn, ir_incoming) => {
+                        let typ = type_tracker.get_type(&ir_retrn.typ().into_real());
+                        let phi = builder.build_phi(typ, "");
+                        let incoming = ir_incoming
+                            .iter()
+                            .map(|(ir_value, ir_basic_block)| {
+                                let basic_block = end_blocks
+                                    .get(ir_basic_block)
+                                    .unwrap_or(&basic_block_tracker[ir_basic_block])
+                                    .clone();
+                                (value_resolver.get(ir_value), basic_block)
+                            })
+                            .collect::<Vec<_>>();
+                        let incoming = incoming
+                            .iter()
+                            .map(|(value, basic_block)| {
+                                (value as &dyn BasicValue, basic_block.clone())
+                            })
+                            .collect::<Vec<_>>();
+                        phi.add_incoming(incoming.as_slice());
+                        value_resolver.set(ir_retrn, phi.as_basic_value());
+                    }
                     Return(ir_value) => {
                         let value = value_resolver.get(ir_value);
-                        builder.build_return(Some(&value));
+                        if let (Some(instrumentation), Some(frame)) = (&instrumentation, &frame) {
+                            instrumentation.build_exit(&builder, frame);
+                        }
+                        match retrn_kind {
+                            ReturnKind::Direct(_) => {
+                                builder.build_return(Some(&value));
+                            }
+                            ReturnKind::Sret(_) => {
+                                let ptr = function_value
+                                    .get_first_param()
+                                    .expect("Missing sret parameter")
+                                    .into_pointer_value();
+                                builder.build_store(ptr, value);
+                                builder.build_return(None);
+                            }
+                            ReturnKind::Erased if func.is_main() => {
+                                builder.build_return(Some(&ctx.i64_type().const_int(0, false)));
+                            }
+                            ReturnKind::Erased => {
+                                builder.build_return(None);
+                            }
+                        }
+                    }
+                    SetLocal(index, ir_value) => {
+                        let ptr = local_tracker.get(index).expect("Local not defined").clone();
+                        builder.build_store(ptr, value_resolver.get(ir_value));
                     }
                 }
             }
+            end_blocks.insert(
+                ir_basic_block.get_index(),
+                builder.get_insert_block().unwrap(),
+            );
         }
     }
+    if let Some(instrumentation) = instrumentation {
+        instrumentation.finish();
+    }
+
+    module
+}
+
+/// Resolve the arguments for a call, leaving out zero-sized ones (see
+/// `TypeTracker::get_fn_type`) and passing the `sret` slot first.
+fn resolve_arguments<'ctx>(
+    value_resolver: &ValueResolver<'ctx>,
+    sret: Option<PointerValue<'ctx>>,
+    ir_arguments: &Vec<Value>,
+) -> Vec<BasicValueEnum<'ctx>> {
+    sret.map(|ptr| ptr.into())
+        .into_iter()
+        .chain(
+            ir_arguments
+                .iter()
+                .filter(|ir_argument| ir_argument.typ().into_real().size() > 0)
+                .map(|ir_argument| value_resolver.get(ir_argument)),
+        )
+        .collect()
+}
+
+/// Build a block that calls `llvm.trap` (ud2 on x86), which is where
+/// invalid divisions go. The builder stays where it was.
+fn build_trap_block<'ctx>(
+    ctx: &'ctx Context,
+    module: &InkModule<'ctx>,
+    builder: &Builder<'ctx>,
+    function: &FunctionValue<'ctx>,
+) -> BasicBlock<'ctx> {
+    let trap = module.get_function("llvm.trap").unwrap_or_else(|| {
+        module.add_function("llvm.trap", ctx.void_type().fn_type(&[], false), None)
+    });
+    let current = builder.get_insert_block().unwrap();
+    let basic_block = ctx.append_basic_block(function.clone(), "trap");
+    builder.position_at_end(basic_block.clone());
+    builder.build_call(trap, &[], "");
+    builder.build_unreachable();
+    builder.position_at_end(current);
+    basic_block
+}
 
-    generate_module(module, true);
+/// Branch to the trap block if dividing `lhs` by `rhs` is an error (see
+/// `IntOp`): LLVM leaves division by zero and `i64::MIN / -1` undefined.
+/// Leaves the builder in a new block for the division.
+fn build_division_check<'ctx>(
+    ctx: &'ctx Context,
+    builder: &Builder<'ctx>,
+    trap: BasicBlock<'ctx>,
+    lhs: IntValue<'ctx>,
+    rhs: IntValue<'ctx>,
+) {
+    let i64_type = ctx.i64_type();
+    let by_zero = builder.build_int_compare(IntPredicate::EQ, rhs, i64_type.const_zero(), "");
+    let min = i64_type.const_int(i64::min_value() as u64, true);
+    let minus_one = i64_type.const_int(-1i64 as u64, true);
+    let overflows = builder.build_and(
+        builder.build_int_compare(IntPredicate::EQ, lhs, min, ""),
+        builder.build_int_compare(IntPredicate::EQ, rhs, minus_one, ""),
+        "",
+    );
+    let invalid = builder.build_or(by_zero, overflows, "");
+    let valid = ctx.insert_basic_block_after(builder.get_insert_block().unwrap(), "");
+    builder.build_conditional_branch(invalid, trap, valid.clone());
+    builder.position_at_end(valid);
 }
 
-fn generate_module(module: InkModule, print_to_stderr: bool) {
+fn generate_module(
+    module: InkModule,
+    options: &CodegenOptions,
+    print_to_stderr: bool,
+    build_dir: &Path,
+) -> Result<(), LinkError> {
     if print_to_stderr {
         module.print_to_stderr();
     }
+    optimize_module(&module, options);
+    record_stats(&module);
 
     // Set up the paths we'll emit to.
-    let object = Path::new("./build/out.o");
-    let executable = Path::new("./build/out");
+    let object = build_dir.join("out.o");
+    let executable = build_dir.join("out");
 
-    // let optimization_level = OptimizationLevel::Aggressive;
-    let optimization_level = OptimizationLevel::None;
+    let optimization_level = optimization_level(options);
     let reloc_mode = RelocMode::Default;
     let code_model = CodeModel::Default;
     Target::initialize_x86(&InitializationConfig::default());
@@ -259,21 +1096,78 @@ fn generate_module(module: InkModule, print_to_stderr: bool) {
         )
         .unwrap();
 
-    target_machine
-        .write_to_file(&module, FileType::Object, &object)
-        .unwrap();
+    timings::time("llvm-codegen", None, || {
+        target_machine
+            .write_to_file(&module, FileType::Object, &object)
+            .unwrap()
+    });
 
-    // Link the object file into an executable.
-    Command::new("clang")
-        .args(&[object.to_str().unwrap(), "-o", executable.to_str().unwrap()])
-        .output()
-        .unwrap();
+    if let Some(kind) = options.instrument {
+        let runtime = build_dir.join("instrument.c");
+        std::fs::write(&runtime, instrument::runtime(kind)).unwrap();
+        link_executable(&[&object, &runtime], &executable)
+    } else {
+        link_executable(&[&object], &executable)
+    }
+}
+
+/// Add an empty function to the end of a module being JIT-ed whose address
+/// marks where the code of the module's last function ends (see
+/// `jit_symbols`). Returns its name.
+fn add_end_marker(ctx: &Context, module: &InkModule) -> String {
+    let name = format!("__hb_end_{}", module.get_name().to_string_lossy());
+    let function = module.add_function(&name, ctx.void_type().fn_type(&[], false), None);
+    let builder = ctx.create_builder();
+    builder.position_at_end(ctx.append_basic_block(function, "entry"));
+    builder.build_return(None);
+    name
+}
+
+fn execute_module(
+    module: InkModule,
+    funcs: &Vec<FuncValue>,
+    end_marker: &str,
+    options: &CodegenOptions,
+) -> i64 {
+    Target::initialize_native(&InitializationConfig::default()).unwrap();
+    optimize_module(&module, options);
+    record_stats(&module);
+    // The main func is always built with a name of "main" and no parameters
+    // (see `function_name`).
+    // Looking up main is what makes the JIT generate the code.
+    let (engine, address) = timings::time("llvm-codegen", None, || {
+        let engine = module
+            .create_jit_execution_engine(optimization_level(options))
+            .unwrap();
+        let address = engine
+            .get_function_address("main")
+            .expect("Missing main function");
+        (engine, address)
+    });
+    jit_symbols::register(
+        funcs
+            .iter()
+            .map(|func| {
+                let address = engine
+                    .get_function_address(function_name(func))
+                    .expect("Func has not been compiled");
+                (func.display_name(), address)
+            })
+            .collect(),
+        engine
+            .get_function_address(end_marker)
+            .expect("Missing end marker"),
+    );
+    let main = unsafe { std::mem::transmute::<usize, extern "C" fn() -> i64>(address) };
+    main()
 }
 
 struct ValueResolver<'ctx> {
     ctx: &'ctx Context,
     // Used to look up static function values.
     function_tracker: &'ctx HashMap<FuncId, FunctionValue<'ctx>>,
+    // If given then static function values are loaded from the entry table.
+    entries: Option<(&'ctx Builder<'ctx>, &'ctx EntryTable)>,
     // Store and look up local SSA values.
     local_tracker: RefCell<HashMap<ValueId, BasicValueEnum<'ctx>>>,
 }
@@ -282,26 +1176,34 @@ impl<'ctx> ValueResolver<'ctx> {
     fn new(
         ctx: &'ctx Context,
         function_tracker: &'ctx HashMap<FuncId, FunctionValue<'ctx>>,
+        entries: Option<(&'ctx Builder<'ctx>, &'ctx EntryTable)>,
     ) -> Self {
         Self {
             ctx,
             function_tracker,
+            entries,
             local_tracker: RefCell::new(HashMap::new()),
         }
     }
 
-    fn get(&self, ir_value: &ir::Value) -> BasicValueEnum {
+    fn get(&self, ir_value: &ir::Value) -> BasicValueEnum<'ctx> {
         // Handle constant values that haven't actually been stored.
         if let ir::Value::Local(local_value) = ir_value {
             match local_value {
+                ir::LocalValue::Bool(_, Some(const_value)) => {
+                    return self
+                        .ctx
+                        .bool_type()
+                        .const_int(*const_value as u64, false)
+                        .into();
+                }
                 ir::LocalValue::Int64(_, Some(const_value)) => {
                     return self.ctx.i64_type().const_int(*const_value, false).into();
                 }
                 // Empty tuples are constant too.
                 ir::LocalValue::Tuple(_, tuple_type) => {
                     if tuple_type.members.is_empty() {
-                        // FIXME: Actually build the right tuple value (see TypeTracker).
-                        return self.ctx.i64_type().const_int(0, false).into();
+                        return self.ctx.struct_type(&[], false).get_undef().into();
                     }
                 }
                 _ => (),
@@ -317,6 +1219,11 @@ impl<'ctx> ValueResolver<'ctx> {
                         .get(&func_value.id())
                         .expect("Function not defined")
                         .clone();
+                    if let Some((builder, table)) = self.entries {
+                        return table
+                            .build_load_entry(self.ctx, builder, func_value, function_value)
+                            .into();
+                    }
                     let global_value = function_value.as_global_value();
                     global_value.as_pointer_value().into()
                 }
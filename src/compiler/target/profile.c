@@ -0,0 +1,48 @@
+/* Runtime linked into executables built with `--profile-generate`. When the
+ * program exits it writes how many times each function was entered and which
+ * way each of their conditional branches went to the file named by
+ * `HUMMINGBIRD_PROFILE_OUT` (or `default.hbprofile`) for `--profile-use`; the
+ * format is described in `compiler/profile.rs`. The counters are defined by
+ * the generated code; see `instrument.rs`. */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern const int64_t __hb_instrument_count;
+extern const char *const __hb_instrument_names[];
+extern const uint64_t __hb_instrument_calls[];
+extern const int64_t __hb_instrument_branch_count;
+extern const int64_t __hb_instrument_branch_funcs[];
+/* Taken and not taken counts of each branch. */
+extern const uint64_t __hb_instrument_branches[];
+
+__attribute__((destructor)) static void write_profile(void) {
+  const char *path = getenv("HUMMINGBIRD_PROFILE_OUT");
+  if (!path) {
+    path = "default.hbprofile";
+  }
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return;
+  }
+  fprintf(out, "# hummingbird profile v2\n");
+  /* Funcs that were never entered are included so that they count as
+   * cold. */
+  for (int64_t index = 0; index < __hb_instrument_count; index++) {
+    fprintf(out, "%" PRIu64 "\t%s\n", __hb_instrument_calls[index],
+            __hb_instrument_names[index]);
+  }
+  /* A function's branches are next to each other, in IR order. */
+  int64_t func = -1, branch = 0;
+  for (int64_t index = 0; index < __hb_instrument_branch_count; index++) {
+    branch = __hb_instrument_branch_funcs[index] == func ? branch + 1 : 0;
+    func = __hb_instrument_branch_funcs[index];
+    fprintf(out, "b\t%" PRId64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\n", branch,
+            __hb_instrument_branches[index * 2],
+            __hb_instrument_branches[index * 2 + 1],
+            __hb_instrument_names[func]);
+  }
+  fclose(out);
+}
@@ -0,0 +1,232 @@
+/// Content-addressed cache of built executables (similar to ccache).
+///
+/// Builds are keyed on the hash of every source file that went into them
+/// along with the compiler's identity, the codegen options and the linker:
+///
+///     <dir>/objects/<key>/out     The linked executable.
+///     <dir>/objects/<key>/out.o   The object it was linked from.
+///     <dir>/manifests/<hash>      Source paths of the last build of an
+///                                 entry module (one per line).
+///
+/// The manifests let a lookup recompute the key from the sources on disk
+/// without parsing or type-checking anything.
+use std::env;
+use std::fs;
+use std::io;
+use std::path::{Path, PathBuf};
+use std::time::UNIX_EPOCH;
+
+use super::super::compiler::{self, CodegenOptions};
+
+pub struct Cache {
+    dir: PathBuf,
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct CacheKey(u128);
+
+impl CacheKey {
+    fn to_hex(&self) -> String {
+        format!("{:032x}", self.0)
+    }
+}
+
+impl Cache {
+    pub fn new(dir: PathBuf) -> Self {
+        Self { dir }
+    }
+
+    /// Uses `$HUMMINGBIRD_CACHE_DIR`, `$XDG_CACHE_HOME/hummingbird`, or
+    /// `~/.cache/hummingbird` (in that order of preference).
+    pub fn from_env() -> Option<Self> {
+        let dir = if let Some(dir) = env::var_os("HUMMINGBIRD_CACHE_DIR") {
+            PathBuf::from(dir)
+        } else if let Some(dir) = env::var_os("XDG_CACHE_HOME") {
+            PathBuf::from(dir).join("hummingbird")
+        } else if let Some(home) = env::var_os("HOME") {
+            PathBuf::from(home).join(".cache").join("hummingbird")
+        } else {
+            return None;
+        };
+        Some(Self::new(dir))
+    }
+
+    /// Compute the key of a build from the (path, source) pairs of all of
+    /// the modules in it.
+    pub fn key(sources: &Vec<(PathBuf, String)>, options: &CodegenOptions) -> CacheKey {
+        let mut sources = sources.iter().collect::<Vec<_>>();
+        sources.sort_by(|a, b| a.0.cmp(&b.0));
+
+        let mut hasher = Fnv128::new();
+        hasher.write_field(compiler_identity().as_bytes());
+        hasher.write_field(options.fingerprint().as_bytes());
+        // A different linker (or linker flags) can produce a different
+        // executable from the same object.
+        hasher.write_field(compiler::linker().join(" ").as_bytes());
+        for (path, source) in sources {
+            hasher.write_field(path.to_str().unwrap().as_bytes());
+            hasher.write_field(source.as_bytes());
+        }
+        CacheKey(hasher.finish())
+    }
+
+    /// Find the executable from a previous build of the entry module if
+    /// none of the sources it was built from have changed since.
+    pub fn lookup(&self, entry_path: &Path, options: &CodegenOptions) -> Option<PathBuf> {
+        let entry_path = entry_path.canonicalize().ok()?;
+        let manifest = fs::read_to_string(self.manifest_path(&entry_path)).ok()?;
+        let mut sources = vec![];
+        for line in manifest.lines() {
+            let path = PathBuf::from(line);
+            let source = fs::read_to_string(&path).ok()?;
+            sources.push((path, source));
+        }
+        let executable = self.object_dir(Self::key(&sources, options)).join("out");
+        if executable.is_file() {
+            Some(executable)
+        } else {
+            None
+        }
+    }
+
+    /// Copy a finished build (the `out` and `out.o` in `build_dir`) into the
+    /// cache and record which sources the entry module was built from.
+    /// Returns the path of the cached executable.
+    pub fn store(
+        &self,
+        entry_path: &Path,
+        sources: &Vec<(PathBuf, String)>,
+        options: &CodegenOptions,
+        build_dir: &Path,
+    ) -> io::Result<PathBuf> {
+        let object_dir = self.object_dir(Self::key(sources, options));
+        fs::create_dir_all(&object_dir)?;
+        for name in ["out.o", "out"].iter() {
+            // Copy and then rename so that concurrent runs never see a
+            // partially-written file.
+            let temporary = object_dir.join(format!("{}.{}", name, std::process::id()));
+            fs::copy(build_dir.join(name), &temporary)?;
+            fs::rename(&temporary, object_dir.join(name))?;
+        }
+
+        let manifest_path = self.manifest_path(&entry_path.canonicalize()?);
+        fs::create_dir_all(manifest_path.parent().unwrap())?;
+        let manifest = sources
+            .iter()
+            .map(|(path, _)| format!("{}\n", path.to_str().unwrap()))
+            .collect::<String>();
+        let temporary = manifest_path.with_extension(std::process::id().to_string());
+        fs::write(&temporary, manifest)?;
+        fs::rename(&temporary, &manifest_path)?;
+
+        Ok(object_dir.join("out"))
+    }
+
+    fn object_dir(&self, key: CacheKey) -> PathBuf {
+        self.dir.join("objects").join(key.to_hex())
+    }
+
+    fn manifest_path(&self, entry_path: &Path) -> PathBuf {
+        let mut hasher = Fnv128::new();
+        hasher.write_field(entry_path.to_str().unwrap().as_bytes());
+        self.dir
+            .join("manifests")
+            .join(CacheKey(hasher.finish()).to_hex())
+    }
+}
+
+/// Identifies the build of the compiler. Like ccache this also uses the size
+/// and modification time of the compiler's executable so that rebuilding
+/// the compiler during development invalidates the cache.
+fn compiler_identity() -> String {
+    let mut identity = env!("CARGO_PKG_VERSION").to_string();
+    if let Ok(metadata) = env::current_exe().and_then(fs::metadata) {
+        identity.push_str(&format!(" {}", metadata.len()));
+        if let Ok(modified) = metadata.modified() {
+            if let Ok(duration) = modified.duration_since(UNIX_EPOCH) {
+                identity.push_str(&format!(" {}", duration.as_nanos()));
+            }
+        }
+    }
+    identity
+}
+
+/// 128-bit FNV-1a.
+struct Fnv128(u128);
+
+const FNV_OFFSET_BASIS: u128 = 0x6c62272e07bb014262b821756295c58d;
+const FNV_PRIME: u128 = 0x0000000001000000000000000000013b;
+
+impl Fnv128 {
+    fn new() -> Self {
+        Self(FNV_OFFSET_BASIS)
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        for byte in bytes.iter() {
+            self.0 ^= *byte as u128;
+            self.0 = self.0.wrapping_mul(FNV_PRIME);
+        }
+    }
+
+    /// Length-prefix the bytes so that adjacent fields can't run together.
+    fn write_field(&mut self, bytes: &[u8]) {
+        self.write(&(bytes.len() as u64).to_le_bytes());
+        self.write(bytes);
+    }
+
+    fn finish(&self) -> u128 {
+        self.0
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::fs;
+    use std::path::PathBuf;
+
+    use super::super::super::compiler::CodegenOptions;
+    use super::{Cache, Fnv128};
+
+    #[test]
+    fn test_fnv128() {
+        // Test vectors from the reference implementation.
+        let mut hasher = Fnv128::new();
+        hasher.write(b"");
+        assert_eq!(hasher.finish(), 0x6c62272e07bb014262b821756295c58d);
+        let mut hasher = Fnv128::new();
+        hasher.write(b"a");
+        assert_eq!(hasher.finish(), 0xd228cb696f1a8caf78912b704e4a8964);
+    }
+
+    #[test]
+    fn test_store_and_lookup() {
+        let root = std::env::temp_dir().join(format!("hummingbird-cache-{}", std::process::id()));
+        let build_dir = root.join("build");
+        fs::create_dir_all(&build_dir).unwrap();
+        fs::write(build_dir.join("out"), "executable").unwrap();
+        fs::write(build_dir.join("out.o"), "object").unwrap();
+        let entry = root.join("main.hb");
+        fs::write(&entry, "func main() {}\n").unwrap();
+        let entry = entry.canonicalize().unwrap();
+        let sources = vec![(entry.clone(), "func main() {}\n".to_string())];
+
+        let cache = Cache::new(root.join("cache"));
+        let options = CodegenOptions::default();
+        assert_eq!(cache.lookup(&entry, &options), None);
+        let stored = cache.store(&entry, &sources, &options, &build_dir).unwrap();
+        assert_eq!(fs::read_to_string(&stored).unwrap(), "executable");
+        assert_eq!(cache.lookup(&entry, &options), Some(stored));
+
+        // Different flags or sources mean a different build.
+        let optimized = CodegenOptions {
+            opt_level: 2,
+            ..CodegenOptions::default()
+        };
+        assert_eq!(cache.lookup(&entry, &optimized), None);
+        fs::write(&entry, "func main() { 1 }\n").unwrap();
+        assert_eq!(cache.lookup(&entry, &options), None);
+
+        fs::remove_dir_all(root).unwrap();
+    }
+}
@@ -0,0 +1,217 @@
+/// Hot-reloading for programs run with the JIT: while main is running, a
+/// watcher thread polls the program's sources and, when they change,
+/// recompiles the whole program with a fresh `Manager` and re-JITs only the
+/// specializations whose IR changed. These are swapped in through the
+/// `EntryTable` so the running program picks them up on its next call.
+use std::collections::HashMap;
+use std::fs;
+use std::path::PathBuf;
+use std::sync::Arc;
+use std::thread;
+use std::time::Duration;
+
+use super::super::compiler::ir::{collect_all_func_values, FuncValue, Module as IrModule};
+use super::super::compiler::target::{EntryTable, Jit};
+use super::super::compiler::CodegenOptions;
+use super::super::StageError;
+use super::{report_error, Manager};
+
+const POLL_INTERVAL: Duration = Duration::from_millis(250);
+
+/// Run the main func with the JIT while reloading changed funcs in the
+/// background. Returns the value returned by main.
+pub fn run_modules(
+    modules: &Vec<IrModule>,
+    entry_path: PathBuf,
+    sources: Vec<(PathBuf, String)>,
+    options: &CodegenOptions,
+) -> i64 {
+    let funcs = collect_all_func_values(modules);
+    let table = Arc::new(EntryTable::new(&funcs));
+    let mut jit = Jit::new_with_table(Some(table.clone()), options);
+    jit.compile(&funcs);
+
+    let mut reloader = Reloader::new(entry_path, sources, table, options.clone());
+    reloader.record(&funcs);
+    thread::spawn(move || reloader.watch());
+
+    let main = funcs
+        .iter()
+        .find(|func| func.is_main())
+        .expect("Missing main func");
+    // The main func is always built with no parameters (see the target's
+    // `function_name`).
+    let main =
+        unsafe { std::mem::transmute::<usize, extern "C" fn() -> i64>(jit.get_address(main)) };
+    main()
+}
+
+struct Reloader {
+    entry_path: PathBuf,
+    /// Sources as of the last reload (or failed attempt at one).
+    sources: Vec<(PathBuf, String)>,
+    table: Arc<EntryTable>,
+    options: CodegenOptions,
+    /// Fingerprints of the code currently installed, by func signature.
+    fingerprints: HashMap<String, u64>,
+}
+
+impl Reloader {
+    fn new(
+        entry_path: PathBuf,
+        sources: Vec<(PathBuf, String)>,
+        table: Arc<EntryTable>,
+        options: CodegenOptions,
+    ) -> Self {
+        Self {
+            entry_path,
+            sources,
+            table,
+            options,
+            fingerprints: HashMap::new(),
+        }
+    }
+
+    fn watch(mut self) {
+        // Replaced code has to stay alive in case it's still running.
+        let mut jits = vec![];
+        loop {
+            thread::sleep(POLL_INTERVAL);
+            if !self.has_changed() {
+                continue;
+            }
+            match self.reload(&mut jits) {
+                Ok(0) => (),
+                Ok(reloaded) => eprintln!("Reloaded {} func(s)", reloaded),
+                Err(error) => report_error(error),
+            }
+        }
+    }
+
+    fn has_changed(&self) -> bool {
+        self.sources
+            .iter()
+            .any(|(path, source)| match fs::read_to_string(path) {
+                Ok(current) => current != *source,
+                // Probably in the middle of being saved.
+                Err(_) => false,
+            })
+    }
+
+    /// Recompile the program and install every func that changed. Returns
+    /// how many funcs were reloaded.
+    fn reload(&mut self, jits: &mut Vec<Jit>) -> Result<usize, StageError> {
+        // Don't retry the same sources if they fail to compile.
+        for (path, source) in self.sources.iter_mut() {
+            if let Ok(current) = fs::read_to_string(&path) {
+                *source = current;
+            }
+        }
+
+        let manager = Manager::new();
+        let entry = manager.load(self.entry_path.clone())?;
+        // Not optimized for the same reason as at startup (see `run_main`):
+        // folded calls wouldn't see later changes to their callees.
+        let modules = manager.compile_ir(&entry);
+        self.sources = manager.sources();
+
+        let funcs = collect_all_func_values(&modules);
+        let changed = funcs
+            .iter()
+            .filter(|func| self.fingerprints.get(&func.signature()) != Some(&func.fingerprint()))
+            .filter(|func| {
+                // Funcs are called through their slots, so a func can only be
+                // swapped in if it and everything it calls already has one.
+                let missing = std::iter::once((*func).clone())
+                    .chain(func.referenced_funcs())
+                    .find(|referenced| !self.table.contains(referenced));
+                if let Some(missing) = &missing {
+                    eprintln!(
+                        "Cannot reload {}: {} is new or changed signature (restart to pick it up)",
+                        func.signature(),
+                        missing.signature(),
+                    );
+                }
+                missing.is_none()
+            })
+            .cloned()
+            .collect::<Vec<_>>();
+        if changed.is_empty() {
+            return Ok(0);
+        }
+
+        // Each reload gets a new JIT so that the new code's symbols can't
+        // collide with the code it's replacing.
+        let mut jit = Jit::new_with_table(Some(self.table.clone()), &self.options);
+        jit.compile(&changed);
+        jits.push(jit);
+        self.record(&changed);
+        Ok(changed.len())
+    }
+
+    fn record(&mut self, funcs: &Vec<FuncValue>) {
+        for func in funcs.iter() {
+            self.fingerprints
+                .insert(func.signature(), func.fingerprint());
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::fs;
+    use std::sync::Arc;
+
+    use super::super::super::compiler::ir::collect_all_func_values;
+    use super::super::super::compiler::target::{EntryTable, Jit};
+    use super::super::super::compiler::CodegenOptions;
+    use super::super::Manager;
+    use super::Reloader;
+
+    #[test]
+    fn test_reload_swaps_changed_funcs() {
+        let dir = std::env::temp_dir().join(format!("hummingbird-reload-{}", std::process::id()));
+        fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("main.hb");
+        fs::write(
+            &path,
+            "func value() {\n  1\n}\nfunc main() {\n  value()\n}\n",
+        )
+        .unwrap();
+
+        let manager = Manager::new();
+        let entry = manager.load(path.clone()).unwrap();
+        let modules = manager.compile_ir(&entry);
+        let funcs = collect_all_func_values(&modules);
+        let table = Arc::new(EntryTable::new(&funcs));
+        let mut jit = Jit::new_with_table(Some(table.clone()), &CodegenOptions::default());
+        jit.compile(&funcs);
+        let mut reloader = Reloader::new(
+            path.clone(),
+            manager.sources(),
+            table.clone(),
+            CodegenOptions::default(),
+        );
+        reloader.record(&funcs);
+
+        let main = funcs.iter().find(|func| func.is_main()).unwrap();
+        let call_main = || {
+            let address = table.get(main);
+            unsafe { std::mem::transmute::<usize, extern "C" fn() -> i64>(address)() }
+        };
+        assert_eq!(call_main(), 1);
+
+        // Only `value` changed; main picks it up through the table.
+        fs::write(
+            &path,
+            "func value() {\n  2\n}\nfunc main() {\n  value()\n}\n",
+        )
+        .unwrap();
+        assert!(reloader.has_changed());
+        let mut jits = vec![];
+        assert_eq!(reloader.reload(&mut jits).unwrap(), 1);
+        assert_eq!(call_main(), 2);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
@@ -1,12 +1,36 @@
 use std::cell::{Ref, RefCell};
 use std::collections::{HashMap, HashSet};
 use std::hash::{Hash, Hasher};
+use std::os::unix::process::ExitStatusExt;
 use std::path::{Path, PathBuf};
 use std::rc::Rc;
 
+use super::compiler::{self, Backend, CodegenOptions, Engine};
 use super::parser::{self, ParseError, TokenStream};
+use super::stats;
+use super::timings;
+use super::trace;
 use super::type_ast::{self, Module as TModule, TypeError};
-use super::{compiler, StageError};
+use super::{print_type_error, StageError};
+
+mod cache;
+mod hot_reload;
+mod repl;
+
+pub use cache::Cache;
+pub use repl::run_repl;
+
+/// Print an error without exiting, for the REPL and hot-reloading where
+/// the process keeps going.
+fn report_error(error: StageError) {
+    match error {
+        StageError::Type(type_error, path, source) => {
+            print_type_error(type_error, path.to_str().unwrap().to_string(), source)
+        }
+        StageError::Parse(parse_error, _, _) => eprintln!("{}", parse_error),
+        other @ _ => eprintln!("{:?}", other),
+    }
+}
 
 #[derive(Debug)]
 pub enum FrontendError {
@@ -36,19 +60,170 @@ impl Manager {
         }))
     }
 
-    pub fn compile_main(entry_path: PathBuf) -> Result<Self, StageError> {
+    /// Build an executable (at `./build/out`) from the entry module. If a
+    /// cache is given and nothing has changed since the last build then the
+    /// previous build is copied out of the cache instead.
+    pub fn compile_main(
+        entry_path: PathBuf,
+        options: &CodegenOptions,
+        cache: Option<&Cache>,
+    ) -> Result<(), StageError> {
+        if let Some(cache) = cache {
+            if let Some(executable) = cache.lookup(&entry_path, options) {
+                let build_dir = Path::new("./build");
+                std::fs::create_dir_all(build_dir).unwrap();
+                let cached_dir = executable.parent().unwrap();
+                for name in ["out.o", "out"].iter() {
+                    std::fs::copy(cached_dir.join(name), build_dir.join(name)).unwrap();
+                }
+                return Ok(());
+            }
+        }
+        Self::build_executable(entry_path, options, cache, true)?;
+        Ok(())
+    }
+
+    /// Compile and link the entry module, adding the build to the cache (if
+    /// given). Returns the path of the executable: the cached copy if there
+    /// is one, otherwise `./build/out`.
+    fn build_executable(
+        entry_path: PathBuf,
+        options: &CodegenOptions,
+        cache: Option<&Cache>,
+        print_to_stderr: bool,
+    ) -> Result<PathBuf, StageError> {
         let manager = Self::new();
-        let entry = manager.load(entry_path)?;
+        let entry = manager.load(entry_path.clone())?;
 
         // let modules = compiler::ir::compile_modules(manager.0.modules.borrow().iter());
         // compiler::compile_modules(modules);
 
-        let ir_modules =
-            compiler::ir::compile_modules(manager.0.modules.borrow().iter(), &entry).get_modules();
+        let ir_modules = manager.compile_ir(&entry);
+        compiler::optimize_ir(&ir_modules, options);
 
-        compiler::target::compile_modules(&ir_modules);
+        // Build in a directory of our own so that a failed link can't leave
+        // a previous build's executable to be cached or run, and concurrent
+        // builds can't pick up each other's output.
+        let build_dir = Path::new("./build");
+        let scratch_dir = build_dir.join(format!("tmp-{}", std::process::id()));
+        std::fs::create_dir_all(&scratch_dir).unwrap();
+        let linked = match options.backend {
+            Backend::Llvm => compiler::target::compile_modules(
+                &ir_modules,
+                options,
+                print_to_stderr,
+                &scratch_dir,
+            ),
+            Backend::Baseline => compiler::baseline::compile_modules(&ir_modules, &scratch_dir),
+        };
+        if let Err(err) = linked {
+            let _ = std::fs::remove_dir_all(&scratch_dir);
+            return Err(StageError::Link(err));
+        }
 
-        Ok(manager)
+        let mut executable = build_dir.join("out");
+        if let Some(cache) = cache {
+            // Not being able to cache shouldn't fail the build.
+            match cache.store(&entry_path, &manager.sources(), options, &scratch_dir) {
+                Ok(cached) => executable = cached,
+                Err(err) => eprintln!("Cannot write to the build cache: {}", err),
+            }
+        }
+        // Renaming means `./build/out` is only ever a complete build.
+        for name in ["out.o", "out"].iter() {
+            std::fs::rename(scratch_dir.join(name), build_dir.join(name)).unwrap();
+        }
+        let _ = std::fs::remove_dir_all(&scratch_dir);
+        Ok(executable)
+    }
+
+    /// Compile the entry module and its dependencies to bytecode instead of
+    /// an executable.
+    pub fn compile_main_to_bytecode(entry_path: PathBuf) -> Result<(), StageError> {
+        let manager = Self::new();
+        let entry = manager.load(entry_path)?;
+
+        let ir_modules = manager.compile_ir(&entry);
+        let program = compiler::bytecode::lower_modules(&ir_modules)
+            .map_err(|err| StageError::Interpreter(err))?;
+        compiler::bytecode::write_file(&program, Path::new("./build/out.hbc")).unwrap();
+
+        Ok(())
+    }
+
+    /// Compile the entry module and its dependencies and execute them with
+    /// the given engine. Returns the value returned by the main func.
+    ///
+    /// If a cache is given then the JIT engine runs the program's executable
+    /// from the cache instead, building and caching it first if anything has
+    /// changed, so that unchanged programs aren't compiled again. Without a
+    /// cache (eg. `--no-cache` or `--perf-map`) and with every other engine
+    /// the program is compiled and executed in-process.
+    pub fn run_main(
+        entry_path: PathBuf,
+        engine: Engine,
+        options: &CodegenOptions,
+        cache: Option<&Cache>,
+    ) -> Result<i64, StageError> {
+        if let (Engine::Jit, Some(cache)) = (engine, cache) {
+            let executable = match cache.lookup(&entry_path, options) {
+                Some(executable) => executable,
+                None => Self::build_executable(entry_path, options, Some(cache), false)?,
+            };
+            let status = std::process::Command::new(executable)
+                .status()
+                .expect("Cannot run cached executable");
+            // Report being killed by a signal the way shells do.
+            return Ok(match status.code() {
+                Some(code) => code as i64,
+                None => 128 + status.signal().unwrap_or(0) as i64,
+            });
+        }
+
+        let manager = Self::new();
+        let entry = manager.load(entry_path.clone())?;
+
+        let ir_modules = manager.compile_ir(&entry);
+        // Folding a call bakes in its callee's result, so a change to the
+        // callee could never take effect when hot-reloading.
+        if engine != Engine::HotReload {
+            compiler::optimize_ir(&ir_modules, options);
+        }
+        match engine {
+            Engine::Jit => Ok(compiler::target::run_modules(&ir_modules, options)),
+            Engine::HotReload => Ok(hot_reload::run_modules(
+                &ir_modules,
+                entry_path,
+                manager.sources(),
+                options,
+            )),
+            Engine::Interpreter => compiler::interpreter::run_modules(&ir_modules)
+                .map_err(|err| StageError::Interpreter(err)),
+            Engine::Tiered => compiler::interpreter::run_modules_tiered(&ir_modules, options)
+                .map_err(|err| StageError::Interpreter(err)),
+            Engine::Vm => compiler::bytecode::lower_modules(&ir_modules)
+                .and_then(|program| compiler::bytecode::run(&program))
+                .map_err(|err| StageError::Interpreter(err)),
+        }
+    }
+
+    /// The paths and sources of every loaded module.
+    pub fn sources(&self) -> Vec<(PathBuf, String)> {
+        let modules = self.0.modules.borrow();
+        modules
+            .iter()
+            .map(|module| (module.path().to_path_buf(), module.source()))
+            .collect()
+    }
+
+    pub fn compile_ir(&self, entry: &Module) -> Vec<compiler::ir::Module> {
+        let modules = timings::time("ir", None, || {
+            compiler::ir::compile_modules(self.0.modules.borrow().iter(), entry).get_modules()
+        });
+        if stats::is_enabled() {
+            compiler::ir::record_stats(&modules);
+        }
+        modules
     }
 
     fn start_loading(&self, path: PathBuf) -> Result<(), FrontendError> {
@@ -112,6 +287,7 @@ impl Module {
         Self(Rc::new(ModuleInner {
             id,
             path,
+            source: RefCell::new(None),
             typed: RefCell::new(None),
         }))
     }
@@ -124,25 +300,33 @@ impl Module {
         self.0.path.as_path()
     }
 
+    pub fn source(&self) -> String {
+        self.0.source.borrow().clone().expect("Module not loaded")
+    }
+
     pub fn borrow_typed(&self) -> Ref<TModule> {
         Ref::map(self.0.typed.borrow(), |module| module.as_ref().unwrap())
     }
 
     pub fn load(&self, manager: Manager) -> Result<(), StageError> {
         let path = self.0.path.clone();
+        let _span = trace::span("load", "frontend", Some(&path), None);
         let source = std::fs::read_to_string(path.clone()).unwrap();
 
-        let mut token_stream = TokenStream::from_string(source.clone());
-        let parsed = parser::parse_module(&mut token_stream)
-            .map_err(|err| err.into_stage_error(&path, &source))?;
+        let parsed = timings::time("parse", Some(&path), || {
+            let mut token_stream = TokenStream::from_string(source.clone());
+            parser::parse_module(&mut token_stream)
+        })
+        .map_err(|err| err.into_stage_error(&path, &source))?;
 
-        let typed = type_ast::translate_module(parsed)
+        let typed = timings::time("type", Some(&path), || type_ast::translate_module(parsed))
             .map_err(|err| err.into_stage_error(&path, &source))?;
 
         {
             let mut mutable = self.0.typed.borrow_mut();
             *mutable = Some(typed);
         }
+        self.0.source.replace(Some(source));
         Ok(())
     }
 
@@ -170,6 +354,8 @@ struct ModuleInner {
     id: usize,
     /// Canonicalized path of the module's source file.
     path: PathBuf,
+    /// The source that the module was loaded from.
+    source: RefCell<Option<String>>,
     /// Will be filled in once the module is finished initializing.
     typed: RefCell<Option<TModule>>,
 }
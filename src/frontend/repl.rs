@@ -0,0 +1,235 @@
+use std::io::{self, BufRead, Write};
+use std::path::PathBuf;
+
+use super::super::compiler::ir::{collect_all_func_values, IncrementalCompiler, RealType};
+use super::super::compiler::target::Jit;
+use super::super::compiler::CodegenOptions;
+use super::super::parser::{self, TokenStream};
+use super::super::type_ast::{self, ModuleScope, ModuleStatement, Scope, ScopeLike};
+use super::super::StageError;
+use super::report_error;
+
+/// Read lines from stdin and evaluate them until EOF.
+pub fn run_repl() {
+    let mut repl = Repl::new();
+    let stdin = io::stdin();
+    let mut lines = stdin.lock().lines();
+    loop {
+        let input = match read_input(&mut lines) {
+            Some(input) => input,
+            None => break,
+        };
+        if input.trim().is_empty() {
+            continue;
+        }
+        match repl.eval(&input) {
+            Ok(Some(output)) => println!("{}", output),
+            Ok(None) => (),
+            Err(error) => report_error(error),
+        }
+    }
+}
+
+/// Read a line, continuing onto more lines while there are unclosed braces.
+/// Returns `None` at EOF.
+fn read_input<B: BufRead>(lines: &mut io::Lines<B>) -> Option<String> {
+    let mut input = String::new();
+    let mut depth = 0;
+    loop {
+        print!("{}", if input.is_empty() { "> " } else { "| " });
+        io::stdout().flush().unwrap();
+        let line = match lines.next() {
+            Some(line) => line.unwrap(),
+            None => return None,
+        };
+        for character in line.chars() {
+            match character {
+                '{' => depth += 1,
+                '}' => depth -= 1,
+                _ => (),
+            }
+        }
+        input.push_str(&line);
+        input.push('\n');
+        if depth <= 0 {
+            return Some(input);
+        }
+    }
+}
+
+/// Every input is translated into the same module scope and compiled into
+/// the same IR module so that later inputs can use funcs defined by earlier
+/// ones. Each input's funcs are JIT-compiled as a new module.
+pub struct Repl {
+    scope: Scope,
+    compiler: IncrementalCompiler,
+    jit: Jit,
+    /// Used to give every expression's wrapper func a unique name.
+    counter: usize,
+}
+
+impl Repl {
+    pub fn new() -> Self {
+        Self {
+            scope: ModuleScope::new().into_scope(),
+            compiler: IncrementalCompiler::new("repl".to_string()),
+            jit: Jit::new(&CodegenOptions::default()),
+            counter: 0,
+        }
+    }
+
+    /// Evaluate an input, returning the printable result (if any). Inputs
+    /// starting with `func` or `struct` are definitions; anything else is an
+    /// expression which is wrapped in a func so that it can be compiled and
+    /// called.
+    pub fn eval(&mut self, input: &str) -> Result<Option<String>, StageError> {
+        let path = PathBuf::from("<repl>");
+        let trimmed = input.trim_start();
+        let wrapper = if trimmed.starts_with("func ") || trimmed.starts_with("struct ") {
+            None
+        } else {
+            self.counter += 1;
+            Some(format!("__repl{}", self.counter))
+        };
+        let source = match &wrapper {
+            Some(name) => format!("func {}() {{\n{}}}\n", name, input),
+            None => input.to_string(),
+        };
+
+        let mut token_stream = TokenStream::from_string(source.clone());
+        let parsed = parser::parse_module(&mut token_stream)
+            .map_err(|err| err.into_stage_error(&path, &source))?;
+        let typed = type_ast::translate_module_in_scope(parsed, self.scope.clone())
+            .map_err(|err| err.into_stage_error(&path, &source))?;
+
+        // Structs are added to the scope by translating them, which is all
+        // that later inputs need, so only funcs are left in the statements.
+        let ast_funcs = typed
+            .statements
+            .into_iter()
+            .map(|statement| match statement {
+                ModuleStatement::Func(func) => func,
+            })
+            .collect::<Vec<_>>();
+        self.compiler.define_funcs(ast_funcs);
+
+        let name = match wrapper {
+            Some(name) => name,
+            // Funcs are compiled lazily when an expression first uses them.
+            None => return Ok(None),
+        };
+        let func_value = match self.compiler.compile_entry(&name) {
+            Some(func_value) => func_value,
+            None => return Ok(Some("<generic func>".to_string())),
+        };
+
+        // Compile the wrapper along with any new funcs (or specializations
+        // of existing ones) that it needs.
+        let funcs = collect_all_func_values(&self.compiler.get_modules())
+            .into_iter()
+            .filter(|func_value| !self.jit.is_compiled(func_value))
+            .collect::<Vec<_>>();
+        self.jit.compile(&funcs);
+
+        let retrn = func_value.get_retrn();
+        let bytes = self.jit.call_for_result(&func_value);
+        if retrn.is_unit() {
+            return Ok(None);
+        }
+        Ok(Some(format_value(&retrn, &bytes)))
+    }
+}
+
+/// Format a value stored in memory (see `RealType::size`).
+fn format_value(real_type: &RealType, bytes: &[u8]) -> String {
+    match real_type {
+        RealType::Bool => (bytes[0] & 1 == 1).to_string(),
+        RealType::Int64 => {
+            let mut word = [0u8; 8];
+            word.copy_from_slice(&bytes[..8]);
+            i64::from_le_bytes(word).to_string()
+        }
+        RealType::FuncPtr(_) => "<func>".to_string(),
+        RealType::Tuple(tuple_type) => {
+            let members = tuple_type
+                .members
+                .iter()
+                .enumerate()
+                .map(|(index, member)| {
+                    format_value(member, &bytes[tuple_type.member_offset(index)..])
+                })
+                .collect::<Vec<_>>();
+            match &tuple_type.layout {
+                Some(layout) => {
+                    let fields = layout
+                        .fields
+                        .iter()
+                        .zip(members.iter())
+                        .map(|(field, member)| format!("{}: {}", field, member))
+                        .collect::<Vec<_>>();
+                    format!("{}({})", layout.name, fields.join(", "))
+                }
+                None if members.len() == 1 => format!("({},)", members[0]),
+                None => format!("({})", members.join(", ")),
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::Repl;
+
+    #[test]
+    fn test_repl_calls_earlier_funcs() {
+        let mut repl = Repl::new();
+        assert_eq!(repl.eval("func first(a, b) {\n  a\n}\n").unwrap(), None);
+        assert_eq!(repl.eval("first(3, 4)\n").unwrap(), Some("3".to_string()));
+        assert_eq!(
+            repl.eval("func second(a, b) {\n  first(b, a)\n}\n")
+                .unwrap(),
+            None
+        );
+        assert_eq!(repl.eval("second(3, 4)\n").unwrap(), Some("4".to_string()));
+    }
+
+    #[test]
+    fn test_repl_prints_tuples() {
+        let mut repl = Repl::new();
+        assert_eq!(
+            repl.eval("(1, true)\n").unwrap(),
+            Some("(1, true)".to_string())
+        );
+        assert_eq!(
+            repl.eval("(true, false, true)\n").unwrap(),
+            Some("(true, false, true)".to_string())
+        );
+        assert_eq!(
+            repl.eval("(1, 2, (3, false))\n").unwrap(),
+            Some("(1, 2, (3, false))".to_string())
+        );
+    }
+
+    #[test]
+    fn test_repl_defines_structs() {
+        let mut repl = Repl::new();
+        assert_eq!(
+            repl.eval("struct Point {\n  x: Int\n  y: Int\n}\n")
+                .unwrap(),
+            None
+        );
+        assert_eq!(
+            repl.eval("func area(point) {\n  point.x * point.y\n}\n")
+                .unwrap(),
+            None
+        );
+        assert_eq!(
+            repl.eval("area(Point(6, 7))\n").unwrap(),
+            Some("42".to_string())
+        );
+        assert_eq!(
+            repl.eval("Point(6, 7)\n").unwrap(),
+            Some("Point(x: 6, y: 7)".to_string())
+        );
+    }
+}
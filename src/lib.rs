@@ -0,0 +1,79 @@
+#![allow(dead_code)]
+#![allow(private_in_public)]
+#![allow(unused_imports)]
+#![allow(unused_macros)]
+#![allow(unused_variables)]
+
+extern crate codespan;
+extern crate codespan_reporting;
+#[macro_use]
+extern crate lazy_static;
+extern crate libc;
+extern crate llvm_sys;
+#[macro_use]
+extern crate paste;
+extern crate regex;
+extern crate termcolor;
+
+use std::path::PathBuf;
+
+pub mod allocations;
+pub mod compiler;
+pub mod frontend;
+pub mod parse_ast;
+pub mod parser;
+pub mod stats;
+pub mod timings;
+pub mod trace;
+pub mod type_ast;
+
+use compiler::interpreter::InterpreterError;
+use compiler::LinkError;
+use frontend::FrontendError;
+use parser::ParseError;
+use type_ast::TypeError;
+
+/// Covers all the different errors that can be raised at various stages of
+/// compilation; includes the path and contents of the file from where the
+/// error originated.
+#[derive(Debug)]
+pub enum StageError {
+    Parse(ParseError, PathBuf, String),
+    Type(TypeError, PathBuf, String),
+    Frontend(FrontendError),
+    Interpreter(InterpreterError),
+    Link(LinkError),
+}
+
+pub fn print_type_error(error: TypeError, filename: String, source: String) {
+    use codespan::{Files, Span as CodeSpan};
+    use codespan_reporting::diagnostic::{Diagnostic, Label};
+
+    use TypeError::*;
+
+    let (error, span) = (error.unwrap(), error.span());
+
+    if let Some(span) = span {
+        let mut files = Files::new();
+        let file_id = files.add(filename, source);
+
+        let mut diagnostic = Diagnostic::new_error(
+            error.short_message(),
+            Label::new(
+                file_id,
+                CodeSpan::new(span.start.index, span.end.index),
+                error.label_message(),
+            ),
+        );
+        if let Some(notes) = error.notes() {
+            diagnostic = diagnostic.with_notes(vec![notes]);
+        }
+
+        let config = codespan_reporting::term::Config::default();
+        let mut writer = termcolor::StandardStream::stderr(termcolor::ColorChoice::Auto);
+        codespan_reporting::term::emit(&mut writer, &config, &files, &diagnostic).unwrap();
+    } else {
+        // If we don't have a span then just report the error.
+        eprintln!("{:#?}", error);
+    }
+}
@@ -1,41 +1,19 @@
 #![allow(dead_code)]
-#![allow(private_in_public)]
-#![allow(unused_imports)]
-#![allow(unused_macros)]
 #![allow(unused_variables)]
 
-extern crate codespan;
-extern crate codespan_reporting;
-#[macro_use]
-extern crate lazy_static;
-#[macro_use]
-extern crate paste;
-extern crate regex;
-extern crate termcolor;
-
 use std::env;
-use std::path::PathBuf;
+use std::path::Path;
 use std::process::exit;
+use std::sync::Arc;
 
-mod compiler;
-mod frontend;
-mod parse_ast;
-mod parser;
-mod type_ast;
-
-use frontend::FrontendError;
-use parser::ParseError;
-use type_ast::{Printer, PrinterOptions, TypeError};
+use hummingbird::compiler::profile::Profile;
+use hummingbird::compiler::{self, Backend, CodegenOptions, Engine, Instrument};
+use hummingbird::type_ast::{Printer, PrinterOptions};
+use hummingbird::{allocations, frontend, print_type_error, stats, timings, trace, StageError};
 
-/// Covers all the different errors that can be raised at various stages of
-/// compilation; includes the path and contents of the file from where the
-/// error originated.
-#[derive(Debug)]
-pub enum StageError {
-    Parse(ParseError, PathBuf, String),
-    Type(TypeError, PathBuf, String),
-    Frontend(FrontendError),
-}
+#[cfg(feature = "count-allocations")]
+#[global_allocator]
+static ALLOCATOR: allocations::CountingAllocator = allocations::CountingAllocator;
 
 fn extract_option<S: AsRef<str>>(args: Vec<String>, option: S) -> (Vec<String>, bool) {
     let mut found = false;
@@ -50,15 +28,79 @@ fn extract_option<S: AsRef<str>>(args: Vec<String>, option: S) -> (Vec<String>,
     (new, found)
 }
 
+/// Extracts an option with a value (eg. `--opt-level=2`).
+fn extract_value_option<S: AsRef<str>>(
+    args: Vec<String>,
+    option: S,
+) -> (Vec<String>, Option<String>) {
+    let prefix = format!("{}=", option.as_ref());
+    let mut value = None;
+    let mut new = vec![];
+    for arg in args.iter() {
+        if arg.starts_with(&prefix) {
+            value = Some(arg[prefix.len()..].to_string())
+        } else {
+            new.push(arg.clone())
+        }
+    }
+    (new, value)
+}
+
 fn print_usage() {
     println!("Usage: hummingbird [command] [file] [options]");
     println!();
     println!("Commands:");
     println!("  compile  Build an executable from the file.");
+    println!("  run      Compile the file and execute it in-process with the JIT.");
+    println!("           Bytecode files (.hbc) are executed directly with the VM.");
     println!("  ast      Print the typed AST of a file.");
+    println!("  repl     Start an interactive session.");
     println!();
     println!("Options:");
+    println!("  --backend=NAME    Backend for compiled executables: llvm (default) or");
+    println!("                    baseline");
+    println!("  --bytecode        Compile to bytecode (build/out.hbc) instead");
+    println!("  --instrument=functions");
+    println!("                    Count calls and cycles in every func of the executable");
+    println!("                    and write them to instrument.txt when it exits");
+    println!("  --interp          Run with the IR interpreter instead of the JIT");
+    println!("  --profile-generate");
+    println!("                    Build an executable which writes a profile to");
+    println!("                    default.hbprofile when it exits");
+    println!("  --profile-use=FILE");
+    println!("                    Optimize hot and cold funcs according to the profile");
+    println!("  --no-cache        Don't use or add to the build cache");
+    println!("  --opt-level=N     Optimization level from 0 to 3 (default 0)");
+    println!("  --vm              Run with the bytecode VM instead of the JIT");
+    println!("  --tiered          Interpret and then JIT funcs once they get hot");
+    println!("  --hot-reload      Recompile funcs in the running program when they change");
+    println!("  --perf-map        Write funcs run with the JIT to /tmp/perf-<pid>.map");
     println!("  --print-pointers  Include pointers in debugging output");
+    println!("  --time-passes     Print the time and memory taken by each stage");
+    println!("  --allocations     Print the allocations made by each stage (needs the");
+    println!("                    count-allocations feature)");
+    println!("  --stats           Print counters gathered during compilation");
+    println!("  --stats-json=FILE Write the counters to the file as JSON");
+    println!("  --trace-out=FILE  Write a Chrome trace of the compiler's work to the file");
+}
+
+/// Print and write out whatever reports were asked for.
+fn finish_reports(trace_out: Option<&String>, print_stats: bool, stats_json: Option<&String>) {
+    timings::print_report();
+    allocations::print_report();
+    if print_stats {
+        stats::print_report();
+    }
+    if let Some(path) = trace_out {
+        if let Err(err) = trace::write(Path::new(path)) {
+            eprintln!("Cannot write trace to {}: {}", path, err);
+        }
+    }
+    if let Some(path) = stats_json {
+        if let Err(err) = stats::write_json(Path::new(path)) {
+            eprintln!("Cannot write statistics to {}: {}", path, err);
+        }
+    }
 }
 
 fn handle_stage_error(error: StageError) {
@@ -66,6 +108,8 @@ fn handle_stage_error(error: StageError) {
         StageError::Type(type_error, path, source) => {
             print_type_error(type_error, path.to_str().unwrap().to_string(), source)
         }
+        StageError::Interpreter(interpreter_error) => eprintln!("{}", interpreter_error),
+        StageError::Link(link_error) => eprintln!("{}", link_error),
         other @ _ => panic!("{:#?}", other),
     }
     exit(-1);
@@ -81,6 +125,99 @@ fn main() {
     let called = args[0].clone();
     let args = args[1..].to_vec();
     let (args, print_pointers) = extract_option(args, "--print-pointers");
+    let (args, interp) = extract_option(args, "--interp");
+    let (args, vm) = extract_option(args, "--vm");
+    let (args, tiered) = extract_option(args, "--tiered");
+    let (args, hot_reload) = extract_option(args, "--hot-reload");
+    let (args, bytecode) = extract_option(args, "--bytecode");
+    let (args, no_cache) = extract_option(args, "--no-cache");
+    let (args, opt_level) = extract_value_option(args, "--opt-level");
+    let (args, backend) = extract_value_option(args, "--backend");
+    let (args, instrument) = extract_value_option(args, "--instrument");
+    let (args, profile_generate) = extract_option(args, "--profile-generate");
+    let (args, profile_use) = extract_value_option(args, "--profile-use");
+    let (args, time_passes) = extract_option(args, "--time-passes");
+    let (args, trace_out) = extract_value_option(args, "--trace-out");
+    let (args, print_stats) = extract_option(args, "--stats");
+    let (args, stats_json) = extract_value_option(args, "--stats-json");
+    let (args, print_allocations) = extract_option(args, "--allocations");
+    let (args, perf_map) = extract_option(args, "--perf-map");
+
+    let options = CodegenOptions {
+        opt_level: match opt_level.map(|level| level.parse::<u8>()) {
+            None => 0,
+            Some(Ok(level)) if level <= 3 => level,
+            _ => {
+                eprintln!("Invalid optimization level (expected 0 through 3)");
+                exit(-1);
+            }
+        },
+        backend: match backend.as_ref().map(|backend| backend.as_str()) {
+            None | Some("llvm") => Backend::Llvm,
+            Some("baseline") => Backend::Baseline,
+            Some(other) => {
+                eprintln!("Invalid backend (expected llvm or baseline): {}", other);
+                exit(-1);
+            }
+        },
+        instrument: match instrument.as_ref().map(|instrument| instrument.as_str()) {
+            None if profile_generate => Some(Instrument::Profile),
+            None => None,
+            Some(_) if profile_generate => {
+                eprintln!("Cannot instrument functions and generate a profile at the same time");
+                exit(-1);
+            }
+            Some("functions") => Some(Instrument::Functions),
+            Some(other) => {
+                eprintln!("Invalid instrumentation (expected functions): {}", other);
+                exit(-1);
+            }
+        },
+        profile: profile_use.map(|path| match Profile::read(Path::new(&path)) {
+            Ok(profile) => Arc::new(profile),
+            Err(err) => {
+                eprintln!("Cannot read profile {}: {}", path, err);
+                exit(-1);
+            }
+        }),
+    };
+    if options.instrument.is_some() && options.backend != Backend::Llvm {
+        eprintln!("Instrumentation is only supported by the LLVM backend");
+        exit(-1);
+    }
+    if time_passes {
+        timings::enable();
+    }
+    if trace_out.is_some() {
+        trace::enable();
+    }
+    if print_stats || stats_json.is_some() {
+        stats::enable();
+    }
+    if perf_map {
+        compiler::target::jit_symbols::enable_perf_map();
+    }
+    if print_allocations {
+        if cfg!(feature = "count-allocations") {
+            allocations::enable();
+        } else {
+            eprintln!("Cannot count allocations; rebuild with `--features count-allocations`");
+            exit(-1);
+        }
+    }
+    // Built executables are cached unless disabled (`run` uses the cache for
+    // the JIT engine). Timing, tracing or counting a build that comes out of
+    // the cache wouldn't tell us anything either.
+    let cache = if no_cache
+        || time_passes
+        || trace_out.is_some()
+        || stats::is_enabled()
+        || allocations::is_enabled()
+    {
+        None
+    } else {
+        frontend::Cache::from_env()
+    };
 
     // Turn them into `&str`s so that we can match against them.
     let arg0 = args.get(0).map(|arg| arg.as_str());
@@ -92,11 +229,61 @@ fn main() {
             exit(0);
         }
         (Some("compile"), Some(filename)) => {
-            match frontend::Manager::compile_main(filename.into()) {
+            // Nothing is JIT-ed, so there'd be nothing to map.
+            if perf_map {
+                eprintln!("Perf maps are only written when running with the JIT");
+                exit(-1);
+            }
+            let result = if bytecode {
+                frontend::Manager::compile_main_to_bytecode(filename.into())
+            } else {
+                frontend::Manager::compile_main(filename.into(), &options, cache.as_ref())
+            };
+            finish_reports(trace_out.as_ref(), print_stats, stats_json.as_ref());
+            match result {
                 Ok(_) => (),
                 Err(error) => handle_stage_error(error),
             }
         }
+        (Some("run"), Some(filename)) => {
+            if options.instrument.is_some() {
+                eprintln!("Instrumentation is only supported when compiling executables");
+                exit(-1);
+            }
+            // Run always uses LLVM (cached executables included), so the
+            // backend would be ignored.
+            if backend.is_some() {
+                eprintln!("Backends are only used when compiling executables");
+                exit(-1);
+            }
+            let result = if filename.ends_with(".hbc") {
+                compiler::bytecode::run_file(Path::new(filename))
+                    .map_err(|err| StageError::Interpreter(err))
+            } else {
+                let engine = if interp {
+                    Engine::Interpreter
+                } else if vm {
+                    Engine::Vm
+                } else if tiered {
+                    Engine::Tiered
+                } else if hot_reload {
+                    Engine::HotReload
+                } else {
+                    Engine::Jit
+                };
+                // Perf maps are written by the in-process JIT, so a cached
+                // executable wouldn't have one.
+                let cache = if perf_map { None } else { cache.as_ref() };
+                frontend::Manager::run_main(filename.into(), engine, &options, cache)
+            };
+            finish_reports(trace_out.as_ref(), print_stats, stats_json.as_ref());
+            match result {
+                // Exit with whatever main returned, same as a compiled executable.
+                Ok(status) => exit(status as i32),
+                Err(error) => handle_stage_error(error),
+            }
+        }
+        (Some("repl"), None) => frontend::run_repl(),
         (Some("ast"), Some(filename)) => {
             let manager = frontend::Manager::new();
             match manager.load(filename.into()) {
@@ -134,37 +321,3 @@ fn main() {
     // let printer = Printer::new_with_options(std::io::stdout(), PrinterOptions { print_pointers });
     // printer.print_module(type_ast).unwrap();
 }
-
-fn print_type_error(error: TypeError, filename: String, source: String) {
-    use codespan::{Files, Span as CodeSpan};
-    use codespan_reporting::diagnostic::{Diagnostic, Label};
-
-    use TypeError::*;
-
-    let (error, span) = (error.unwrap(), error.span());
-
-    if let Some(span) = span {
-        let mut files = Files::new();
-        let file_id = files.add(filename, source);
-
-        let mut diagnostic = Diagnostic::new_error(
-            error.short_message(),
-            Label::new(
-                file_id,
-                CodeSpan::new(span.start.index, span.end.index),
-                error.label_message(),
-            ),
-        );
-        if let Some(notes) = error.notes() {
-            diagnostic = diagnostic.with_notes(vec![notes]);
-        }
-
-        let config = codespan_reporting::term::Config::default();
-        let mut writer = termcolor::StandardStream::stderr(termcolor::ColorChoice::Auto);
-        codespan_reporting::term::emit(&mut writer, &config, &files, &diagnostic).unwrap();
-    } else {
-        // If we don't have a span then just report the error.
-        eprintln!("{:#?}", error);
-    }
-    exit(-1)
-}
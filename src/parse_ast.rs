@@ -50,6 +50,15 @@ pub struct Func {
     pub span: Span,
 }
 
+/// An immutable binding, eg. `let foo = bar`. Unlike a `var` it must be
+/// initialized.
+#[derive(Clone, Debug, PartialEq)]
+pub struct Let {
+    pub name: Word,
+    pub initializer: Expression,
+    pub span: Span,
+}
+
 #[derive(Clone, Debug, PartialEq)]
 pub struct Var {
     pub name: Word,
@@ -63,12 +72,28 @@ pub struct Import {
     pub span: Span,
 }
 
+/// A value type with named fields, eg.
+///
+///     struct Point {
+///       x: Int
+///       y: Int
+///     }
+///
+/// Fields are separated by newlines or commas.
 #[derive(Clone, Debug, PartialEq)]
 pub struct Struct {
     pub name: Word,
+    pub fields: Vec<StructField>,
     pub span: Span,
 }
 
+#[derive(Clone, Debug, PartialEq)]
+pub struct StructField {
+    pub name: Word,
+    /// Name of the field's class.
+    pub typ: Word,
+}
+
 #[derive(Clone, Debug, PartialEq)]
 pub struct Block {
     pub statements: Vec<BlockStatement>,
@@ -77,20 +102,40 @@ pub struct Block {
 
 #[derive(Clone, Debug, PartialEq)]
 pub enum BlockStatement {
+    Assignment(Assignment),
     CommentLine(CommentLine),
     Expression(Expression),
+    Let(Let),
     Var(Var),
     Func(Func),
+    While(While),
+}
+
+/// Assigning a new value to a `var`, eg. `foo = bar`.
+#[derive(Clone, Debug, PartialEq)]
+pub struct Assignment {
+    pub name: Word,
+    pub value: Expression,
+    pub span: Span,
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct While {
+    pub condition: Expression,
+    pub block: Block,
+    pub span: Span,
 }
 
 #[derive(Clone, Debug, PartialEq)]
 pub enum Expression {
     Closure(Closure),
     Identifier(Identifier),
+    If(If),
     Infix(Infix),
     LiteralInt(LiteralInt),
     PostfixCall(PostfixCall),
     PostfixProperty(PostfixProperty),
+    Tuple(Tuple),
 }
 
 impl Expression {
@@ -99,6 +144,7 @@ impl Expression {
         match self {
             Closure(closure) => closure.span.clone(),
             Identifier(identifier) => identifier.name.span.clone(),
+            If(if_) => if_.span.clone(),
             Infix(infix) => {
                 let start = infix.lhs.span().start;
                 let end = infix.rhs.span().end;
@@ -107,6 +153,7 @@ impl Expression {
             LiteralInt(literal) => literal.span.clone(),
             PostfixCall(call) => call.span.clone(),
             PostfixProperty(property) => property.span.clone(),
+            Tuple(tuple) => tuple.span.clone(),
         }
     }
 }
@@ -116,6 +163,16 @@ pub struct Identifier {
     pub name: Word,
 }
 
+/// `if` is an expression: its value is the value of whichever block ran. An
+/// `else if` is an `else` block containing just another `If`.
+#[derive(Clone, Debug, PartialEq)]
+pub struct If {
+    pub condition: Box<Expression>,
+    pub block: Block,
+    pub els: Option<Block>,
+    pub span: Span,
+}
+
 #[derive(Clone, Debug, PartialEq)]
 pub struct Infix {
     pub lhs: Box<Expression>,
@@ -142,3 +199,11 @@ pub struct PostfixProperty {
     pub property: Word,
     pub span: Span,
 }
+
+/// `()` is the unit tuple and `(a,)` a tuple with one member; `(a)` on its
+/// own is just a group.
+#[derive(Clone, Debug, PartialEq)]
+pub struct Tuple {
+    pub members: Vec<Expression>,
+    pub span: Span,
+}
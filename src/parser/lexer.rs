@@ -100,26 +100,37 @@ pub struct Word {
 #[derive(Clone, Debug, PartialEq)]
 pub enum Token {
     Arrow(Location),
+    BangEquals(Location),
     BraceLeft(Location),
     BraceRight(Location),
+    Colon(Location),
     Comma(Location),
     CommentLine(String, Span),
     Dot(Location),
+    Else(Location),
     EOF(Location),
     Equals(Location),
+    EqualsEquals(Location),
     Func(Location),
+    GreaterThan(Location),
+    GreaterThanEquals(Location),
+    If(Location),
     Import(Location),
+    LessThan(Location),
+    LessThanEquals(Location),
     Minus(Location),
     Newline(Location),
     Let(Location),
     LiteralInt(LiteralInt),
     ParenthesesLeft(Location),
     ParenthesesRight(Location),
+    Percent(Location),
     Plus(Location),
     Slash(Location),
     Star(Location),
     Struct(Location),
     Var(Location),
+    While(Location),
     Word(Word),
 }
 
@@ -131,31 +142,51 @@ impl Token {
             LiteralInt(literal) => literal.span.start.clone(),
             Word(word) => word.span.start.clone(),
             Arrow(location)
+            | BangEquals(location)
             | BraceLeft(location)
             | BraceRight(location)
+            | Colon(location)
             | Comma(location)
             | Dot(location)
+            | Else(location)
             | EOF(location)
             | Equals(location)
+            | EqualsEquals(location)
             | Func(location)
+            | GreaterThan(location)
+            | GreaterThanEquals(location)
+            | If(location)
             | Import(location)
+            | LessThan(location)
+            | LessThanEquals(location)
             | Minus(location)
             | Newline(location)
             | Let(location)
             | ParenthesesLeft(location)
             | ParenthesesRight(location)
+            | Percent(location)
             | Plus(location)
             | Slash(location)
             | Star(location)
             | Struct(location)
-            | Var(location) => location.clone(),
+            | Var(location)
+            | While(location) => location.clone(),
         }
     }
 
     pub fn to_string(&self) -> String {
         use Token::*;
         match self {
+            BangEquals(_) => "!=",
+            EqualsEquals(_) => "==",
+            GreaterThan(_) => ">",
+            GreaterThanEquals(_) => ">=",
+            LessThan(_) => "<",
+            LessThanEquals(_) => "<=",
+            Minus(_) => "-",
+            Percent(_) => "%",
             Plus(_) => "+",
+            Slash(_) => "/",
             Star(_) => "*",
             _ => unreachable!("Cannot stringify: {:?}", self),
         }
@@ -165,6 +196,14 @@ impl Token {
     pub fn same_variant_as(&self, other: &Token) -> bool {
         use Token::*;
         match (self, other) {
+            (BangEquals(_), BangEquals(_)) => true,
+            (EqualsEquals(_), EqualsEquals(_)) => true,
+            (GreaterThan(_), GreaterThan(_)) => true,
+            (GreaterThanEquals(_), GreaterThanEquals(_)) => true,
+            (LessThan(_), LessThan(_)) => true,
+            (LessThanEquals(_), LessThanEquals(_)) => true,
+            (Minus(_), Minus(_)) => true,
+            (Percent(_), Percent(_)) => true,
             (Plus(_), Plus(_)) => true,
             (Slash(_), Slash(_)) => true,
             (Star(_), Star(_)) => true,
@@ -239,11 +278,19 @@ impl TokenStream {
             match character {
                 '{' => Token::BraceLeft(location),
                 '}' => Token::BraceRight(location),
+                ':' => Token::Colon(location),
                 ',' => Token::Comma(location),
                 '.' => Token::Dot(location),
-                '=' => Token::Equals(location),
+                '=' => self.lex_with_equals(location, Token::Equals, Token::EqualsEquals),
+                '<' => self.lex_with_equals(location, Token::LessThan, Token::LessThanEquals),
+                '>' => self.lex_with_equals(location, Token::GreaterThan, Token::GreaterThanEquals),
+                '!' if self.input.peek() == '=' => {
+                    self.input.read();
+                    Token::BangEquals(location)
+                }
                 '(' => Token::ParenthesesLeft(location),
                 ')' => Token::ParenthesesRight(location),
+                '%' => Token::Percent(location),
                 '+' => Token::Plus(location),
                 '\n' => Token::Newline(location),
                 '/' => Token::Slash(location),
@@ -258,10 +305,14 @@ impl TokenStream {
         let (tail, end) = self.input.read_while(word_tail);
         let name = head.to_string() + &tail;
         match name.as_str() {
+            "else" => Token::Else(start),
             "func" => Token::Func(start),
+            "if" => Token::If(start),
             "import" => Token::Import(start),
             "struct" => Token::Struct(start),
+            "let" => Token::Let(start),
             "var" => Token::Var(start),
+            "while" => Token::While(start),
             _ => Token::Word(Word {
                 name,
                 span: Span::new(start, end),
@@ -285,6 +336,22 @@ impl TokenStream {
         })
     }
 
+    /// Lex an operator which has a second form ending with `=` (eg. `<` and
+    /// `<=`).
+    fn lex_with_equals(
+        &mut self,
+        start: Location,
+        single: fn(Location) -> Token,
+        with_equals: fn(Location) -> Token,
+    ) -> Token {
+        if self.input.peek() == '=' {
+            self.input.read();
+            with_equals(start)
+        } else {
+            single(start)
+        }
+    }
+
     fn lex_slash_or_line_comment(&mut self, start: Location) -> Token {
         let next = self.input.peek();
         if next == '/' {
@@ -363,6 +430,22 @@ mod tests {
         );
     }
 
+    #[test]
+    fn test_parse_operators() {
+        assert_eq!(
+            parse("<= = == != % :"),
+            vec![
+                Token::LessThanEquals(Location::new(0, 1, 1)),
+                Token::Equals(Location::new(3, 1, 4)),
+                Token::EqualsEquals(Location::new(5, 1, 6)),
+                Token::BangEquals(Location::new(8, 1, 9)),
+                Token::Percent(Location::new(11, 1, 12)),
+                Token::Colon(Location::new(13, 1, 14)),
+                Token::EOF(Location::new(14, 1, 15))
+            ]
+        );
+    }
+
     #[test]
     fn test_parse_words() {
         assert_eq!(
@@ -91,6 +91,7 @@ fn parse_module_statement(input: &mut TokenStream) -> ParseResult<Option<ModuleS
         Token::Func(_) => Some(ModuleStatement::Func(expect_func(input)?)),
         Token::Import(_) => Some(expect_import(input)?),
         Token::Newline(_) => None,
+        Token::Struct(_) => Some(ModuleStatement::Struct(expect_struct(input)?)),
         _ => return Err(ParseError::new_unexpected(vec!["None".to_string()], next)),
     })
 }
@@ -112,15 +113,72 @@ fn expect_block(input: &mut TokenStream) -> ParseResult<Block> {
 }
 
 fn parse_block_statement(input: &mut TokenStream) -> ParseResult<Option<BlockStatement>> {
-    // TODO: If, else, etc.
     Ok(match input.peek() {
         Token::CommentLine(_, _) => Some(BlockStatement::CommentLine(token_to_comment_line(
             input.read(),
         ))),
+        Token::Let(_) => Some(BlockStatement::Let(expect_let(input)?)),
         Token::Var(_) => Some(BlockStatement::Var(expect_var(input)?)),
         Token::Newline(_) => None,
         Token::Func(_) => Some(BlockStatement::Func(expect_func(input)?)),
-        _ => Some(BlockStatement::Expression(expect_expression(input)?)),
+        Token::While(_) => Some(BlockStatement::While(expect_while(input)?)),
+        _ => Some(expect_expression_or_assignment(input)?),
+    })
+}
+
+/// An assignment looks like an expression until the `=`.
+fn expect_expression_or_assignment(input: &mut TokenStream) -> ParseResult<BlockStatement> {
+    let expression = expect_expression(input)?;
+    let name = match (&expression, input.peek()) {
+        (Expression::Identifier(identifier), Token::Equals(_)) => identifier.name.clone(),
+        _ => return Ok(BlockStatement::Expression(expression)),
+    };
+    input.read();
+    let value = expect_expression(input)?;
+    let span = Span::new(name.span.start.clone(), value.span().end);
+    Ok(BlockStatement::Assignment(Assignment { name, value, span }))
+}
+
+fn expect_while(input: &mut TokenStream) -> ParseResult<While> {
+    let start = expect_to_read!(input, { Token::While(start) => start });
+    let condition = expect_expression(input)?;
+    let block = expect_block(input)?;
+    let span = Span::new(start, block.span.end.clone());
+    Ok(While {
+        condition,
+        block,
+        span,
+    })
+}
+
+fn expect_if(input: &mut TokenStream) -> ParseResult<If> {
+    let start = expect_to_read!(input, { Token::If(start) => start });
+    let condition = expect_expression(input)?;
+    let block = expect_block(input)?;
+    let els = if let Token::Else(_) = input.peek() {
+        input.read();
+        if let Token::If(_) = input.peek() {
+            let if_ = expect_if(input)?;
+            let span = if_.span.clone();
+            Some(Block {
+                statements: vec![BlockStatement::Expression(Expression::If(if_))],
+                span,
+            })
+        } else {
+            Some(expect_block(input)?)
+        }
+    } else {
+        None
+    };
+    let end = match &els {
+        Some(els) => els.span.end.clone(),
+        None => block.span.end.clone(),
+    };
+    Ok(If {
+        condition: Box::new(condition),
+        block,
+        els,
+        span: Span::new(start, end),
     })
 }
 
@@ -163,6 +221,19 @@ fn expect_block_terminals(input: &mut TokenStream) -> ParseResult<Vec<BlockState
     }
 }
 
+fn expect_let(input: &mut TokenStream) -> ParseResult<Let> {
+    let start = expect_to_read!(input, { Token::Let(start) => start });
+    let name = expect_to_read!(input, { Token::Word(word) => word });
+    expect_to_read!(input, { Token::Equals(_) => () });
+    let initializer = expect_expression(input)?;
+    let end = initializer.span().end.clone();
+    Ok(Let {
+        name,
+        initializer,
+        span: Span::new(start, end),
+    })
+}
+
 fn expect_var(input: &mut TokenStream) -> ParseResult<Var> {
     let start = expect_to_read!(input, { Token::Var(start) => start });
     let name = expect_to_read!(input, { Token::Word(word) => word });
@@ -188,14 +259,15 @@ fn expect_expression(input: &mut TokenStream) -> ParseResult<Expression> {
 /// A callable to parse a level of infix operations.
 type InfixParser = Box<dyn Fn(&mut TokenStream) -> ParseResult<Expression> + Send + Sync>;
 
-/// Construct an `InfixParser` which will parse infix expressions with the
-/// given token as the operator. `next` will be called to parse the left- and
-/// right-hand sides of the operator.
-fn infix_parser(token: Token, next: InfixParser) -> InfixParser {
+/// Construct an `InfixParser` which will parse infix expressions with any of
+/// the given tokens as the operator. `next` will be called to parse the left-
+/// and right-hand sides of the operator.
+fn infix_parser(tokens: Vec<Token>, next: InfixParser) -> InfixParser {
     return Box::new(move |input: &mut TokenStream| {
         let mut lhs = next(input)?;
         loop {
-            if input.peek().same_variant_as(&token) {
+            let peeked = input.peek();
+            if tokens.iter().any(|token| peeked.same_variant_as(token)) {
                 let op = input.read();
                 let rhs = next(input)?;
                 lhs = Expression::Infix(Infix {
@@ -215,10 +287,26 @@ lazy_static! {
     // Only initialize these closures once.
     static ref PARSE_INFIX: InfixParser = {
         let atom = Box::new(parse_postfix);
-        // Implement PEMDAS associativity rules.
-        let mul = infix_parser(Token::Star(Location::unknown()), atom);
-        let add = infix_parser(Token::Plus(Location::unknown()), mul);
-        add
+        let unknown = Location::unknown;
+        // Implement PEMDAS associativity rules, with comparisons binding the
+        // loosest.
+        let mul = infix_parser(
+            vec![Token::Star(unknown()), Token::Slash(unknown()), Token::Percent(unknown())],
+            atom,
+        );
+        let add = infix_parser(vec![Token::Plus(unknown()), Token::Minus(unknown())], mul);
+        let compare = infix_parser(
+            vec![
+                Token::EqualsEquals(unknown()),
+                Token::BangEquals(unknown()),
+                Token::LessThan(unknown()),
+                Token::LessThanEquals(unknown()),
+                Token::GreaterThan(unknown()),
+                Token::GreaterThanEquals(unknown()),
+            ],
+            add,
+        );
+        compare
     };
 }
 
@@ -233,7 +321,16 @@ fn parse_postfix(input: &mut TokenStream) -> ParseResult<Expression> {
         match input.peek() {
             Token::Dot(start) => {
                 input.read();
-                let property = expect_to_read!(input, { Token::Word(word) => word });
+                // Tuple members are accessed by their index (eg. `pair.0`).
+                let property = expect_to_read!(input, {
+                    Token::Word(word) => word,
+                    Token::LiteralInt(literal) => {
+                        Word {
+                            name: literal.value.to_string(),
+                            span: literal.span,
+                        }
+                    },
+                });
                 target = Expression::PostfixProperty(PostfixProperty {
                     target: Box::new(target),
                     property: property.clone(),
@@ -277,11 +374,11 @@ fn expect_postfix_call(input: &mut TokenStream, target: Expression) -> ParseResu
 }
 
 fn parse_group(input: &mut TokenStream) -> ParseResult<Expression> {
+    if let Token::If(_) = input.peek() {
+        return Ok(Expression::If(expect_if(input)?));
+    }
     let head = if let Token::ParenthesesLeft(_) = input.peek() {
-        input.read();
-        let expression = expect_expression(input)?;
-        expect_to_read!(input, { Token::ParenthesesRight(_) => () });
-        expression
+        expect_group_or_tuple(input)?
     } else {
         expect_atom(input)?
     };
@@ -304,6 +401,38 @@ fn parse_group(input: &mut TokenStream) -> ParseResult<Expression> {
     Ok(head)
 }
 
+/// A trailing comma makes a tuple out of what would otherwise be a group
+/// (eg. `(a,)`), and `()` is the unit tuple.
+fn expect_group_or_tuple(input: &mut TokenStream) -> ParseResult<Expression> {
+    let start = expect_to_read!(input, { Token::ParenthesesLeft(location) => location });
+    let mut members = vec![];
+    let mut trailing_comma = false;
+    let end = loop {
+        if let Token::ParenthesesRight(location) = input.peek() {
+            input.read();
+            break location;
+        }
+        members.push(expect_expression(input)?);
+        trailing_comma = match input.peek() {
+            Token::Comma(_) => {
+                input.read();
+                true
+            }
+            _ => false,
+        };
+        if !trailing_comma {
+            break expect_to_read!(input, { Token::ParenthesesRight(location) => location });
+        }
+    };
+    if members.len() == 1 && !trailing_comma {
+        return Ok(members.remove(0));
+    }
+    Ok(Expression::Tuple(Tuple {
+        members,
+        span: Span::new(start, end.plus_one()),
+    }))
+}
+
 /// Groups, tuples, and identifiers can all be converted to closure arguments:
 ///   (foo) -> bar         Group
 ///   (foo,) -> bar        Tuple
@@ -364,6 +493,35 @@ fn expect_func(input: &mut TokenStream) -> ParseResult<Func> {
     })
 }
 
+fn expect_struct(input: &mut TokenStream) -> ParseResult<Struct> {
+    let start = expect_to_read!(input, { Token::Struct(start) => start });
+    let name = expect_to_read!(input, { Token::Word(word) => word });
+    expect_to_read!(input, { Token::BraceLeft(_) => () });
+    let mut fields = vec![];
+    let end = loop {
+        match input.peek() {
+            Token::BraceRight(location) => {
+                input.read();
+                break location;
+            }
+            Token::Newline(_) | Token::Comma(_) => {
+                input.read();
+            }
+            _ => {
+                let name = expect_to_read!(input, { Token::Word(word) => word });
+                expect_to_read!(input, { Token::Colon(_) => () });
+                let typ = expect_to_read!(input, { Token::Word(word) => word });
+                fields.push(StructField { name, typ });
+            }
+        }
+    };
+    Ok(Struct {
+        name,
+        fields,
+        span: Span::new(start, end),
+    })
+}
+
 fn expect_import(input: &mut TokenStream) -> ParseResult<ModuleStatement> {
     let start = expect_to_read!(input, { Token::Import(start) => start });
     Ok(ModuleStatement::Import(Import {
@@ -448,7 +606,9 @@ mod tests {
     use super::super::super::parse_ast::*;
     use super::super::lexer::TokenStream;
     use super::super::{Location, Span, Token, Word};
-    use super::{expect_block, expect_expression, parse_infix, parse_module, parse_postfix};
+    use super::{
+        expect_block, expect_expression, expect_struct, parse_infix, parse_module, parse_postfix,
+    };
 
     fn input(input: &str) -> TokenStream {
         TokenStream::from_string(input.to_string())
@@ -526,6 +686,129 @@ mod tests {
         );
     }
 
+    #[test]
+    fn test_parse_comparison() {
+        let literal = |value| {
+            Box::new(Expression::LiteralInt(LiteralInt {
+                value,
+                span: Span::unknown(),
+            }))
+        };
+        assert_eq!(
+            parse_infix(&mut input("1 - 2 % 3 < 4")),
+            Ok(Expression::Infix(Infix {
+                lhs: Box::new(Expression::Infix(Infix {
+                    lhs: literal(1),
+                    op: Token::Minus(Location::unknown()),
+                    rhs: Box::new(Expression::Infix(Infix {
+                        lhs: literal(2),
+                        op: Token::Percent(Location::unknown()),
+                        rhs: literal(3),
+                    })),
+                })),
+                op: Token::LessThan(Location::unknown()),
+                rhs: literal(4),
+            }))
+        );
+    }
+
+    #[test]
+    fn test_parse_let() {
+        assert_eq!(
+            expect_block(&mut input("{\n  let a = b\n}")),
+            Ok(Block {
+                statements: vec![BlockStatement::Let(Let {
+                    name: word("a"),
+                    initializer: Expression::Identifier(Identifier { name: word("b") }),
+                    span: Span::unknown(),
+                })],
+                span: Span::unknown(),
+            })
+        );
+        assert!(expect_block(&mut input("{\n  let a\n}")).is_err());
+    }
+
+    #[test]
+    fn test_parse_tuple() {
+        let identifier = |name| Expression::Identifier(Identifier { name: word(name) });
+        let tuple = |members| {
+            Expression::Tuple(Tuple {
+                members,
+                span: Span::unknown(),
+            })
+        };
+        assert_eq!(expect_expression(&mut input("(a)")), Ok(identifier("a")));
+        assert_eq!(expect_expression(&mut input("()")), Ok(tuple(vec![])));
+        assert_eq!(
+            expect_expression(&mut input("(a,)")),
+            Ok(tuple(vec![identifier("a")]))
+        );
+        assert_eq!(
+            parse_postfix(&mut input("(a, b).1")),
+            Ok(Expression::PostfixProperty(PostfixProperty {
+                target: Box::new(tuple(vec![identifier("a"), identifier("b")])),
+                property: word("1"),
+                span: Span::unknown(),
+            }))
+        );
+    }
+
+    #[test]
+    fn test_parse_struct() {
+        let field = |name, typ| StructField {
+            name: word(name),
+            typ: word(typ),
+        };
+        assert_eq!(
+            expect_struct(&mut input(
+                "struct Point {\n  x: Int\n  y: Int, valid: Bool\n}"
+            )),
+            Ok(Struct {
+                name: word("Point"),
+                fields: vec![field("x", "Int"), field("y", "Int"), field("valid", "Bool")],
+                span: Span::unknown(),
+            })
+        );
+        assert!(expect_struct(&mut input("struct Point {\n  x\n}")).is_err());
+    }
+
+    #[test]
+    fn test_parse_control_flow() {
+        let identifier = |name| Expression::Identifier(Identifier { name: word(name) });
+        let block = |statements| Block {
+            statements,
+            span: Span::unknown(),
+        };
+        assert_eq!(
+            expect_block(&mut input("{\n  while a {\n    a = b\n  }\n}")),
+            Ok(block(vec![BlockStatement::While(While {
+                condition: identifier("a"),
+                block: block(vec![BlockStatement::Assignment(Assignment {
+                    name: word("a"),
+                    value: identifier("b"),
+                    span: Span::unknown(),
+                })]),
+                span: Span::unknown(),
+            })]))
+        );
+        assert_eq!(
+            expect_expression(&mut input("if a { b } else if b { a }")),
+            Ok(Expression::If(If {
+                condition: Box::new(identifier("a")),
+                block: block(vec![BlockStatement::Expression(identifier("b"))]),
+                els: Some(block(vec![BlockStatement::Expression(Expression::If(
+                    If {
+                        condition: Box::new(identifier("b")),
+                        block: block(vec![BlockStatement::Expression(identifier("a"))]),
+                        els: None,
+                        span: Span::unknown(),
+                    }
+                ))])),
+                span: Span::unknown(),
+            }))
+        );
+    }
+
     fn word<S: AsRef<str>>(name: S) -> Word {
         Word {
             name: name.as_ref().to_string(),
@@ -0,0 +1,225 @@
+/// Counters gathered during compilation and reported by `--stats` (or
+/// written as JSON by `--stats-json`). When a build suddenly gets slow these
+/// point at the construct that blew up.
+use std::cell::RefCell;
+use std::fmt::Write as FmtWrite;
+use std::fs;
+use std::io;
+use std::path::Path;
+
+use super::trace::push_json_string;
+
+/// How many of the largest funcs to print for each per-func counter.
+const TOP_FUNCS: usize = 10;
+
+#[derive(Default)]
+struct Stats {
+    enabled: bool,
+    unify_calls: usize,
+    unify_depth: usize,
+    unify_max_depth: usize,
+    /// Types created through `next_uid`.
+    uids: usize,
+    substitute_chains: usize,
+    substitute_chain_total: usize,
+    substitute_chain_max: usize,
+    close_calls: usize,
+    open_duplicate_calls: usize,
+    /// Specializations by qualified name of the `Func`.
+    specializations: Vec<(String, usize)>,
+    /// IR instructions by qualified name of the `FuncValue`.
+    ir_instructions: Vec<(String, usize)>,
+    /// LLVM instructions (after optimization) by function name.
+    llvm_instructions: Vec<(String, usize)>,
+}
+
+thread_local! {
+    static STATS: RefCell<Stats> = RefCell::new(Stats::default());
+}
+
+pub fn enable() {
+    STATS.with(|stats| stats.borrow_mut().enabled = true);
+}
+
+pub fn is_enabled() -> bool {
+    STATS.with(|stats| stats.borrow().enabled)
+}
+
+fn update<F: FnOnce(&mut Stats)>(update_fn: F) {
+    STATS.with(|stats| {
+        let mut stats = stats.borrow_mut();
+        if stats.enabled {
+            update_fn(&mut stats)
+        }
+    })
+}
+
+/// Tracks the recursion depth of `unify` until it's dropped.
+pub struct UnifyGuard(bool);
+
+pub fn enter_unify() -> UnifyGuard {
+    let mut entered = false;
+    update(|stats| {
+        stats.unify_calls += 1;
+        stats.unify_depth += 1;
+        stats.unify_max_depth = stats.unify_max_depth.max(stats.unify_depth);
+        entered = true;
+    });
+    UnifyGuard(entered)
+}
+
+impl Drop for UnifyGuard {
+    fn drop(&mut self) {
+        if self.0 {
+            update(|stats| stats.unify_depth -= 1);
+        }
+    }
+}
+
+pub fn count_uid() {
+    update(|stats| stats.uids += 1);
+}
+
+pub fn count_close() {
+    update(|stats| stats.close_calls += 1);
+}
+
+pub fn count_open_duplicate() {
+    update(|stats| stats.open_duplicate_calls += 1);
+}
+
+/// Record how many substitutions had to be followed to reach a type.
+pub fn record_substitute_chain(length: usize) {
+    update(|stats| {
+        stats.substitute_chains += 1;
+        stats.substitute_chain_total += length;
+        stats.substitute_chain_max = stats.substitute_chain_max.max(length);
+    });
+}
+
+pub fn record_specializations(func: String, count: usize) {
+    update(|stats| stats.specializations.push((func, count)));
+}
+
+pub fn record_ir_instructions(func: String, count: usize) {
+    update(|stats| stats.ir_instructions.push((func, count)));
+}
+
+pub fn record_llvm_instructions(function: String, count: usize) {
+    update(|stats| stats.llvm_instructions.push((function, count)));
+}
+
+impl Stats {
+    fn counters(&self) -> Vec<(&'static str, usize)> {
+        vec![
+            ("unify-calls", self.unify_calls),
+            ("unify-max-depth", self.unify_max_depth),
+            ("types-created", self.uids),
+            ("substitute-chains", self.substitute_chains),
+            ("substitute-chain-max", self.substitute_chain_max),
+            ("close-calls", self.close_calls),
+            ("open-duplicate-calls", self.open_duplicate_calls),
+        ]
+    }
+
+    fn per_func(&self) -> Vec<(&'static str, &Vec<(String, usize)>)> {
+        vec![
+            ("specializations", &self.specializations),
+            ("ir-instructions", &self.ir_instructions),
+            ("llvm-instructions", &self.llvm_instructions),
+        ]
+    }
+}
+
+/// Print the counters followed by the largest funcs for each per-func
+/// counter.
+pub fn print_report() {
+    STATS.with(|stats| {
+        let stats = stats.borrow();
+        if !stats.enabled {
+            return;
+        }
+        eprintln!("===-- Compile statistics --===");
+        for (name, value) in stats.counters() {
+            eprintln!("{:>10}  {}", value, name);
+        }
+        if stats.substitute_chains > 0 {
+            let mean = stats.substitute_chain_total as f64 / stats.substitute_chains as f64;
+            eprintln!("{:>10.2}  substitute-chain-mean", mean);
+        }
+        for (name, entries) in stats.per_func() {
+            if entries.is_empty() {
+                continue;
+            }
+            let total = entries.iter().map(|(_, count)| count).sum::<usize>();
+            eprintln!();
+            eprintln!(
+                "{:>10}  {} ({} funcs, largest first)",
+                total,
+                name,
+                entries.len()
+            );
+            let mut sorted = entries.iter().collect::<Vec<_>>();
+            sorted.sort_by(|a, b| b.1.cmp(&a.1).then_with(|| a.0.cmp(&b.0)));
+            for (func, count) in sorted.into_iter().take(TOP_FUNCS) {
+                eprintln!("{:>10}  {}", count, func);
+            }
+        }
+    })
+}
+
+pub fn write_json(path: &Path) -> io::Result<()> {
+    let json = STATS.with(|stats| to_json(&stats.borrow()));
+    fs::write(path, json)
+}
+
+fn to_json(stats: &Stats) -> String {
+    let mut json = String::from("{");
+    for (name, value) in stats.counters() {
+        push_json_string(&mut json, name);
+        write!(json, ":{},", value).unwrap();
+    }
+    let per_func = stats.per_func();
+    for (index, (name, entries)) in per_func.iter().enumerate() {
+        push_json_string(&mut json, name);
+        json.push_str(":{");
+        for (entry_index, (func, count)) in entries.iter().enumerate() {
+            if entry_index > 0 {
+                json.push(',');
+            }
+            push_json_string(&mut json, func);
+            write!(json, ":{}", count).unwrap();
+        }
+        json.push('}');
+        if index < per_func.len() - 1 {
+            json.push(',');
+        }
+    }
+    json.push_str("}\n");
+    json
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{enable, enter_unify, record_ir_instructions, to_json, STATS};
+
+    #[test]
+    fn test_unify_depth() {
+        enable();
+        {
+            let _outer = enter_unify();
+            let _inner = enter_unify();
+        }
+        let _again = enter_unify();
+        record_ir_instructions("main_main0".to_string(), 3);
+        STATS.with(|stats| {
+            let stats = stats.borrow();
+            assert_eq!(stats.unify_calls, 3);
+            assert_eq!(stats.unify_max_depth, 2);
+            assert_eq!(stats.unify_depth, 1);
+            let json = to_json(&stats);
+            assert!(json.starts_with("{\"unify-calls\":3,\"unify-max-depth\":2,"));
+            assert!(json.contains("\"ir-instructions\":{\"main_main0\":3}"));
+        });
+    }
+}
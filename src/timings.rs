@@ -0,0 +1,211 @@
+/// Wall time, CPU time and peak RSS of each stage of compilation, reported
+/// by `--time-passes`. Stages are timed exclusively: time spent in a stage
+/// nested within another one isn't also counted towards the outer one.
+use std::cell::RefCell;
+use std::mem::MaybeUninit;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+
+use super::{allocations, trace};
+
+struct Entry {
+    stage: &'static str,
+    module: Option<PathBuf>,
+    wall: Duration,
+    cpu: Duration,
+    /// Peak RSS of the whole process (in bytes) when the stage finished.
+    peak_rss: u64,
+}
+
+/// A stage that's currently running.
+struct Frame {
+    start_wall: Instant,
+    start_cpu: Duration,
+    /// Time spent in stages nested within this one.
+    nested_wall: Duration,
+    nested_cpu: Duration,
+}
+
+#[derive(Default)]
+struct Timings {
+    enabled: bool,
+    entries: Vec<Entry>,
+    stack: Vec<Frame>,
+}
+
+thread_local! {
+    static TIMINGS: RefCell<Timings> = RefCell::new(Timings::default());
+}
+
+pub fn enable() {
+    TIMINGS.with(|timings| timings.borrow_mut().enabled = true);
+}
+
+pub fn is_enabled() -> bool {
+    TIMINGS.with(|timings| timings.borrow().enabled)
+}
+
+/// Run a stage, recording how long it took if timing is enabled. The module
+/// should be given for stages which run once per module. Stages are also
+/// traced as spans and have their allocations counted.
+pub fn time<T, F: FnOnce() -> T>(stage: &'static str, module: Option<&Path>, stage_fn: F) -> T {
+    let _span = trace::span(stage, "stage", module, None);
+    let _allocations = allocations::enter(stage);
+    if !is_enabled() {
+        return stage_fn();
+    }
+    let (_, start_cpu) = resource_usage();
+    TIMINGS.with(|timings| {
+        timings.borrow_mut().stack.push(Frame {
+            start_wall: Instant::now(),
+            start_cpu,
+            nested_wall: Duration::default(),
+            nested_cpu: Duration::default(),
+        })
+    });
+
+    let result = stage_fn();
+
+    let (peak_rss, end_cpu) = resource_usage();
+    TIMINGS.with(|timings| {
+        let mut timings = timings.borrow_mut();
+        let frame = timings.stack.pop().unwrap();
+        let total_wall = frame.start_wall.elapsed();
+        let total_cpu = end_cpu.checked_sub(frame.start_cpu).unwrap_or_default();
+        if let Some(parent) = timings.stack.last_mut() {
+            parent.nested_wall += total_wall;
+            parent.nested_cpu += total_cpu;
+        }
+        timings.entries.push(Entry {
+            stage,
+            module: module.map(Path::to_path_buf),
+            wall: total_wall
+                .checked_sub(frame.nested_wall)
+                .unwrap_or_default(),
+            cpu: total_cpu.checked_sub(frame.nested_cpu).unwrap_or_default(),
+            peak_rss,
+        });
+    });
+    result
+}
+
+/// Print the totals for each stage followed by the per-module breakdown.
+pub fn print_report() {
+    TIMINGS.with(|timings| {
+        let timings = timings.borrow();
+        if !timings.enabled {
+            return;
+        }
+
+        // Stages in the order that they first ran.
+        let mut totals: Vec<(&'static str, Duration, Duration, u64)> = vec![];
+        for entry in timings.entries.iter() {
+            match totals.iter_mut().find(|total| total.0 == entry.stage) {
+                Some(total) => {
+                    total.1 += entry.wall;
+                    total.2 += entry.cpu;
+                    total.3 = total.3.max(entry.peak_rss);
+                }
+                None => totals.push((entry.stage, entry.wall, entry.cpu, entry.peak_rss)),
+            }
+        }
+        let wall = totals.iter().map(|total| total.1).sum::<Duration>();
+        let cpu = totals.iter().map(|total| total.2).sum::<Duration>();
+        let peak_rss = totals.iter().map(|total| total.3).max().unwrap_or(0);
+
+        eprintln!("===-- Compile times --===");
+        eprintln!("{:>10} {:>10} {:>10}  Stage", "Wall", "CPU", "Peak RSS");
+        for (stage, wall, cpu, peak_rss) in totals.iter() {
+            print_row(*wall, *cpu, *peak_rss, stage);
+        }
+        print_row(wall, cpu, peak_rss, "Total");
+
+        let per_module = timings
+            .entries
+            .iter()
+            .filter(|entry| entry.module.is_some())
+            .collect::<Vec<_>>();
+        if !per_module.is_empty() {
+            eprintln!();
+            eprintln!(
+                "{:>10} {:>10} {:>10}  Stage and module",
+                "Wall", "CPU", "Peak RSS"
+            );
+            for entry in per_module {
+                let label = format!(
+                    "{} {}",
+                    entry.stage,
+                    entry.module.as_ref().unwrap().display()
+                );
+                print_row(entry.wall, entry.cpu, entry.peak_rss, &label);
+            }
+        }
+    })
+}
+
+fn print_row(wall: Duration, cpu: Duration, peak_rss: u64, label: &str) {
+    eprintln!(
+        "{:>7.3} ms {:>7.3} ms {:>7.1} MB  {}",
+        wall.as_secs_f64() * 1000.0,
+        cpu.as_secs_f64() * 1000.0,
+        peak_rss as f64 / (1024.0 * 1024.0),
+        label,
+    );
+}
+
+/// Returns the peak RSS in bytes and the CPU time (user and system) used by
+/// the process so far.
+fn resource_usage() -> (u64, Duration) {
+    let usage = unsafe {
+        let mut usage = MaybeUninit::<libc::rusage>::zeroed();
+        if libc::getrusage(libc::RUSAGE_SELF, usage.as_mut_ptr()) != 0 {
+            return (0, Duration::default());
+        }
+        usage.assume_init()
+    };
+    let to_duration = |time: libc::timeval| {
+        Duration::from_secs(time.tv_sec as u64) + Duration::from_micros(time.tv_usec as u64)
+    };
+    // Linux reports kilobytes; macOS reports bytes.
+    let peak_rss = if cfg!(target_os = "macos") {
+        usage.ru_maxrss as u64
+    } else {
+        usage.ru_maxrss as u64 * 1024
+    };
+    (
+        peak_rss,
+        to_duration(usage.ru_utime) + to_duration(usage.ru_stime),
+    )
+}
+
+#[cfg(test)]
+mod tests {
+    use std::path::Path;
+    use std::time::Duration;
+
+    use super::{enable, time, TIMINGS};
+
+    #[test]
+    fn test_nested_stages_are_exclusive() {
+        enable();
+        time("outer", None, || {
+            time("inner", Some(Path::new("a.hb")), || {
+                std::thread::sleep(Duration::from_millis(50))
+            });
+        });
+        TIMINGS.with(|timings| {
+            let timings = timings.borrow();
+            let stages = timings
+                .entries
+                .iter()
+                .map(|entry| entry.stage)
+                .collect::<Vec<_>>();
+            assert_eq!(stages, vec!["inner", "outer"]);
+            // The inner stage's time isn't counted towards the outer one.
+            let (inner, outer) = (&timings.entries[0], &timings.entries[1]);
+            assert!(inner.wall >= Duration::from_millis(50));
+            assert!(outer.wall < Duration::from_millis(50));
+            assert!(outer.peak_rss > 0);
+        });
+    }
+}
@@ -0,0 +1,228 @@
+/// Spans of compilation work recorded by `--trace-out` and written in the
+/// Chrome trace event format (load it in chrome://tracing or Perfetto).
+///
+/// Spans are tagged with the module and func they're working on. A span
+/// that isn't given a module inherits the one of the span it's nested in.
+use std::cell::RefCell;
+use std::fmt::Write as FmtWrite;
+use std::fs;
+use std::io;
+use std::path::Path;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::time::Instant;
+
+struct Event {
+    name: &'static str,
+    category: &'static str,
+    module: Option<String>,
+    func: Option<String>,
+    /// Microseconds since tracing was enabled.
+    start: f64,
+    duration: f64,
+    thread: usize,
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static NEXT_THREAD_ID: AtomicUsize = AtomicUsize::new(1);
+
+lazy_static! {
+    static ref START: Instant = Instant::now();
+    static ref EVENTS: Mutex<Vec<Event>> = Mutex::new(vec![]);
+}
+
+thread_local! {
+    static THREAD_ID: usize = NEXT_THREAD_ID.fetch_add(1, Ordering::Relaxed);
+    /// Modules of the spans currently open on this thread.
+    static MODULES: RefCell<Vec<Option<String>>> = RefCell::new(vec![]);
+    /// Spans being recorded by `capture` instead of globally.
+    #[cfg(test)]
+    static CAPTURED: RefCell<Option<Vec<Event>>> = RefCell::new(None);
+}
+
+pub fn enable() {
+    lazy_static::initialize(&START);
+    ENABLED.store(true, Ordering::Relaxed);
+}
+
+pub fn is_enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+/// A span which is recorded when it's dropped.
+pub struct Span(Option<OpenSpan>);
+
+struct OpenSpan {
+    name: &'static str,
+    category: &'static str,
+    module: Option<String>,
+    func: Option<String>,
+    start: Instant,
+}
+
+/// Start a span. Does nothing (and doesn't allocate) if tracing isn't
+/// enabled.
+pub fn span(
+    name: &'static str,
+    category: &'static str,
+    module: Option<&Path>,
+    func: Option<&str>,
+) -> Span {
+    if !is_enabled() && !is_capturing() {
+        return Span(None);
+    }
+    let module = match module {
+        Some(module) => Some(module.display().to_string()),
+        None => MODULES.with(|modules| modules.borrow().last().cloned().unwrap_or(None)),
+    };
+    MODULES.with(|modules| modules.borrow_mut().push(module.clone()));
+    Span(Some(OpenSpan {
+        name,
+        category,
+        module,
+        func: func.map(str::to_string),
+        start: Instant::now(),
+    }))
+}
+
+impl Drop for Span {
+    fn drop(&mut self) {
+        let open = match self.0.take() {
+            Some(open) => open,
+            None => return,
+        };
+        let end = Instant::now();
+        MODULES.with(|modules| modules.borrow_mut().pop());
+        let micros = |instant: Instant| instant.duration_since(*START).as_secs_f64() * 1e6;
+        let event = Event {
+            name: open.name,
+            category: open.category,
+            module: open.module,
+            func: open.func,
+            start: micros(open.start),
+            duration: (end - open.start).as_secs_f64() * 1e6,
+            thread: THREAD_ID.with(|id| *id),
+        };
+        record(event);
+    }
+}
+
+#[cfg(not(test))]
+#[inline(always)]
+fn is_capturing() -> bool {
+    false
+}
+
+#[cfg(not(test))]
+fn record(event: Event) {
+    EVENTS.lock().unwrap().push(event);
+}
+
+#[cfg(test)]
+fn is_capturing() -> bool {
+    CAPTURED.with(|captured| captured.borrow().is_some())
+}
+
+#[cfg(test)]
+fn record(event: Event) {
+    CAPTURED.with(|captured| match captured.borrow_mut().as_mut() {
+        Some(events) => events.push(event),
+        None => EVENTS.lock().unwrap().push(event),
+    })
+}
+
+/// Record the spans of `f` on this thread only, so that tests running in
+/// parallel don't see each other's spans or have to enable tracing for the
+/// whole process.
+#[cfg(test)]
+fn capture<F: FnOnce()>(f: F) -> Vec<Event> {
+    lazy_static::initialize(&START);
+    CAPTURED.with(|captured| *captured.borrow_mut() = Some(vec![]));
+    f();
+    CAPTURED.with(|captured| captured.borrow_mut().take().unwrap())
+}
+
+/// Write every span recorded so far.
+pub fn write(path: &Path) -> io::Result<()> {
+    let events = EVENTS.lock().unwrap();
+    fs::write(path, to_json(&events))
+}
+
+fn to_json(events: &Vec<Event>) -> String {
+    let pid = std::process::id();
+    let mut json = String::from("{\"traceEvents\":[");
+    for (index, event) in events.iter().enumerate() {
+        if index > 0 {
+            json.push(',');
+        }
+        json.push_str("\n{\"name\":");
+        push_json_string(&mut json, event.name);
+        json.push_str(",\"cat\":");
+        push_json_string(&mut json, event.category);
+        write!(
+            json,
+            ",\"ph\":\"X\",\"ts\":{:.3},\"dur\":{:.3},\"pid\":{},\"tid\":{},\"args\":{{",
+            event.start, event.duration, pid, event.thread
+        )
+        .unwrap();
+        let mut first = true;
+        for (key, value) in [("module", &event.module), ("func", &event.func)].iter() {
+            if let Some(value) = value {
+                if !first {
+                    json.push(',');
+                }
+                first = false;
+                push_json_string(&mut json, key);
+                json.push(':');
+                push_json_string(&mut json, value);
+            }
+        }
+        json.push_str("}}");
+    }
+    json.push_str("\n],\"displayTimeUnit\":\"ms\"}\n");
+    json
+}
+
+/// Append a string literal to some JSON.
+pub fn push_json_string(json: &mut String, string: &str) {
+    json.push('"');
+    for character in string.chars() {
+        match character {
+            '"' => json.push_str("\\\""),
+            '\\' => json.push_str("\\\\"),
+            '\n' => json.push_str("\\n"),
+            character if (character as u32) < 0x20 => {
+                write!(json, "\\u{:04x}", character as u32).unwrap()
+            }
+            character => json.push(character),
+        }
+    }
+    json.push('"');
+}
+
+#[cfg(test)]
+mod tests {
+    use std::path::Path;
+
+    use super::{capture, span, to_json};
+
+    #[test]
+    fn test_nested_spans_inherit_module() {
+        let events = capture(|| {
+            let _load = span("load", "frontend", Some(Path::new("a\"b.hb")), None);
+            let _func = span("type-check", "type", None, Some("main"));
+        });
+        // Spans are recorded as they finish, so inner ones come first.
+        let func = events
+            .iter()
+            .find(|event| event.name == "type-check")
+            .unwrap();
+        assert_eq!(func.module.as_ref().unwrap(), "a\"b.hb");
+        assert_eq!(func.func.as_ref().unwrap(), "main");
+
+        let json = to_json(&events);
+        assert!(json.starts_with("{\"traceEvents\":["));
+        assert!(json.contains("\"args\":{\"module\":\"a\\\"b.hb\",\"func\":\"main\"}"));
+        assert!(json.contains("\"name\":\"load\",\"cat\":\"frontend\",\"ph\":\"X\""));
+    }
+}
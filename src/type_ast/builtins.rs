@@ -16,6 +16,7 @@ lazy_static! {
             };
             builtins.insert(name.to_string(), Class::Intrinsic(Arc::new(class)));
         };
+        instrinsic("Bool");
         instrinsic("Int");
 
         Builtins(Arc::new(builtins))
@@ -26,10 +26,10 @@ pub use builtins::Builtins;
 pub use nodes::*;
 pub use printer::{Printer, PrinterOptions};
 pub use scope::{ClosureScope, ModuleScope, Scope, ScopeLike, ScopeResolution};
-pub use translate::translate_module;
+pub use translate::{translate_module, translate_module_in_scope};
 pub use typ::{
-    Class, Func as TFunc, Generic, GenericConstraint, IntrinsicClass, PropertyConstraint, Type,
-    TypeId, Variable,
+    Class, DerivedClass, Field, Func as TFunc, Generic, GenericConstraint, IntrinsicClass,
+    PropertyConstraint, Type, TypeId, Variable,
 };
 pub use unify::unify;
 
@@ -43,9 +43,19 @@ pub enum TypeError {
     LocalNotFound {
         name: String,
     },
+    /// A field's type names a class that isn't a builtin or a struct defined
+    /// earlier in the module.
+    ClassNotFound {
+        name: String,
+    },
     CannotCapture {
         name: String,
     },
+    /// Assigning to something that isn't a `var` in the current func (eg.
+    /// a `let` binding).
+    CannotAssign {
+        name: String,
+    },
     // PropertyAlreadyDefined {
     //     name: String,
     // },
@@ -61,6 +71,12 @@ pub enum TypeError {
         expected: Vec<Type>,
         got: Vec<Type>,
     },
+    /// Getting a property that the type doesn't have (eg. an index past the
+    /// end of a tuple).
+    PropertyNotFound {
+        name: String,
+        typ: Type,
+    },
     /// When we try to `Type#close` and run into an `Unbound`.
     UnexpectedUnbound {
         id: usize,
@@ -96,11 +112,14 @@ impl TypeError {
         let message = match self.unwrap() {
             LocalAlreadyDefined { .. } => "LocalAlreadyDefined",
             LocalNotFound { .. } => "LocalNotFound",
+            ClassNotFound { .. } => "ClassNotFound",
             CannotCapture { .. } => "CannotCapture",
+            CannotAssign { .. } => "CannotAssign",
             // PropertyAlreadyDefined { .. } => "PropertyAlreadyDefined",
             CannotUnify { .. } => "CannotUnify",
             TypeMismatch { .. } => "TypeMismatch",
             ArgumentLengthMismatch { .. } => "ArgumentLengthMismatch",
+            PropertyNotFound { .. } => "PropertyNotFound",
             UnexpectedUnbound { .. } => "UnexpectedUnbound",
             InternalError { .. } => "InternalError",
             WithSpan { .. } => unreachable!(),
@@ -112,8 +131,10 @@ impl TypeError {
         use TypeError::*;
         match self.unwrap() {
             CannotCapture { .. } => "Attempted to capture here".to_string(),
+            CannotAssign { .. } => "Attempted to assign here".to_string(),
             CannotUnify { .. } => "Trying to unify here".to_string(),
             TypeMismatch { .. } => "Mismatch occurred here".to_string(),
+            PropertyNotFound { name, .. } => format!("No property `{}` here", name),
             InternalError { message } => message.clone(),
             WithSpan { .. } => unreachable!(),
             _ => "Here".to_string(),
@@ -131,6 +152,13 @@ impl TypeError {
                         .to_string(),
                 )
             }
+            CannotAssign { .. } => {
+                return Some(
+                    "Only locals declared with `var` can be assigned to; `let` bindings \
+                    are immutable."
+                        .to_string(),
+                )
+            }
             _ => (),
         }
         None
@@ -140,18 +140,24 @@ impl Closable for Block {
 
 #[derive(Clone, Debug)]
 pub enum BlockStatement {
+    Assignment(Assignment),
     Expression(Expression),
     Func(Func),
+    Let(Let),
     Var(Var),
+    While(While),
 }
 
 impl BlockStatement {
     pub fn typ(&self) -> Type {
         use BlockStatement::*;
         match self {
+            Assignment(assignment) => assignment.typ.clone(),
             Expression(expression) => expression.typ().clone(),
             Func(func) => func.typ.clone(),
+            Let(let_) => let_.typ.clone(),
             Var(var) => var.typ.clone(),
+            While(while_) => while_.typ.clone(),
         }
     }
 }
@@ -160,9 +166,66 @@ impl Closable for BlockStatement {
     fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
         use BlockStatement::*;
         Ok(match self {
+            Assignment(assignment) => Assignment(assignment.close(tracker, scope)?),
             Expression(expression) => Expression(expression.close(tracker, scope)?),
             Func(func) => Func(func.close(tracker, scope)?),
+            Let(let_) => Let(let_.close(tracker, scope)?),
             Var(var) => Var(var.close(tracker, scope)?),
+            While(while_) => While(while_.close(tracker, scope)?),
+        })
+    }
+}
+
+#[derive(Clone, Debug)]
+pub struct Assignment {
+    pub name: Word,
+    pub value: Expression,
+    /// Always unit.
+    pub typ: Type,
+}
+
+impl Closable for Assignment {
+    fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
+        Ok(Assignment {
+            name: self.name,
+            value: self.value.close(tracker, scope.clone())?,
+            typ: self.typ.close(tracker, scope)?,
+        })
+    }
+}
+
+/// An immutable binding; see `Scope::add_let`.
+#[derive(Clone, Debug)]
+pub struct Let {
+    pub name: Word,
+    pub initializer: Expression,
+    pub typ: Type,
+}
+
+impl Closable for Let {
+    fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
+        Ok(Let {
+            name: self.name,
+            initializer: self.initializer.close(tracker, scope.clone())?,
+            typ: self.typ.close(tracker, scope)?,
+        })
+    }
+}
+
+#[derive(Clone, Debug)]
+pub struct While {
+    pub condition: Expression,
+    pub block: Block,
+    /// Always unit.
+    pub typ: Type,
+}
+
+impl Closable for While {
+    fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
+        Ok(While {
+            condition: self.condition.close(tracker, scope.clone())?,
+            block: self.block.close(tracker, scope.clone())?,
+            typ: self.typ.close(tracker, scope)?,
         })
     }
 }
@@ -192,10 +255,13 @@ impl Closable for Var {
 pub enum Expression {
     Closure(Closure),
     Identifier(Identifier),
+    If(If),
     Infix(Infix),
     LiteralInt(LiteralInt),
     PostfixCall(PostfixCall),
     PostfixProperty(PostfixProperty),
+    StructLiteral(StructLiteral),
+    Tuple(Tuple),
 }
 
 impl Expression {
@@ -204,10 +270,13 @@ impl Expression {
         match self {
             Closure(closure) => &closure.typ,
             Identifier(identifier) => &identifier.typ,
+            If(if_) => &if_.typ,
             Infix(infix) => &infix.typ,
             LiteralInt(literal) => &literal.typ,
             PostfixCall(call) => &call.typ,
             PostfixProperty(property) => &property.typ,
+            StructLiteral(literal) => &literal.typ,
+            Tuple(tuple) => &tuple.typ,
         }
     }
 }
@@ -218,10 +287,13 @@ impl Closable for Expression {
         Ok(match self {
             Closure(closure) => Closure(closure.close(tracker, scope)?),
             Identifier(identifier) => Identifier(identifier.close(tracker, scope)?),
+            If(if_) => If(if_.close(tracker, scope)?),
             Infix(infix) => Infix(infix.close(tracker, scope)?),
             literal @ LiteralInt(_) => literal,
             PostfixCall(call) => PostfixCall(call.close(tracker, scope)?),
             PostfixProperty(property) => PostfixProperty(property.close(tracker, scope)?),
+            StructLiteral(literal) => StructLiteral(literal.close(tracker, scope)?),
+            Tuple(tuple) => Tuple(tuple.close(tracker, scope)?),
         })
     }
 }
@@ -243,6 +315,30 @@ impl Closable for Identifier {
     }
 }
 
+#[derive(Clone, Debug)]
+pub struct If {
+    pub condition: Box<Expression>,
+    pub block: Block,
+    pub els: Option<Block>,
+    /// The type of both blocks if there's an `else`, otherwise unit.
+    pub typ: Type,
+}
+
+impl Closable for If {
+    fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
+        let els = match self.els {
+            Some(els) => Some(els.close(tracker, scope.clone())?),
+            None => None,
+        };
+        Ok(If {
+            condition: Box::new(self.condition.close(tracker, scope.clone())?),
+            block: self.block.close(tracker, scope.clone())?,
+            els,
+            typ: self.typ.close(tracker, scope)?,
+        })
+    }
+}
+
 #[derive(Clone, Debug)]
 pub struct Infix {
     pub lhs: Box<Expression>,
@@ -309,3 +405,44 @@ impl Closable for PostfixProperty {
         })
     }
 }
+
+/// Constructing a struct by calling it with its fields, eg. `Point(1, 2)`.
+#[derive(Clone, Debug)]
+pub struct StructLiteral {
+    pub name: Word,
+    /// In the order the struct declares them.
+    pub fields: Vec<Expression>,
+    pub typ: Type,
+}
+
+impl Closable for StructLiteral {
+    fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
+        let mut fields = vec![];
+        for field in self.fields.into_iter() {
+            fields.push(field.close(tracker, scope.clone())?);
+        }
+        let typ = self.typ.close(tracker, scope)?;
+        Ok(StructLiteral {
+            name: self.name,
+            fields,
+            typ,
+        })
+    }
+}
+
+#[derive(Clone, Debug)]
+pub struct Tuple {
+    pub members: Vec<Expression>,
+    pub typ: Type,
+}
+
+impl Closable for Tuple {
+    fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
+        let mut members = vec![];
+        for member in self.members.into_iter() {
+            members.push(member.close(tracker, scope.clone())?);
+        }
+        let typ = self.typ.close(tracker, scope)?;
+        Ok(Tuple { members, typ })
+    }
+}
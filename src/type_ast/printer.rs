@@ -249,6 +249,15 @@ impl<O: Write> Printer<O> {
         Ok(())
     }
 
+    fn print_let(&self, let_: &Let) -> Result<()> {
+        self.lnwrite(format!("let {}: ", &let_.name.name))?;
+        self.write_type(&let_.typ, true)?;
+        self.indented(|| {
+            self.write(" =")?;
+            self.print_expression(&let_.initializer)
+        })
+    }
+
     fn print_block(&self, block: &Block) -> Result<()> {
         self.iwrite("Block {")?;
         if block.statements.is_empty() {
@@ -260,11 +269,14 @@ impl<O: Write> Printer<O> {
             for statement in block.statements.iter() {
                 use BlockStatement::*;
                 match statement {
+                    Assignment(assignment) => self.print_assignment(assignment)?,
                     Expression(expression) => {
                         self.print_expression(expression)?;
                     }
                     Func(func) => self.print_func(func)?,
+                    Let(let_) => self.print_let(let_)?,
                     Var(var) => self.print_var(var, false)?,
+                    While(while_) => self.print_while(while_)?,
                 }
             }
             Ok(())
@@ -272,15 +284,39 @@ impl<O: Write> Printer<O> {
         self.writeln("}")
     }
 
+    fn print_assignment(&self, assignment: &Assignment) -> Result<()> {
+        self.writeln("Assignment {")?;
+        self.indented(|| {
+            writeln!(self, "name: {}", assignment.name.name)?;
+            self.writeln("value:")?;
+            self.indented(|| self.print_expression(&assignment.value))
+        })?;
+        self.writeln("}")
+    }
+
+    fn print_while(&self, while_: &While) -> Result<()> {
+        self.writeln("While {")?;
+        self.indented(|| {
+            self.writeln("condition:")?;
+            self.indented(|| self.print_expression(&while_.condition))?;
+            self.writeln("block:")?;
+            self.indented(|| self.print_block(&while_.block))
+        })?;
+        self.writeln("}")
+    }
+
     fn print_expression(&self, expression: &Expression) -> Result<()> {
         use Expression::*;
         match expression {
             Closure(closure) => self.print_closure(closure),
             Identifier(identifier) => self.print_identifier(identifier),
+            If(if_) => self.print_if(if_),
             Infix(infix) => self.print_infix(infix),
             LiteralInt(literal) => self.print_literal_int(literal),
             PostfixCall(call) => self.print_postfix_call(call),
             PostfixProperty(property) => self.print_postfix_property(property),
+            StructLiteral(literal) => self.print_struct_literal(literal),
+            Tuple(tuple) => self.print_tuple(tuple),
         }
     }
 
@@ -336,6 +372,24 @@ impl<O: Write> Printer<O> {
         self.writeln("}")
     }
 
+    fn print_if(&self, if_: &If) -> Result<()> {
+        self.writeln("If {")?;
+        self.indented(|| {
+            self.writeln("condition:")?;
+            self.indented(|| self.print_expression(&if_.condition))?;
+            self.writeln("block:")?;
+            self.indented(|| self.print_block(&if_.block))?;
+            if let Some(els) = &if_.els {
+                self.writeln("else:")?;
+                self.indented(|| self.print_block(els))?;
+            }
+            self.iwrite("typ: ")?;
+            self.write_type(&if_.typ, false)?;
+            self.write("\n")
+        })?;
+        self.writeln("}")
+    }
+
     fn print_infix(&self, infix: &Infix) -> Result<()> {
         self.writeln("Infix {")?;
         self.indented(|| {
@@ -389,6 +443,53 @@ impl<O: Write> Printer<O> {
         self.writeln("}")
     }
 
+    fn print_struct_literal(&self, literal: &StructLiteral) -> Result<()> {
+        self.writeln("StructLiteral {")?;
+        self.indented(|| {
+            writeln!(self, "name: {}", literal.name.name)?;
+            self.iwrite("fields: [")?;
+            if !literal.fields.is_empty() {
+                self.write("\n")?;
+                self.indented(|| {
+                    for field in literal.fields.iter() {
+                        self.print_expression(field)?;
+                    }
+                    Ok(())
+                })?;
+                self.writeln("]")?;
+            } else {
+                self.write("]\n")?;
+            }
+            self.iwrite("typ: ")?;
+            self.write_type(&literal.typ, true)?;
+            self.write("\n")
+        })?;
+        self.writeln("}")
+    }
+
+    fn print_tuple(&self, tuple: &nodes::Tuple) -> Result<()> {
+        self.writeln("Tuple {")?;
+        self.indented(|| {
+            self.iwrite("members: [")?;
+            if !tuple.members.is_empty() {
+                self.write("\n")?;
+                self.indented(|| {
+                    for member in tuple.members.iter() {
+                        self.print_expression(member)?;
+                    }
+                    Ok(())
+                })?;
+                self.writeln("]")?;
+            } else {
+                self.write("]\n")?;
+            }
+            self.iwrite("typ: ")?;
+            self.write_type(&tuple.typ, true)?;
+            self.write("\n")
+        })?;
+        self.writeln("}")
+    }
+
     /// Write a string.
     fn write<S: AsRef<str>>(&self, string: S) -> Result<()> {
         self.write_output(string.as_ref().as_bytes())
@@ -3,7 +3,7 @@ use std::collections::{HashMap, HashSet};
 use std::fmt::{Error, Formatter};
 use std::rc::Rc;
 
-use super::{Closable, RecursionTracker, Type, TypeError, TypeResult};
+use super::{Class, Closable, RecursionTracker, Type, TypeError, TypeResult};
 
 /// Proxy so that we can share different kinds of scopes.
 #[derive(Clone, Debug)]
@@ -47,6 +47,74 @@ impl Scope {
         }
     }
 
+    /// Adds a local bound with `let`. It can't be assigned to and is only
+    /// visible until `remove_let` is called at the end of its block.
+    pub fn add_let(&self, name: &str, typ: Type) -> TypeResult<()> {
+        self.add_local(name, typ)?;
+        use Scope::*;
+        match self {
+            Closure(closure) => closure.borrow_mut().lets.insert(name.to_string()),
+            Func(func) => func.borrow_mut().lets.insert(name.to_string()),
+            Module(_) => unreachable!("Cannot bind a let in a module"),
+        };
+        Ok(())
+    }
+
+    pub fn is_let(&self, name: &str) -> bool {
+        use Scope::*;
+        match self {
+            Closure(closure) => closure.borrow().lets.contains(name),
+            Func(func) => func.borrow().lets.contains(name),
+            Module(_) => false,
+        }
+    }
+
+    /// Lets never get a slot in the stack frame so they're removed from the
+    /// locals once they go out of scope.
+    pub fn remove_let(&self, name: &str) {
+        use Scope::*;
+        match self {
+            Closure(closure) => {
+                let mut closure = closure.borrow_mut();
+                closure.lets.remove(name);
+                closure.locals.remove(name);
+            }
+            Func(func) => {
+                let mut func = func.borrow_mut();
+                func.lets.remove(name);
+                func.locals.remove(name);
+            }
+            Module(_) => unreachable!("Cannot bind a let in a module"),
+        }
+    }
+
+    /// Structs live in their own namespace at the module level, so they're
+    /// visible from every scope in the module.
+    pub fn add_struct(&self, name: &str, class: Class) -> TypeResult<()> {
+        match self {
+            Scope::Module(module) => {
+                let mut module = module.borrow_mut();
+                if module.structs.contains_key(name) {
+                    return Err(TypeError::LocalAlreadyDefined {
+                        name: name.to_string(),
+                    });
+                }
+                module.structs.insert(name.to_string(), class);
+                Ok(())
+            }
+            other @ _ => unreachable!("Cannot define a struct in: {:?}", other),
+        }
+    }
+
+    pub fn get_struct(&self, name: &str) -> Option<Class> {
+        match self {
+            Scope::Module(module) => module.borrow().structs.get(name).cloned(),
+            other @ _ => other
+                .get_parent()
+                .and_then(|parent| parent.get_struct(name)),
+        }
+    }
+
     fn get_parent(&self) -> Option<Scope> {
         use Scope::*;
         match self {
@@ -106,6 +174,7 @@ impl Closable for Scope {
                         captures: closure.captures,
                         captured: closure.captured,
                         captured_locals: closure.captured_locals.clone(),
+                        lets: closure.lets.clone(),
                     }
                 };
                 shared.replace(replacement);
@@ -123,6 +192,7 @@ impl Closable for Scope {
                         parent: func.parent.clone(),
                         captured: func.captured,
                         captured_locals: func.captured_locals.clone(),
+                        lets: func.lets.clone(),
                     }
                 };
                 shared.replace(replacement);
@@ -138,6 +208,7 @@ impl Closable for Scope {
                     ModuleScope {
                         statics,
                         captured_statics: module.captured_statics.clone(),
+                        structs: module.structs.clone(),
                     }
                 };
                 shared.replace(replacement);
@@ -268,6 +339,8 @@ pub struct ClosureScope {
     captured: bool,
     /// Locals in this scope which are captured by closures.
     captured_locals: HashSet<String>,
+    /// Locals which are bound with `let`.
+    lets: HashSet<String>,
 }
 
 impl ClosureScope {
@@ -278,6 +351,7 @@ impl ClosureScope {
             captures: false,
             captured: false,
             captured_locals: HashSet::new(),
+            lets: HashSet::new(),
         }
     }
 }
@@ -350,6 +424,8 @@ pub struct FuncScope {
     /// Whether or not this scope is captured by child scopes (closures).
     captured: bool,
     captured_locals: HashSet<String>,
+    /// Locals which are bound with `let`.
+    lets: HashSet<String>,
 }
 
 impl FuncScope {
@@ -359,6 +435,7 @@ impl FuncScope {
             parent,
             captured: false,
             captured_locals: HashSet::new(),
+            lets: HashSet::new(),
         }
     }
 
@@ -431,6 +508,8 @@ pub struct ModuleScope {
     pub statics: HashMap<String, Type>,
     // Keeping track of which statics are used by child scopes. Not sure why...
     captured_statics: HashSet<String>,
+    /// Classes of the structs defined in the module.
+    structs: HashMap<String, Class>,
 }
 
 impl ModuleScope {
@@ -438,6 +517,7 @@ impl ModuleScope {
         Self {
             statics: HashMap::new(),
             captured_statics: HashSet::new(),
+            structs: HashMap::new(),
         }
     }
 }
@@ -1,18 +1,30 @@
+use std::sync::Arc;
+
 use super::super::parse_ast as past;
+use super::super::parser::Token;
+use super::super::trace;
 use super::nodes::*;
-use super::scope::{ClosureScope, FuncScope, ModuleScope, Scope, ScopeLike};
-use super::typ::{Generic, Type, Variable};
+use super::scope::{ClosureScope, FuncScope, ModuleScope, Scope, ScopeLike, ScopeResolution};
+use super::typ::{next_uid, Class, DerivedClass, Field, Generic, Type, Variable};
 use super::{unify, Builtins, Closable, RecursionTracker, TypeError, TypeResult};
 
 pub fn translate_module(pmodule: past::Module) -> TypeResult<Module> {
-    let scope = ModuleScope::new().into_scope();
+    translate_module_in_scope(pmodule, ModuleScope::new().into_scope())
+}
 
+/// Translate into an existing module scope so that the module's statements
+/// can see statics defined by earlier translations (eg. in the REPL).
+pub fn translate_module_in_scope(pmodule: past::Module, scope: Scope) -> TypeResult<Module> {
     let mut statements = vec![];
     for pstatement in pmodule.statements.into_iter() {
         let statement = match pstatement {
             past::ModuleStatement::Func(pfunc) => {
                 ModuleStatement::Func(translate_func(&pfunc, scope.clone())?)
             }
+            past::ModuleStatement::Struct(pstruct) => {
+                translate_struct(&pstruct, scope.clone())?;
+                continue;
+            }
             past::ModuleStatement::CommentLine(_) => continue,
             _ => unreachable!(),
         };
@@ -32,8 +44,44 @@ pub fn translate_module(pmodule: past::Module) -> TypeResult<Module> {
     Ok(Module { statements, scope })
 }
 
+/// Structs only define a class: they're constructed by calling them (see
+/// `translate_struct_literal`) so nothing is left in the typed AST.
+fn translate_struct(pstruct: &past::Struct, scope: Scope) -> TypeResult<()> {
+    let mut fields: Vec<Field> = vec![];
+    for pfield in pstruct.fields.iter() {
+        if fields.iter().any(|field| field.name == pfield.name.name) {
+            return Err(TypeError::LocalAlreadyDefined {
+                name: pfield.name.name.clone(),
+            }
+            .with_span(pfield.name.span.clone()));
+        }
+        // Fields can only be builtins or structs defined before this one, so
+        // a struct can never contain itself.
+        let name = &pfield.typ.name;
+        let class = match Builtins::get_all().get(name) {
+            Some(class) => class.clone(),
+            None => scope.get_struct(name).ok_or_else(|| {
+                TypeError::ClassNotFound { name: name.clone() }.with_span(pfield.typ.span.clone())
+            })?,
+        };
+        fields.push(Field {
+            name: pfield.name.name.clone(),
+            class,
+        });
+    }
+    let class = Class::Derived(Arc::new(DerivedClass {
+        id: next_uid(),
+        name: pstruct.name.name.clone(),
+        fields,
+    }));
+    scope
+        .add_struct(&pstruct.name.name, class)
+        .map_err(|err| err.with_span(pstruct.name.span.clone()))
+}
+
 fn translate_func(pfunc: &past::Func, scope: Scope) -> TypeResult<Func> {
     let name = pfunc.name.name.clone();
+    let _span = trace::span("type-check", "type", None, Some(&name));
     // The scope that the function's arguments and body will be evaluated in.
     let func_scope = FuncScope::new(Some(scope.clone())).into_scope();
 
@@ -72,33 +120,49 @@ fn translate_func(pfunc: &past::Func, scope: Scope) -> TypeResult<Func> {
     let implicit_retrn = &body.typ;
     unify(&retrn, implicit_retrn, func_scope.clone())?;
 
-    Ok(Func {
+    let func = Func {
         name: name.clone(),
         arguments: arguments_nodes,
         body,
         scope: func_scope.clone(),
         typ,
-    }
-    .close(&mut RecursionTracker::new(), func_scope)?)
+    };
+    let _span = trace::span("close", "type", None, Some(&name));
+    Ok(func.close(&mut RecursionTracker::new(), func_scope)?)
 }
 
 fn translate_block(pblock: &past::Block, scope: Scope) -> TypeResult<Block> {
     let mut statements = vec![];
+    // Lets bound in this block, which go out of scope at the end of it.
+    let mut lets = vec![];
     for pstatement in &pblock.statements {
         let statement = match pstatement {
             past::BlockStatement::CommentLine(_) => continue,
+            past::BlockStatement::Assignment(passignment) => {
+                BlockStatement::Assignment(translate_assignment(passignment, scope.clone())?)
+            }
             past::BlockStatement::Func(pfunc) => {
                 BlockStatement::Func(translate_func(pfunc, scope.clone())?)
             }
             past::BlockStatement::Expression(pexpression) => {
                 BlockStatement::Expression(translate_expression(&pexpression, scope.clone())?)
             }
+            past::BlockStatement::Let(plet) => {
+                lets.push(plet.name.name.clone());
+                BlockStatement::Let(translate_let(plet, scope.clone())?)
+            }
             past::BlockStatement::Var(pvar) => {
                 BlockStatement::Var(translate_var(pvar, scope.clone())?)
             }
+            past::BlockStatement::While(pwhile) => {
+                BlockStatement::While(translate_while(pwhile, scope.clone())?)
+            }
         };
         statements.push(statement);
     }
+    for name in lets.iter() {
+        scope.remove_let(name);
+    }
     let typ = if statements.is_empty() {
         Type::new_empty_tuple(scope)
     } else {
@@ -111,6 +175,20 @@ fn translate_block(pblock: &past::Block, scope: Scope) -> TypeResult<Block> {
     })
 }
 
+fn translate_let(plet: &past::Let, scope: Scope) -> TypeResult<Let> {
+    // The initializer can't refer to the binding itself.
+    let initializer = translate_expression(&plet.initializer, scope.clone())?;
+    let typ = initializer.typ().clone();
+    scope
+        .add_let(&plet.name.name, typ.clone())
+        .map_err(|err| err.with_span(plet.name.span.clone()))?;
+    Ok(Let {
+        name: plet.name.clone(),
+        initializer,
+        typ,
+    })
+}
+
 fn translate_var(pvar: &past::Var, scope: Scope) -> TypeResult<Var> {
     let typ = Type::new_unbound(scope.clone());
     scope.add_local(&pvar.name.name, typ.clone())?;
@@ -129,6 +207,67 @@ fn translate_var(pvar: &past::Var, scope: Scope) -> TypeResult<Var> {
     })
 }
 
+fn translate_assignment(passignment: &past::Assignment, scope: Scope) -> TypeResult<Assignment> {
+    let name = passignment.name.clone();
+    let resolution = scope
+        .get_local(&name.name)
+        .map_err(|err| err.with_span(name.span.clone()))?;
+    // Only `var`s of the current func have a slot that can be written to.
+    match resolution {
+        ScopeResolution::Local(_, ref typ) if !typ.is_func() && !scope.is_let(&name.name) => (),
+        _ => {
+            return Err(TypeError::CannotAssign {
+                name: name.name.clone(),
+            }
+            .with_span(name.span.clone()))
+        }
+    }
+    let value = translate_expression(&passignment.value, scope.clone())?;
+    unify(&resolution.typ(), value.typ(), scope.clone())?;
+    Ok(Assignment {
+        name,
+        value,
+        typ: Type::new_empty_tuple(scope),
+    })
+}
+
+fn translate_while(pwhile: &past::While, scope: Scope) -> TypeResult<While> {
+    let condition = translate_expression(&pwhile.condition, scope.clone())?;
+    let bool = Type::new_object(Builtins::get("Bool"), scope.clone());
+    unify(condition.typ(), &bool, scope.clone())?;
+    let block = translate_block(&pwhile.block, scope.clone())?;
+    Ok(While {
+        condition,
+        block,
+        typ: Type::new_empty_tuple(scope),
+    })
+}
+
+fn translate_if(pif: &past::If, scope: Scope) -> TypeResult<If> {
+    let condition = translate_expression(&pif.condition, scope.clone())?;
+    let bool = Type::new_object(Builtins::get("Bool"), scope.clone());
+    unify(condition.typ(), &bool, scope.clone())?;
+    let block = translate_block(&pif.block, scope.clone())?;
+    let els = match &pif.els {
+        Some(pels) => Some(translate_block(pels, scope.clone())?),
+        None => None,
+    };
+    // Only an `if` with an `else` always produces a value.
+    let typ = match &els {
+        Some(els) => {
+            unify(&block.typ, &els.typ, scope)?;
+            block.typ.clone()
+        }
+        None => Type::new_empty_tuple(scope),
+    };
+    Ok(If {
+        condition: Box::new(condition),
+        block,
+        els,
+        typ,
+    })
+}
+
 fn translate_expression(pexpression: &past::Expression, scope: Scope) -> TypeResult<Expression> {
     Ok(match pexpression {
         past::Expression::Closure(pclosure) => {
@@ -146,12 +285,24 @@ fn translate_expression(pexpression: &past::Expression, scope: Scope) -> TypeRes
                 typ,
             })
         }
+        past::Expression::If(pif) => Expression::If(translate_if(pif, scope)?),
         past::Expression::Infix(pinfix) => {
             let lhs = translate_expression(&*pinfix.lhs, scope.clone())?;
             let rhs = translate_expression(&*pinfix.rhs, scope.clone())?;
             // Left- and right-hand sides must be the same in an infix operation.
-            unify(lhs.typ(), rhs.typ(), scope)?;
-            let typ = rhs.typ().clone();
+            unify(lhs.typ(), rhs.typ(), scope.clone())?;
+            // Infix operators are only defined on integers for now.
+            let int = Type::new_object(Builtins::get("Int"), scope.clone());
+            unify(rhs.typ(), &int, scope.clone())?;
+            let typ = match &pinfix.op {
+                Token::EqualsEquals(_)
+                | Token::BangEquals(_)
+                | Token::LessThan(_)
+                | Token::LessThanEquals(_)
+                | Token::GreaterThan(_)
+                | Token::GreaterThanEquals(_) => Type::new_object(Builtins::get("Bool"), scope),
+                _ => rhs.typ().clone(),
+            };
             Expression::Infix(Infix {
                 lhs: Box::new(lhs),
                 op: pinfix.op.clone(),
@@ -167,11 +318,29 @@ fn translate_expression(pexpression: &past::Expression, scope: Scope) -> TypeRes
             })
         }
         past::Expression::PostfixCall(pcall) => {
+            if let past::Expression::Identifier(pidentifier) = &*pcall.target {
+                if let Some(class) = scope.get_struct(&pidentifier.name.name) {
+                    return Ok(Expression::StructLiteral(translate_struct_literal(
+                        pcall, class, scope,
+                    )?));
+                }
+            }
             Expression::PostfixCall(translate_postfix_call(pcall, scope)?)
         }
         past::Expression::PostfixProperty(pproperty) => {
             Expression::PostfixProperty(translate_postfix_property(pproperty, scope)?)
         }
+        past::Expression::Tuple(ptuple) => {
+            let mut members = vec![];
+            for pmember in ptuple.members.iter() {
+                members.push(translate_expression(pmember, scope.clone())?);
+            }
+            let typ = Type::new_tuple(
+                members.iter().map(|member| member.typ().clone()).collect(),
+                scope,
+            );
+            Expression::Tuple(Tuple { members, typ })
+        }
     })
 }
 
@@ -292,6 +461,46 @@ fn translate_postfix_call(pcall: &past::PostfixCall, scope: Scope) -> TypeResult
     })
 }
 
+/// The arguments are the struct's fields in the order they're declared.
+fn translate_struct_literal(
+    pcall: &past::PostfixCall,
+    class: Class,
+    scope: Scope,
+) -> TypeResult<StructLiteral> {
+    let name = match &*pcall.target {
+        past::Expression::Identifier(pidentifier) => pidentifier.name.clone(),
+        other @ _ => unreachable!("Struct literal without a name: {:?}", other),
+    };
+    let field_types = match &class {
+        Class::Derived(derived) => derived
+            .fields
+            .iter()
+            .map(|field| Type::new_object(field.class.clone(), scope.clone()))
+            .collect::<Vec<_>>(),
+        Class::Intrinsic(_) => unreachable!("Builtins aren't structs"),
+    };
+    let mut fields = vec![];
+    for argument in pcall.arguments.iter() {
+        fields.push(translate_expression(argument, scope.clone())?);
+    }
+    if fields.len() != field_types.len() {
+        return Err(TypeError::ArgumentLengthMismatch {
+            expected: field_types,
+            got: fields.iter().map(|field| field.typ().clone()).collect(),
+        }
+        .with_span(pcall.span.clone()));
+    }
+    for (field, field_type) in fields.iter().zip(field_types.iter()) {
+        unify(field.typ(), field_type, scope.clone())
+            .map_err(|err| err.with_span(pcall.span.clone()))?;
+    }
+    Ok(StructLiteral {
+        name,
+        fields,
+        typ: Type::new_object(class, scope),
+    })
+}
+
 fn translate_postfix_property(
     pproperty: &past::PostfixProperty,
     scope: Scope,
@@ -324,9 +533,9 @@ fn translate_postfix_property(
 mod tests {
     use super::super::super::parse_ast as past;
     use super::super::super::parser::{Location, Span, Token, Word};
-    use super::super::scope::{ClosureScope, ScopeLike};
+    use super::super::scope::{ClosureScope, FuncScope, ScopeLike};
     use super::super::{Builtins, Type, TypeError, Variable};
-    use super::{translate_expression, translate_func};
+    use super::{translate_block, translate_expression, translate_func};
 
     fn word<S: AsRef<str>>(name: S) -> Word {
         Word {
@@ -375,6 +584,47 @@ mod tests {
         Ok(())
     }
 
+    #[test]
+    fn test_translate_let() {
+        let plet = past::BlockStatement::Let(past::Let {
+            name: word("foo"),
+            initializer: past::Expression::LiteralInt(past::LiteralInt {
+                value: 1,
+                span: Span::unknown(),
+            }),
+            span: Span::unknown(),
+        });
+        let passignment = past::BlockStatement::Assignment(past::Assignment {
+            name: word("foo"),
+            value: past::Expression::LiteralInt(past::LiteralInt {
+                value: 2,
+                span: Span::unknown(),
+            }),
+            span: Span::unknown(),
+        });
+        let block = |statements| past::Block {
+            statements,
+            span: Span::unknown(),
+        };
+
+        // Lets can't be assigned to.
+        let scope = FuncScope::new(None).into_scope();
+        match translate_block(&block(vec![plet.clone(), passignment]), scope) {
+            Err(error) => match error.unwrap() {
+                TypeError::CannotAssign { name } => assert_eq!(name, "foo"),
+                other @ _ => panic!("Expected CannotAssign: {:?}", other),
+            },
+            Ok(_) => panic!("Expected an error"),
+        }
+
+        // Lets go out of scope at the end of their block (and so never end
+        // up in the stack frame).
+        let scope = FuncScope::new(None).into_scope();
+        translate_block(&block(vec![plet]), scope.clone()).unwrap();
+        assert!(scope.get_local("foo").is_err());
+        assert!(scope.unwrap_func().get_locals().is_empty());
+    }
+
     #[test]
     fn test_translate_func() -> Result<(), TypeError> {
         let pclosure = past::Closure {
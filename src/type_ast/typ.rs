@@ -3,6 +3,7 @@ use std::rc::Rc;
 use std::sync::atomic::{AtomicUsize, Ordering};
 use std::sync::Arc;
 
+use super::super::stats;
 use super::scope::Scope;
 use super::{Closable, RecursionTracker, TypeError, TypeResult};
 
@@ -12,6 +13,7 @@ lazy_static! {
 
 /// Returns an ID that is guaranteed to be unique amongst all threads.
 pub fn next_uid() -> usize {
+    stats::count_uid();
     UID.fetch_add(1, Ordering::SeqCst)
 }
 
@@ -91,10 +93,14 @@ impl Type {
     }
 
     pub fn new_empty_tuple(scope: Scope) -> Self {
+        Self::new_tuple(vec![], scope)
+    }
+
+    pub fn new_tuple(members: Vec<Type>, scope: Scope) -> Self {
         Type::Tuple(Tuple {
             id: next_uid(),
             scope,
-            members: vec![],
+            members,
         })
     }
 
@@ -188,6 +194,7 @@ impl Type {
     /// if we see it multiple times. This way links between argument and return
     /// types are preserved.
     pub fn open_duplicate(&self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Type> {
+        stats::count_open_duplicate();
         if let Some(known) = tracker.check(&self.id()) {
             return Ok(known);
         }
@@ -235,6 +242,15 @@ impl Type {
                 tracker.add(self.id(), open.clone());
                 Ok(open)
             }
+            Type::Tuple(tuple) => {
+                let mut open_members = vec![];
+                for member in tuple.members.iter() {
+                    open_members.push(member.open_duplicate(tracker, scope.clone())?);
+                }
+                let open = Type::new_tuple(open_members, scope);
+                tracker.add(tuple.id, open.clone());
+                Ok(open)
+            }
             _ => Ok(self.clone()),
         }
     }
@@ -327,6 +343,12 @@ impl Type {
                 }
                 Ok(())
             }
+            Type::Tuple(tuple) => {
+                for member in tuple.members.iter() {
+                    member.genericize(scope.clone())?;
+                }
+                Ok(())
+            }
             _ => Ok(()),
         }
     }
@@ -371,11 +393,32 @@ impl Type {
         Ok(Type::Func(func))
     }
 
+    /// How many substitutions have to be followed from the variable to get
+    /// to the type underneath.
+    fn substitute_chain_length(variable: &Rc<RefCell<Variable>>) -> usize {
+        let mut length = 0;
+        let mut current = variable.clone();
+        loop {
+            let next = match &*current.borrow() {
+                Variable::Substitute { substitute, .. } => match &**substitute {
+                    Type::Variable(next) => next.clone(),
+                    _ => return length + 1,
+                },
+                _ => return length,
+            };
+            length += 1;
+            current = next;
+        }
+    }
+
     fn close_variable(typ: Type, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
         let variable = match typ {
             Type::Variable(variable) => variable,
             other @ _ => unreachable!("Called close_variable on non-Variable: {:?}", other),
         };
+        if stats::is_enabled() {
+            stats::record_substitute_chain(Self::substitute_chain_length(&variable));
+        }
         // Uncomment to see types pre-closing:
         //   return Ok(Type::Variable(variable));
         let replacement = match &*variable.borrow() {
@@ -456,6 +499,7 @@ impl Closable for Type {
     /// When translation and unification is done we need to turn all the
     /// `Variable` types into closed, fixed types.
     fn close(self, tracker: &mut RecursionTracker, scope: Scope) -> TypeResult<Self> {
+        stats::count_close();
         // Skip closing if this variable isn't in the scope being closed.
         if !self.scope().within(&scope) {
             return Ok(self);
@@ -463,6 +507,17 @@ impl Closable for Type {
         match self {
             Type::Func(_) => Type::close_func(self, tracker, scope),
             Type::Variable(_) => Type::close_variable(self, tracker, scope),
+            Type::Tuple(tuple) => {
+                let mut members = vec![];
+                for member in tuple.members.into_iter() {
+                    members.push(member.close(tracker, scope.clone())?);
+                }
+                Ok(Type::Tuple(Tuple {
+                    id: tuple.id,
+                    scope: tuple.scope,
+                    members,
+                }))
+            }
             other @ _ => Ok(other),
         }
     }
@@ -661,9 +716,23 @@ pub struct IntrinsicClass {
 pub struct DerivedClass {
     pub id: TypeId,
     pub name: String,
+    /// In the order they were declared.
+    pub fields: Vec<Field>,
     // TODO: Parameters
 }
 
+impl DerivedClass {
+    pub fn get_field(&self, name: &str) -> Option<&Field> {
+        self.fields.iter().find(|field| field.name == name)
+    }
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct Field {
+    pub name: String,
+    pub class: Class,
+}
+
 #[derive(Clone, Debug)]
 pub struct Tuple {
     pub id: TypeId,
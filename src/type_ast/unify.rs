@@ -1,8 +1,9 @@
 use std::cell::{Ref, RefCell, RefMut};
 use std::rc::Rc;
 
+use super::super::stats;
 use super::scope::Scope;
-use super::typ::{Func, Generic, GenericConstraint, Object, Type, Variable};
+use super::typ::{Class, Func, Generic, GenericConstraint, Object, Tuple, Type, Variable};
 use super::{TypeError, TypeResult};
 
 /// Unify a variable (mutable) generic with another generic.
@@ -88,18 +89,49 @@ pub fn unify_variable_generic_with_generic(
     Ok(())
 }
 
-/// Check if an object satisfies a generic's constraints.
-fn object_satisfies_constraints(generic: &Generic, object: &Rc<Object>) -> TypeResult<()> {
-    if generic.constraints.is_empty() {
-        return Ok(());
+/// Check if an object satisfies a generic's constraints. Only the fields of
+/// derived classes (structs) are properties; nothing is callable.
+fn object_satisfies_constraints(
+    generic: &Generic,
+    object: &Rc<Object>,
+    scope: Scope,
+) -> TypeResult<()> {
+    for constraint in generic.constraints.iter() {
+        use GenericConstraint::*;
+        match constraint {
+            Property(property) => {
+                let field = match &object.class {
+                    Class::Derived(derived) => derived.get_field(&property.name),
+                    Class::Intrinsic(_) => None,
+                };
+                match field {
+                    Some(field) => unify(
+                        &Type::new_object(field.class.clone(), scope.clone()),
+                        &property.typ,
+                        scope.clone(),
+                    )?,
+                    None => {
+                        return Err(TypeError::PropertyNotFound {
+                            name: property.name.clone(),
+                            typ: Type::Object(object.clone()),
+                        })
+                    }
+                }
+            }
+            Callable(callable) => {
+                return Err(TypeError::TypeMismatch {
+                    expected: Type::Object(object.clone()),
+                    got: Type::new_func(
+                        None,
+                        callable.arguments.clone(),
+                        callable.retrn.clone(),
+                        scope.clone(),
+                    ),
+                })
+            }
+        }
     }
-    // TODO: Actually check each constraint against the object.
-    Err(TypeError::InternalError {
-        message: format!(
-            "Object doesn't satisfy constraints:\nobject: {:?}\nconstraints: {:?}",
-            object, generic.constraints,
-        ),
-    })
+    Ok(())
 }
 
 /// If the generic has a callable constraint it will unify the func with that
@@ -144,7 +176,46 @@ fn func_satisfies_constraints(generic: &Generic, func: &Rc<Func>, scope: Scope)
     Ok(())
 }
 
+/// Tuples only have properties for their members' indices (eg. `pair.0`),
+/// so unify the types of those with the generic's property constraints.
+fn tuple_satisfies_constraints(generic: &Generic, tuple: &Tuple, scope: Scope) -> TypeResult<()> {
+    for constraint in generic.constraints.iter() {
+        use GenericConstraint::*;
+        match constraint {
+            Property(property) => {
+                let member = property
+                    .name
+                    .parse::<usize>()
+                    .ok()
+                    .and_then(|index| tuple.members.get(index));
+                match member {
+                    Some(member) => unify(member, &property.typ, scope.clone())?,
+                    None => {
+                        return Err(TypeError::PropertyNotFound {
+                            name: property.name.clone(),
+                            typ: Type::Tuple(tuple.clone()),
+                        })
+                    }
+                }
+            }
+            Callable(callable) => {
+                return Err(TypeError::TypeMismatch {
+                    expected: Type::Tuple(tuple.clone()),
+                    got: Type::new_func(
+                        None,
+                        callable.arguments.clone(),
+                        callable.retrn.clone(),
+                        scope.clone(),
+                    ),
+                })
+            }
+        }
+    }
+    Ok(())
+}
+
 pub fn unify(typ1: &Type, typ2: &Type, scope: Scope) -> TypeResult<()> {
+    let _depth = stats::enter_unify();
     if typ1 == typ2 {
         return Ok(());
     }
@@ -166,6 +237,7 @@ pub fn unify(typ1: &Type, typ2: &Type, scope: Scope) -> TypeResult<()> {
             UnifyGenerics,
             UnifyGenericWithObject(Rc<Object>),
             UnifyGenericWithFunc(Rc<Func>),
+            UnifyGenericWithTuple(Tuple),
         }
         use Action::*;
 
@@ -197,6 +269,7 @@ pub fn unify(typ1: &Type, typ2: &Type, scope: Scope) -> TypeResult<()> {
                         }
                     }
                     Type::Func(func2) => UnifyGenericWithFunc(func2.clone()),
+                    Type::Tuple(tuple2) => UnifyGenericWithTuple(tuple2.clone()),
                     _ => {
                         return Err(TypeError::TypeMismatch {
                             expected: typ1.clone(),
@@ -241,7 +314,7 @@ pub fn unify(typ1: &Type, typ2: &Type, scope: Scope) -> TypeResult<()> {
                 {
                     // First ensure the object satisfies our constraints.
                     let generic = Ref::map(var1.borrow(), Variable::unwrap_generic);
-                    object_satisfies_constraints(&generic, &object)?;
+                    object_satisfies_constraints(&generic, &object, scope.clone())?;
                 }
                 // If the constraints are all satisfied then we can substitute
                 // ourselves for the object.
@@ -264,6 +337,17 @@ pub fn unify(typ1: &Type, typ2: &Type, scope: Scope) -> TypeResult<()> {
                 };
                 Ok(())
             }
+            UnifyGenericWithTuple(tuple) => {
+                {
+                    let generic = Ref::map(var1.borrow(), Variable::unwrap_generic);
+                    tuple_satisfies_constraints(&generic, &tuple, scope.clone())?;
+                }
+                *var1.borrow_mut() = Variable::Substitute {
+                    scope,
+                    substitute: Box::new(Type::Tuple(tuple)),
+                };
+                Ok(())
+            }
         };
     }
 
@@ -292,6 +376,18 @@ pub fn unify(typ1: &Type, typ2: &Type, scope: Scope) -> TypeResult<()> {
             let func2_return = &*func2.retrn.borrow();
             return unify(&func1_return, &func2_return, scope);
         }
+        (Type::Tuple(tuple1), Type::Tuple(tuple2)) => {
+            if tuple1.members.len() != tuple2.members.len() {
+                return Err(TypeError::TypeMismatch {
+                    expected: typ1.clone(),
+                    got: typ2.clone(),
+                });
+            }
+            for (member1, member2) in tuple1.members.iter().zip(tuple2.members.iter()) {
+                unify(member1, member2, scope.clone())?;
+            }
+            return Ok(());
+        }
         _ => (),
     }
 